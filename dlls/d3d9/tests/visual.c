@@ -21901,6 +21901,154 @@ static void test_line_antialiasing_blending(void)
     DestroyWindow(window);
 }
 
+static void fill_texture(IDirect3DTexture9 *texture, D3DCOLOR color)
+{
+    D3DLOCKED_RECT locked_rect;
+    HRESULT hr;
+
+    hr = IDirect3DTexture9_LockRect(texture, 0, &locked_rect, NULL, 0);
+    ok(SUCCEEDED(hr), "Failed to lock texture, hr %#x.\n", hr);
+    *(D3DCOLOR *)locked_rect.pBits = color;
+    hr = IDirect3DTexture9_UnlockRect(texture, 0);
+    ok(SUCCEEDED(hr), "Failed to unlock texture, hr %#x.\n", hr);
+}
+
+static void test_rebind_resources(void)
+{
+    IDirect3DVertexBuffer9 *vb[2];
+    IDirect3DTexture9 *texture[2];
+    IDirect3DDevice9 *device;
+    IDirect3D9 *d3d;
+    unsigned int i;
+    ULONG refcount;
+    D3DCOLOR color;
+    HWND window;
+    HRESULT hr;
+    void *data;
+
+    static const struct
+    {
+        struct vec4 position;
+        struct vec2 texcoord;
+    }
+    quads[2][4] =
+    {
+        {
+            {{  0.0f,   0.0f, 0.1f, 1.0f}, {0.0f, 0.0f}},
+            {{320.0f,   0.0f, 0.1f, 1.0f}, {1.0f, 0.0f}},
+            {{  0.0f, 480.0f, 0.1f, 1.0f}, {0.0f, 1.0f}},
+            {{320.0f, 480.0f, 0.1f, 1.0f}, {1.0f, 1.0f}},
+        },
+        {
+            {{320.0f,   0.0f, 0.1f, 1.0f}, {0.0f, 0.0f}},
+            {{640.0f,   0.0f, 0.1f, 1.0f}, {1.0f, 0.0f}},
+            {{320.0f, 480.0f, 0.1f, 1.0f}, {0.0f, 1.0f}},
+            {{640.0f, 480.0f, 0.1f, 1.0f}, {1.0f, 1.0f}},
+        },
+    };
+    static const D3DCOLOR colors[] = {0x00ff0000, 0x0000ff00};
+
+    /* With a multithreaded command stream, draws are executed after the
+     * application has already bound other resources. Locking the resources
+     * used by the first draw must neither hang nor change what it drew. */
+    window = create_window();
+    d3d = Direct3DCreate9(D3D_SDK_VERSION);
+    ok(!!d3d, "Failed to create a D3D object.\n");
+    if (!(device = create_device(d3d, window, window, TRUE)))
+    {
+        skip("Failed to create a D3D device, skipping tests.\n");
+        goto done;
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        hr = IDirect3DDevice9_CreateTexture(device, 1, 1, 1, 0, D3DFMT_X8R8G8B8,
+                D3DPOOL_MANAGED, &texture[i], NULL);
+        ok(SUCCEEDED(hr), "Failed to create texture, hr %#x.\n", hr);
+        fill_texture(texture[i], colors[i]);
+
+        hr = IDirect3DDevice9_CreateVertexBuffer(device, sizeof(quads[i]), 0, D3DFVF_XYZRHW | D3DFVF_TEX1,
+                D3DPOOL_MANAGED, &vb[i], NULL);
+        ok(SUCCEEDED(hr), "Failed to create vertex buffer, hr %#x.\n", hr);
+        hr = IDirect3DVertexBuffer9_Lock(vb[i], 0, sizeof(quads[i]), &data, 0);
+        ok(SUCCEEDED(hr), "Failed to lock vertex buffer, hr %#x.\n", hr);
+        memcpy(data, quads[i], sizeof(quads[i]));
+        hr = IDirect3DVertexBuffer9_Unlock(vb[i]);
+        ok(SUCCEEDED(hr), "Failed to unlock vertex buffer, hr %#x.\n", hr);
+    }
+
+    hr = IDirect3DDevice9_SetRenderState(device, D3DRS_ZENABLE, D3DZB_FALSE);
+    ok(SUCCEEDED(hr), "Failed to disable Z test, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetRenderState(device, D3DRS_LIGHTING, FALSE);
+    ok(SUCCEEDED(hr), "Failed to disable lighting, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetTextureStageState(device, 0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+    ok(SUCCEEDED(hr), "Failed to set color op, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetTextureStageState(device, 0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+    ok(SUCCEEDED(hr), "Failed to set color arg, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZRHW | D3DFVF_TEX1);
+    ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
+
+    hr = IDirect3DDevice9_Clear(device, 0, NULL, D3DCLEAR_TARGET, 0x000000ff, 0.0f, 0);
+    ok(SUCCEEDED(hr), "Failed to clear, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_BeginScene(device);
+    ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+    for (i = 0; i < 2; ++i)
+    {
+        hr = IDirect3DDevice9_SetStreamSource(device, 0, vb[i], 0, sizeof(*quads[i]));
+        ok(SUCCEEDED(hr), "Failed to set stream source, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_SetTexture(device, 0, (IDirect3DBaseTexture9 *)texture[i]);
+        ok(SUCCEEDED(hr), "Failed to set texture, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_DrawPrimitive(device, D3DPT_TRIANGLESTRIP, 0, 2);
+        ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+    }
+    hr = IDirect3DDevice9_EndScene(device);
+    ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+
+    /* Neither resource is bound anymore, but the first draw may still be
+     * queued. */
+    fill_texture(texture[0], 0x00ffffff);
+    hr = IDirect3DVertexBuffer9_Lock(vb[0], 0, sizeof(quads[0]), &data, 0);
+    ok(SUCCEEDED(hr), "Failed to lock vertex buffer, hr %#x.\n", hr);
+    memcpy(data, quads[0], sizeof(quads[0]));
+    hr = IDirect3DVertexBuffer9_Unlock(vb[0]);
+    ok(SUCCEEDED(hr), "Failed to unlock vertex buffer, hr %#x.\n", hr);
+
+    color = getPixelColor(device, 160, 240);
+    ok(color_match(color, 0x00ff0000, 1), "Got unexpected color 0x%08x.\n", color);
+    color = getPixelColor(device, 480, 240);
+    ok(color_match(color, 0x0000ff00, 1), "Got unexpected color 0x%08x.\n", color);
+
+    hr = IDirect3DDevice9_BeginScene(device);
+    ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetStreamSource(device, 0, vb[0], 0, sizeof(*quads[0]));
+    ok(SUCCEEDED(hr), "Failed to set stream source, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_SetTexture(device, 0, (IDirect3DBaseTexture9 *)texture[0]);
+    ok(SUCCEEDED(hr), "Failed to set texture, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_DrawPrimitive(device, D3DPT_TRIANGLESTRIP, 0, 2);
+    ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+    hr = IDirect3DDevice9_EndScene(device);
+    ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+
+    color = getPixelColor(device, 160, 240);
+    ok(color_match(color, 0x00ffffff, 1), "Got unexpected color 0x%08x.\n", color);
+    color = getPixelColor(device, 480, 240);
+    ok(color_match(color, 0x0000ff00, 1), "Got unexpected color 0x%08x.\n", color);
+
+    hr = IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+    ok(SUCCEEDED(hr), "Failed to present, hr %#x.\n", hr);
+
+    for (i = 0; i < 2; ++i)
+    {
+        IDirect3DVertexBuffer9_Release(vb[i]);
+        IDirect3DTexture9_Release(texture[i]);
+    }
+    refcount = IDirect3DDevice9_Release(device);
+    ok(!refcount, "Device has %u references left.\n", refcount);
+done:
+    IDirect3D9_Release(d3d);
+    DestroyWindow(window);
+}
+
 START_TEST(visual)
 {
     D3DADAPTER_IDENTIFIER9 identifier;
@@ -22025,4 +22173,5 @@ START_TEST(visual)
     test_texture_blending();
     test_color_clamping();
     test_line_antialiasing_blending();
+    test_rebind_resources();
 }
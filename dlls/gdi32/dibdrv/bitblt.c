@@ -22,6 +22,7 @@
 
 #include "gdi_private.h"
 #include "dibdrv.h"
+#include "winternl.h"
 
 #include "wine/debug.h"
 
@@ -581,19 +582,200 @@ static void mask_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     }
 }
 
+/* Large operations are split into horizontal bands that are processed in
+ * parallel by the calling thread and a few worker threads. The bands don't
+ * overlap, so the results are the same as when processing them in order. */
+
+#define BAND_MIN_AREA    (512 * 512)
+#define BAND_MIN_HEIGHT  32
+#define MAX_BAND_THREADS 7
+#define MAX_BANDS        (4 * (MAX_BAND_THREADS + 1))
+
+struct band_job
+{
+    void (*func)( struct band_job *job, int band );  /* process a single band */
+    int  count;  /* number of bands */
+    LONG next;   /* next band to process */
+    LONG refs;   /* number of threads using the job, protected by band_job_section */
+};
+
+static struct band_job *band_job;  /* job that the workers can join, protected by band_job_section */
+static HANDLE band_wakeup;         /* semaphore waking up the workers */
+static HANDLE band_done;           /* signaled when the workers that joined are done with the job */
+static int band_threads;           /* number of workers, -1 if they can't be started */
+
+static CRITICAL_SECTION band_section;
+static CRITICAL_SECTION_DEBUG band_critsect_debug =
+{
+    0, 0, &band_section,
+    { &band_critsect_debug.ProcessLocksList, &band_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": band_section") }
+};
+static CRITICAL_SECTION band_section = { &band_critsect_debug, -1, 0, 0, 0, 0 };
+
+static CRITICAL_SECTION band_job_section;
+static CRITICAL_SECTION_DEBUG band_job_critsect_debug =
+{
+    0, 0, &band_job_section,
+    { &band_job_critsect_debug.ProcessLocksList, &band_job_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": band_job_section") }
+};
+static CRITICAL_SECTION band_job_section = { &band_job_critsect_debug, -1, 0, 0, 0, 0 };
+
+static void process_bands( struct band_job *job )
+{
+    int band;
+
+    while ((band = InterlockedIncrement( &job->next ) - 1) < job->count) job->func( job, band );
+}
+
+static DWORD WINAPI band_thread( void *arg )
+{
+    struct band_job *job;
+
+    for (;;)
+    {
+        WaitForSingleObject( band_wakeup, INFINITE );
+
+        /* the wakeup may be for a job that is already finished */
+        EnterCriticalSection( &band_job_section );
+        if ((job = band_job)) job->refs++;
+        LeaveCriticalSection( &band_job_section );
+        if (!job) continue;
+
+        process_bands( job );
+
+        EnterCriticalSection( &band_job_section );
+        if (!--job->refs) SetEvent( band_done );
+        LeaveCriticalSection( &band_job_section );
+    }
+    return 0;
+}
+
+/* must be called inside band_section */
+static BOOL start_band_threads(void)
+{
+    SYSTEM_INFO info;
+    HANDLE thread;
+    int i, count;
+
+    if (band_threads) return band_threads > 0;
+    band_threads = -1;
+
+    GetSystemInfo( &info );
+    count = min( info.dwNumberOfProcessors - 1, MAX_BAND_THREADS );
+    if (count <= 0) return FALSE;
+    if (!(band_wakeup = CreateSemaphoreW( NULL, 0, 0x7fffffff, NULL ))) return FALSE;
+    if (!(band_done = CreateEventW( NULL, FALSE, FALSE, NULL ))) return FALSE;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(thread = CreateThread( NULL, 0, band_thread, NULL, 0, NULL ))) break;
+        CloseHandle( thread );
+    }
+    TRACE( "started %d threads\n", i );
+    if (!i) return FALSE;
+    band_threads = i;
+    return TRUE;
+}
+
+/* number of bands to split a rectangle into */
+static int get_band_count( const RECT *rect )
+{
+    int width = rect->right - rect->left, height = rect->bottom - rect->top;
+
+    if ((LONGLONG)width * height < BAND_MIN_AREA) return 1;
+    return max( 1, min( height / BAND_MIN_HEIGHT, MAX_BANDS ));
+}
+
+static void get_band_rect( const RECT *rect, int band, int count, RECT *ret )
+{
+    int height = rect->bottom - rect->top;
+
+    ret->left   = rect->left;
+    ret->right  = rect->right;
+    ret->top    = rect->top + MulDiv( height, band, count );
+    ret->bottom = rect->top + MulDiv( height, band + 1, count );
+}
+
+static void run_band_job( struct band_job *job )
+{
+    int workers;
+    LONG remaining;
+
+    job->next = 0;
+    job->refs = 1;
+
+    /* the workers may have been killed already */
+    if (job->count > 1 && !RtlDllShutdownInProgress() && TryEnterCriticalSection( &band_section ))
+    {
+        if (start_band_threads())
+        {
+            /* only wait for the workers that join the job; they may not be able to start
+             * at all, for instance if the loader lock is held */
+            workers = min( band_threads, job->count - 1 );
+            EnterCriticalSection( &band_job_section );
+            band_job = job;
+            LeaveCriticalSection( &band_job_section );
+            ReleaseSemaphore( band_wakeup, workers, NULL );
+            process_bands( job );
+
+            EnterCriticalSection( &band_job_section );
+            band_job = NULL;
+            remaining = --job->refs;
+            LeaveCriticalSection( &band_job_section );
+            if (remaining) WaitForSingleObject( band_done, INFINITE );
+            LeaveCriticalSection( &band_section );
+            return;
+        }
+        LeaveCriticalSection( &band_section );
+    }
+    /* the workers are busy with another operation */
+    process_bands( job );
+}
+
+struct blend_job
+{
+    struct band_job   job;
+    const dib_info   *dst;
+    const dib_info   *src;
+    const RECT       *rect;
+    POINT             origin;
+    BLENDFUNCTION     blend;
+};
+
+static void blend_band( struct band_job *job, int band )
+{
+    struct blend_job *blend = CONTAINING_RECORD( job, struct blend_job, job );
+    POINT origin = blend->origin;
+    RECT rect;
+
+    get_band_rect( blend->rect, band, job->count, &rect );
+    origin.y += rect.top - blend->rect->top;
+    blend->dst->funcs->blend_rect( blend->dst, &rect, blend->src, &origin, blend->blend );
+}
+
 static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src, const RECT *src_rect,
                          HRGN clip, BLENDFUNCTION blend )
 {
-    POINT origin;
+    struct blend_job job;
     struct clipped_rects clipped_rects;
     int i;
 
     if (!get_clipped_rects( dst, dst_rect, clip, &clipped_rects )) return ERROR_SUCCESS;
+    job.job.func = blend_band;
+    job.dst      = dst;
+    job.src      = src;
+    job.blend    = blend;
     for (i = 0; i < clipped_rects.count; i++)
     {
-        origin.x = src_rect->left + clipped_rects.rects[i].left - dst_rect->left;
-        origin.y = src_rect->top  + clipped_rects.rects[i].top  - dst_rect->top;
-        dst->funcs->blend_rect( dst, &clipped_rects.rects[i], src, &origin, blend );
+        job.rect     = &clipped_rects.rects[i];
+        job.origin.x = src_rect->left + clipped_rects.rects[i].left - dst_rect->left;
+        job.origin.y = src_rect->top  + clipped_rects.rects[i].top  - dst_rect->top;
+        /* the source rows must not be modified by the other bands */
+        if (src->bits.ptr == dst->bits.ptr) job.job.count = 1;
+        else job.job.count = get_band_count( job.rect );
+        run_band_job( &job.job );
     }
     free_clipped_rects( &clipped_rects );
     return ERROR_SUCCESS;
@@ -678,19 +860,46 @@ static void get_gradient_triangle_vertices( const GRADIENT_TRIANGLE *tri, const
     bounds->bottom = v[2].y;
 }
 
+struct gradient_job
+{
+    struct band_job   job;
+    const dib_info   *dib;
+    const RECT       *rect;
+    const TRIVERTEX  *v;
+    int               mode;
+    BOOL              ret;
+};
+
+static void gradient_band( struct band_job *job, int band )
+{
+    struct gradient_job *gradient = CONTAINING_RECORD( job, struct gradient_job, job );
+    RECT rect;
+
+    get_band_rect( gradient->rect, band, job->count, &rect );
+    if (!gradient->dib->funcs->gradient_rect( gradient->dib, &rect, gradient->v, gradient->mode ))
+        gradient->ret = FALSE;
+}
+
 static BOOL gradient_rect( dib_info *dib, TRIVERTEX *v, int mode, HRGN clip, const RECT *bounds )
 {
     int i;
+    struct gradient_job job;
     struct clipped_rects clipped_rects;
-    BOOL ret = TRUE;
 
     if (!get_clipped_rects( dib, bounds, clip, &clipped_rects )) return TRUE;
-    for (i = 0; i < clipped_rects.count; i++)
+    job.job.func = gradient_band;
+    job.dib      = dib;
+    job.v        = v;
+    job.mode     = mode;
+    job.ret      = TRUE;
+    for (i = 0; i < clipped_rects.count && job.ret; i++)
     {
-        if (!(ret = dib->funcs->gradient_rect( dib, &clipped_rects.rects[i], v, mode ))) break;
+        job.rect = &clipped_rects.rects[i];
+        job.job.count = get_band_count( job.rect );
+        run_band_job( &job.job );
     }
     free_clipped_rects( &clipped_rects );
-    return ret;
+    return job.ret;
 }
 
 static DWORD copy_src_bits( dib_info *src, RECT *src_rect )
@@ -1189,6 +1398,113 @@ static DWORD calc_1d_stretch_params( INT dst_start, INT dst_length, INT dst_vis_
 }
 
 
+struct stretch_state
+{
+    int   start;      /* index of the first row of the band */
+    POINT dst_start;
+    POINT src_start;
+    int   err;
+};
+
+struct stretch_job
+{
+    struct band_job              job;
+    dib_info                    *dst_dib;
+    const dib_info              *src_dib;
+    struct stretch_params        v_params;
+    struct stretch_params        h_params;
+    BOOL                         vstretch;
+    int                          width;
+    int                          mode;
+    void (* row_fn)(const dib_info *dst_dib, const POINT *dst_start,
+                    const dib_info *src_dib, const POINT *src_start,
+                    const struct stretch_params *params, int mode, BOOL keep_dst);
+    struct stretch_state         bands[MAX_BANDS + 1];
+};
+
+/* move to the next row in the vertical direction, returns TRUE when it starts a new
+ * source row if stretching, or a new destination row if shrinking */
+static BOOL next_stretch_row( struct stretch_state *state, const struct stretch_params *params, BOOL vstretch )
+{
+    BOOL ret = state->err > 0;
+
+    if (ret)
+    {
+        if (vstretch) state->src_start.y += params->src_inc;
+        else state->dst_start.y += params->dst_inc;
+        state->err += params->err_add_1;
+    }
+    else state->err += params->err_add_2;
+
+    if (vstretch) state->dst_start.y += params->dst_inc;
+    else state->src_start.y += params->src_inc;
+    return ret;
+}
+
+static void stretch_band( struct band_job *job, int band )
+{
+    struct stretch_job *stretch = CONTAINING_RECORD( job, struct stretch_job, job );
+    struct stretch_state state = stretch->bands[band];
+    int length = stretch->bands[band + 1].start - state.start;
+
+    if (stretch->vstretch)
+    {
+        BOOL need_row = TRUE;
+        RECT last_row, this_row;
+        last_row.left = 0;
+        last_row.right = stretch->width;
+
+        while (length--)
+        {
+            if (need_row)
+            {
+                stretch->row_fn( stretch->dst_dib, &state.dst_start, stretch->src_dib, &state.src_start,
+                                 &stretch->h_params, stretch->mode, FALSE );
+            }
+            else
+            {
+                last_row.top = state.dst_start.y - stretch->v_params.dst_inc;
+                last_row.bottom = last_row.top + 1;
+                this_row = last_row;
+                offset_rect( &this_row, 0, stretch->v_params.dst_inc );
+                copy_rect( stretch->dst_dib, &this_row, stretch->dst_dib, &last_row, NULL, R2_COPYPEN );
+            }
+            need_row = next_stretch_row( &state, &stretch->v_params, TRUE );
+        }
+    }
+    else
+    {
+        int merged_rows = 0;
+
+        while (length--)
+        {
+            if (stretch->mode != STRETCH_DELETESCANS || !merged_rows)
+                stretch->row_fn( stretch->dst_dib, &state.dst_start, stretch->src_dib, &state.src_start,
+                                 &stretch->h_params, stretch->mode, merged_rows != 0 );
+            merged_rows++;
+            if (next_stretch_row( &state, &stretch->v_params, FALSE )) merged_rows = 0;
+        }
+    }
+}
+
+/* split the rows into bands; a band starts with a new source row when stretching, since
+ * the previous destination row can't be copied, and with a new destination row when
+ * shrinking, since the rows merged into it have to be processed in order */
+static void get_stretch_bands( struct stretch_job *job, int count )
+{
+    struct stretch_state state = job->bands[0];
+    int length = job->v_params.length, band = 1;
+    BOOL new_row = TRUE;
+
+    for (state.start = 0; state.start < length && band < count; state.start++)
+    {
+        if (new_row && state.start >= MulDiv( length, band, count )) job->bands[band++] = state;
+        new_row = next_stretch_row( &state, &job->v_params, job->vstretch );
+    }
+    job->job.count = band;
+    job->bands[band].start = length;
+}
+
 DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bitblt_coords *src,
                           const BITMAPINFO *dst_info, void *dst_bits, struct bitblt_coords *dst,
                           INT mode )
@@ -1198,11 +1514,8 @@ DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bit
     RECT rect;
     BOOL hstretch, vstretch;
     struct stretch_params v_params, h_params;
-    int err;
+    struct stretch_job job;
     DWORD ret;
-    void (* row_fn)(const dib_info *dst_dib, const POINT *dst_start,
-                    const dib_info *src_dib, const POINT *src_start,
-                    const struct stretch_params *params, int mode, BOOL keep_dst);
 
     TRACE("dst %d, %d - %d x %d visrect %s src %d, %d - %d x %d visrect %s\n",
           dst->x, dst->y, dst->width, dst->height, wine_dbgstr_rect(&dst->visrect),
@@ -1236,64 +1549,21 @@ DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bit
     dst_start.x -= dst->visrect.left;
     dst_start.y -= dst->visrect.top;
 
-    err = v_params.err_start;
-
-    row_fn = hstretch ? dst_dib.funcs->stretch_row : dst_dib.funcs->shrink_row;
-
-    if (vstretch)
-    {
-        BOOL need_row = TRUE;
-        RECT last_row, this_row;
-        if (hstretch) mode = STRETCH_DELETESCANS;
-        last_row.left = 0;
-        last_row.right = dst->visrect.right - dst->visrect.left;
-
-        while (v_params.length--)
-        {
-            if (need_row)
-            {
-                row_fn( &dst_dib, &dst_start, &src_dib, &src_start, &h_params, mode, FALSE );
-                need_row = FALSE;
-            }
-            else
-            {
-                last_row.top = dst_start.y - v_params.dst_inc;
-                last_row.bottom = last_row.top + 1;
-                this_row = last_row;
-                offset_rect( &this_row, 0, v_params.dst_inc );
-                copy_rect( &dst_dib, &this_row, &dst_dib, &last_row, NULL, R2_COPYPEN );
-            }
-
-            if (err > 0)
-            {
-                src_start.y += v_params.src_inc;
-                need_row = TRUE;
-                err += v_params.err_add_1;
-            }
-            else err += v_params.err_add_2;
-            dst_start.y += v_params.dst_inc;
-        }
-    }
-    else
-    {
-        int merged_rows = 0;
-
-        while (v_params.length--)
-        {
-            if (mode != STRETCH_DELETESCANS || !merged_rows)
-                row_fn( &dst_dib, &dst_start, &src_dib, &src_start, &h_params, mode, merged_rows != 0 );
-            merged_rows++;
-
-            if (err > 0)
-            {
-                dst_start.y += v_params.dst_inc;
-                merged_rows = 0;
-                err += v_params.err_add_1;
-            }
-            else err += v_params.err_add_2;
-            src_start.y += v_params.src_inc;
-        }
-    }
+    job.job.func = stretch_band;
+    job.dst_dib  = &dst_dib;
+    job.src_dib  = &src_dib;
+    job.v_params = v_params;
+    job.h_params = h_params;
+    job.vstretch = vstretch;
+    job.width    = dst->visrect.right - dst->visrect.left;
+    job.mode     = (vstretch && hstretch) ? STRETCH_DELETESCANS : mode;
+    job.row_fn   = hstretch ? dst_dib.funcs->stretch_row : dst_dib.funcs->shrink_row;
+    job.bands[0].start     = 0;
+    job.bands[0].dst_start = dst_start;
+    job.bands[0].src_start = src_start;
+    job.bands[0].err       = v_params.err_start;
+    get_stretch_bands( &job, get_band_count( &dst->visrect ));
+    run_band_job( &job.job );
 
     /* update coordinates, the destination rectangle is always stored at 0,0 */
     *src = *dst;
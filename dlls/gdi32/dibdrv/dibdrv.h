@@ -223,6 +223,26 @@ struct rop_codes
     DWORD a1, a2, x1, x2;
 };
 
+/* optional vectorized versions of the inner loops of some primitives,
+ * they return the number of pixels processed (see simd.c) */
+struct dib_simd_funcs
+{
+    const char *name;
+    int               (* solid_line_32)(DWORD *ptr, DWORD and, DWORD xor, int len);
+    int               (* solid_line_16)(WORD *ptr, WORD and, WORD xor, int len);
+    int           (* rop_codes_line_32)(DWORD *dst, const DWORD *src, const struct rop_codes *codes, int len);
+    int       (* rop_codes_line_rev_32)(DWORD *dst, const DWORD *src, const struct rop_codes *codes, int len);
+    int           (* rop_codes_line_16)(WORD *dst, const WORD *src, const struct rop_codes *codes, int len);
+    int       (* rop_codes_line_rev_16)(WORD *dst, const WORD *src, const struct rop_codes *codes, int len);
+    int  (* blend_constant_alpha_line)(DWORD *dst, const DWORD *src, int len, DWORD alpha, BOOL src_alpha);
+    int             (* blend_argb_line)(DWORD *dst, const DWORD *src, int len, DWORD alpha);
+    int     (* convert_24_to_8888_line)(DWORD *dst, const BYTE *src, int len);
+    int    (* convert_555_to_8888_line)(DWORD *dst, const WORD *src, int len);
+    int    (* convert_8888_to_555_line)(WORD *dst, const DWORD *src, int len);
+};
+
+extern const struct dib_simd_funcs *dib_simd DECLSPEC_HIDDEN;
+
 #define OVERLAP_LEFT  0x01  /* dest starts left of source */
 #define OVERLAP_RIGHT 0x02  /* dest starts right of source */
 #define OVERLAP_ABOVE 0x04  /* dest starts above source */
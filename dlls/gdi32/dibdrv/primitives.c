@@ -148,24 +148,63 @@ static inline void do_rop_codes_mask_8(BYTE *dst, BYTE src, struct rop_codes *co
     do_rop_mask_8( dst, (src & codes->a1) ^ codes->a2, (src & codes->x1) ^ codes->x2, mask );
 }
 
+static inline void do_rop_line_32(DWORD *ptr, DWORD and, DWORD xor, int len)
+{
+    if (dib_simd)
+    {
+        int done = dib_simd->solid_line_32( ptr, and, xor, len );
+        ptr += done;
+        len -= done;
+    }
+    for (; len > 0; len--) do_rop_32( ptr++, and, xor );
+}
+
+static inline void do_rop_line_16(WORD *ptr, WORD and, WORD xor, int len)
+{
+    if (dib_simd)
+    {
+        int done = dib_simd->solid_line_16( ptr, and, xor, len );
+        ptr += done;
+        len -= done;
+    }
+    for (; len > 0; len--) do_rop_16( ptr++, and, xor );
+}
+
 static inline void do_rop_codes_line_32(DWORD *dst, const DWORD *src, struct rop_codes *codes, int len)
 {
+    if (dib_simd)
+    {
+        int done = dib_simd->rop_codes_line_32( dst, src, codes, len );
+        dst += done;
+        src += done;
+        len -= done;
+    }
     for (; len > 0; len--, src++, dst++) do_rop_codes_32( dst, *src, codes );
 }
 
 static inline void do_rop_codes_line_rev_32(DWORD *dst, const DWORD *src, struct rop_codes *codes, int len)
 {
+    /* the vectorized version processes the end of the line */
+    if (dib_simd) len -= dib_simd->rop_codes_line_rev_32( dst, src, codes, len );
     for (src += len - 1, dst += len - 1; len > 0; len--, src--, dst--)
         do_rop_codes_32( dst, *src, codes );
 }
 
 static inline void do_rop_codes_line_16(WORD *dst, const WORD *src, struct rop_codes *codes, int len)
 {
+    if (dib_simd)
+    {
+        int done = dib_simd->rop_codes_line_16( dst, src, codes, len );
+        dst += done;
+        src += done;
+        len -= done;
+    }
     for (; len > 0; len--, src++, dst++) do_rop_codes_16( dst, *src, codes );
 }
 
 static inline void do_rop_codes_line_rev_16(WORD *dst, const WORD *src, struct rop_codes *codes, int len)
 {
+    if (dib_simd) len -= dib_simd->rop_codes_line_rev_16( dst, src, codes, len );
     for (src += len - 1, dst += len - 1; len > 0; len--, src--, dst--)
         do_rop_codes_16( dst, *src, codes );
 }
@@ -525,8 +564,8 @@ static inline void memset_16( WORD *start, WORD val, DWORD size )
 
 static void solid_rects_32(const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor)
 {
-    DWORD *ptr, *start;
-    int x, y, i;
+    DWORD *start;
+    int y, i;
 
     for(i = 0; i < num; i++, rc++)
     {
@@ -535,8 +574,7 @@ static void solid_rects_32(const dib_info *dib, int num, const RECT *rc, DWORD a
         start = get_pixel_ptr_32(dib, rc->left, rc->top);
         if (and)
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
-                for(x = rc->left, ptr = start; x < rc->right; x++)
-                    do_rop_32(ptr++, and, xor);
+                do_rop_line_32( start, and, xor, rc->right - rc->left );
         else
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
                 memset_32( start, xor, rc->right - rc->left );
@@ -676,8 +714,8 @@ static void solid_rects_24(const dib_info *dib, int num, const RECT *rc, DWORD a
 
 static void solid_rects_16(const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor)
 {
-    WORD *ptr, *start;
-    int x, y, i;
+    WORD *start;
+    int y, i;
 
     for(i = 0; i < num; i++, rc++)
     {
@@ -686,8 +724,7 @@ static void solid_rects_16(const dib_info *dib, int num, const RECT *rc, DWORD a
         start = get_pixel_ptr_16(dib, rc->left, rc->top);
         if (and)
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 2)
-                for(x = rc->left, ptr = start; x < rc->right; x++)
-                    do_rop_16(ptr++, and, xor);
+                do_rop_line_16( start, and, xor, rc->right - rc->left );
         else
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 2)
                 memset_16( start, xor, rc->right - rc->left );
@@ -2115,7 +2152,15 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             dst_pixel = dst_start;
             src_pixel = src_start;
-            for(x = src_rect->left; x < src_rect->right; x++)
+            x = src_rect->left;
+            if (dib_simd)
+            {
+                int done = dib_simd->convert_24_to_8888_line( dst_pixel, src_pixel, src_rect->right - x );
+                dst_pixel += done;
+                src_pixel += done * 3;
+                x += done;
+            }
+            for(; x < src_rect->right; x++)
             {
                 RGBQUAD rgb;
                 rgb.rgbBlue  = *src_pixel++;
@@ -2140,7 +2185,15 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
             {
                 dst_pixel = dst_start;
                 src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = src_rect->left;
+                if (dib_simd)
+                {
+                    int done = dib_simd->convert_555_to_8888_line( dst_pixel, src_pixel, src_rect->right - x );
+                    dst_pixel += done;
+                    src_pixel += done;
+                    x += done;
+                }
+                for(; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = ((src_val << 9) & 0xf80000) | ((src_val << 4) & 0x070000) |
@@ -2841,7 +2894,15 @@ static void convert_to_555(dib_info *dst, const dib_info *src, const RECT *src_r
             {
                 dst_pixel = dst_start;
                 src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = src_rect->left;
+                if (dib_simd)
+                {
+                    int done = dib_simd->convert_8888_to_555_line( dst_pixel, src_pixel, src_rect->right - x );
+                    dst_pixel += done;
+                    src_pixel += done;
+                    x += done;
+                }
+                for(; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = ((src_val >> 9) & 0x7c00) |
@@ -4534,27 +4595,41 @@ static void blend_rect_8888(const dib_info *dst, const RECT *rc,
 {
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
-    int x, y;
+    int x, y, len = rc->right - rc->left;
 
     if (blend.AlphaFormat & AC_SRC_ALPHA)
     {
-	if (blend.SourceConstantAlpha == 255)
-	    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-		for (x = 0; x < rc->right - rc->left; x++)
-		    dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
-        else
-	    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-		for (x = 0; x < rc->right - rc->left; x++)
-		    dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+        {
+            for (x = 0; x < len; x++)
+            {
+                /* the vectorized version stops at pixels it can't handle */
+                if (dib_simd)
+                {
+                    x += dib_simd->blend_argb_line( dst_ptr + x, src_ptr + x, len - x, blend.SourceConstantAlpha );
+                    if (x == len) break;
+                }
+                if (blend.SourceConstantAlpha == 255)
+                    dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+                else
+                    dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+            }
+        }
     }
     else if (src->compression == BI_RGB)
-	for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-	    for (x = 0; x < rc->right - rc->left; x++)
-		dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+        {
+            x = dib_simd ? dib_simd->blend_constant_alpha_line( dst_ptr, src_ptr, len, blend.SourceConstantAlpha, TRUE ) : 0;
+            for (; x < len; x++)
+                dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        }
     else
-	for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-	    for (x = 0; x < rc->right - rc->left; x++)
-		dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+        {
+            x = dib_simd ? dib_simd->blend_constant_alpha_line( dst_ptr, src_ptr, len, blend.SourceConstantAlpha, FALSE ) : 0;
+            for (; x < len; x++)
+                dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        }
 }
 
 static void blend_rect_32(const dib_info *dst, const RECT *rc,
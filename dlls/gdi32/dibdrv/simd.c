@@ -0,0 +1,449 @@
+/*
+ * DIB driver SIMD primitives.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The functions in this file process the bulk of a row and return the
+ * number of pixels they handled, starting from the beginning of the row, or
+ * from its end for the reverse ones; the callers in primitives.c process the
+ * remaining pixels with the generic code. They have to produce exactly the
+ * same results as the generic code; when that's not possible for a group of
+ * pixels they stop before it.
+ *
+ * The instruction set is selected at run time, the functions are compiled
+ * with the target attribute so that the rest of the dll doesn't depend on it.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__i386__) || defined(__x86_64__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_DIB_SIMD
+#include <immintrin.h>
+#endif
+
+#include "gdi_private.h"
+#include "dibdrv.h"
+
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dib);
+
+const struct dib_simd_funcs *dib_simd = NULL;
+
+#ifdef USE_DIB_SIMD
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+static SSE2 int solid_line_32_sse2( DWORD *ptr, DWORD and, DWORD xor, int len )
+{
+    __m128i and_vec = _mm_set1_epi32( and ), xor_vec = _mm_set1_epi32( xor );
+    int i;
+
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        __m128i *p = (__m128i *)(ptr + i);
+        _mm_storeu_si128( p, _mm_xor_si128( _mm_and_si128( _mm_loadu_si128( p ), and_vec ), xor_vec ));
+    }
+    return i;
+}
+
+static SSE2 int solid_line_16_sse2( WORD *ptr, WORD and, WORD xor, int len )
+{
+    __m128i and_vec = _mm_set1_epi16( and ), xor_vec = _mm_set1_epi16( xor );
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m128i *p = (__m128i *)(ptr + i);
+        _mm_storeu_si128( p, _mm_xor_si128( _mm_and_si128( _mm_loadu_si128( p ), and_vec ), xor_vec ));
+    }
+    return i;
+}
+
+static SSE2 inline __m128i rop_codes_sse2( __m128i dst, __m128i src, const __m128i codes[4] )
+{
+    __m128i and = _mm_xor_si128( _mm_and_si128( src, codes[0] ), codes[1] );
+    __m128i xor = _mm_xor_si128( _mm_and_si128( src, codes[2] ), codes[3] );
+    return _mm_xor_si128( _mm_and_si128( dst, and ), xor );
+}
+
+/* The source block is loaded before the destination block is stored, so the
+ * forward variants handle destinations left of an overlapping source, and
+ * the reverse ones destinations right of it, like the generic code. */
+
+static SSE2 int rop_codes_line_32_sse2( DWORD *dst, const DWORD *src, const struct rop_codes *codes, int len )
+{
+    __m128i vec[4];
+    int i;
+
+    vec[0] = _mm_set1_epi32( codes->a1 );
+    vec[1] = _mm_set1_epi32( codes->a2 );
+    vec[2] = _mm_set1_epi32( codes->x1 );
+    vec[3] = _mm_set1_epi32( codes->x2 );
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + i) );
+        _mm_storeu_si128( (__m128i *)(dst + i), rop_codes_sse2( d, s, vec ));
+    }
+    return i;
+}
+
+static SSE2 int rop_codes_line_rev_32_sse2( DWORD *dst, const DWORD *src, const struct rop_codes *codes, int len )
+{
+    __m128i vec[4];
+    int i;
+
+    vec[0] = _mm_set1_epi32( codes->a1 );
+    vec[1] = _mm_set1_epi32( codes->a2 );
+    vec[2] = _mm_set1_epi32( codes->x1 );
+    vec[3] = _mm_set1_epi32( codes->x2 );
+    for (i = len - 4; i >= 0; i -= 4)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + i) );
+        _mm_storeu_si128( (__m128i *)(dst + i), rop_codes_sse2( d, s, vec ));
+    }
+    return len - (i + 4);
+}
+
+static SSE2 int rop_codes_line_16_sse2( WORD *dst, const WORD *src, const struct rop_codes *codes, int len )
+{
+    __m128i vec[4];
+    int i;
+
+    vec[0] = _mm_set1_epi16( codes->a1 );
+    vec[1] = _mm_set1_epi16( codes->a2 );
+    vec[2] = _mm_set1_epi16( codes->x1 );
+    vec[3] = _mm_set1_epi16( codes->x2 );
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + i) );
+        _mm_storeu_si128( (__m128i *)(dst + i), rop_codes_sse2( d, s, vec ));
+    }
+    return i;
+}
+
+static SSE2 int rop_codes_line_rev_16_sse2( WORD *dst, const WORD *src, const struct rop_codes *codes, int len )
+{
+    __m128i vec[4];
+    int i;
+
+    vec[0] = _mm_set1_epi16( codes->a1 );
+    vec[1] = _mm_set1_epi16( codes->a2 );
+    vec[2] = _mm_set1_epi16( codes->x1 );
+    vec[3] = _mm_set1_epi16( codes->x2 );
+    for (i = len - 8; i >= 0; i -= 8)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + i) );
+        _mm_storeu_si128( (__m128i *)(dst + i), rop_codes_sse2( d, s, vec ));
+    }
+    return len - (i + 8);
+}
+
+/* (x + 127) / 255 for x <= 255 * 255, on 16-bit lanes */
+static SSE2 inline __m128i div255_round_sse2( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 127 ));
+    x = _mm_add_epi16( _mm_add_epi16( x, _mm_set1_epi16( 1 )), _mm_srli_epi16( x, 8 ));
+    return _mm_srli_epi16( x, 8 );
+}
+
+/* broadcast the alpha channel of each pixel to its four 16-bit lanes */
+static SSE2 inline __m128i expand_alpha_sse2( __m128i x )
+{
+    x = _mm_shufflelo_epi16( x, _MM_SHUFFLE( 3, 3, 3, 3 ));
+    return _mm_shufflehi_epi16( x, _MM_SHUFFLE( 3, 3, 3, 3 ));
+}
+
+static SSE2 int blend_constant_alpha_line_sse2( DWORD *dst, const DWORD *src, int len, DWORD alpha,
+                                                BOOL src_alpha )
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i src_mul = _mm_set1_epi16( alpha ), dst_mul = _mm_set1_epi16( 255 - alpha );
+    __m128i alpha_mask = _mm_set1_epi32( src_alpha ? 0 : 0xff000000 );
+    int i;
+
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        __m128i s = _mm_or_si128( _mm_loadu_si128( (const __m128i *)(src + i) ), alpha_mask );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + i) );
+        __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( s, zero ), src_mul ),
+                                    _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), dst_mul ));
+        __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( s, zero ), src_mul ),
+                                    _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), dst_mul ));
+        _mm_storeu_si128( (__m128i *)(dst + i),
+                          _mm_packus_epi16( div255_round_sse2( lo ), div255_round_sse2( hi )));
+    }
+    return i;
+}
+
+static SSE2 int blend_argb_line_sse2( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    __m128i zero = _mm_setzero_si128(), max = _mm_set1_epi16( 255 );
+    __m128i src_mul = _mm_set1_epi16( alpha );
+    int i;
+
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(dst + i) );
+        __m128i s_lo = _mm_unpacklo_epi8( s, zero ), s_hi = _mm_unpackhi_epi8( s, zero );
+        __m128i lo, hi;
+
+        if (alpha != 255)
+        {
+            s_lo = div255_round_sse2( _mm_mullo_epi16( s_lo, src_mul ));
+            s_hi = div255_round_sse2( _mm_mullo_epi16( s_hi, src_mul ));
+        }
+        lo = _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), _mm_sub_epi16( max, expand_alpha_sse2( s_lo )));
+        hi = _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), _mm_sub_epi16( max, expand_alpha_sse2( s_hi )));
+        lo = _mm_add_epi16( s_lo, div255_round_sse2( lo ));
+        hi = _mm_add_epi16( s_hi, div255_round_sse2( hi ));
+
+        /* channels of sources that are not premultiplied may overflow into
+         * the next one, leave these to the generic code */
+        if (_mm_movemask_epi8( _mm_or_si128( _mm_cmpgt_epi16( lo, max ), _mm_cmpgt_epi16( hi, max ))))
+            break;
+
+        _mm_storeu_si128( (__m128i *)(dst + i), _mm_packus_epi16( lo, hi ));
+    }
+    return i;
+}
+
+static SSE2 int convert_24_to_8888_line_sse2( DWORD *dst, const BYTE *src, int len )
+{
+    __m128i mask0 = _mm_set_epi32( 0, 0, 0, 0xffffff ), mask1 = _mm_set_epi32( 0, 0, 0xffffff, 0 );
+    __m128i mask2 = _mm_set_epi32( 0, 0xffffff, 0, 0 ), mask3 = _mm_set_epi32( 0xffffff, 0, 0, 0 );
+    int i;
+
+    /* each load reads 16 bytes for 12 bytes of pixels, stay inside the row */
+    for (i = 0; i + 6 <= len; i += 4)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i * 3) );
+        __m128i d = _mm_or_si128( _mm_or_si128( _mm_and_si128( s, mask0 ),
+                                                _mm_and_si128( _mm_slli_si128( s, 1 ), mask1 )),
+                                  _mm_or_si128( _mm_and_si128( _mm_slli_si128( s, 2 ), mask2 ),
+                                                _mm_and_si128( _mm_slli_si128( s, 3 ), mask3 )));
+        _mm_storeu_si128( (__m128i *)(dst + i), d );
+    }
+    return i;
+}
+
+static SSE2 inline __m128i expand_555_sse2( __m128i x )
+{
+    return _mm_or_si128(
+        _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_slli_epi32( x, 9 ), _mm_set1_epi32( 0xf80000 )),
+                                    _mm_and_si128( _mm_slli_epi32( x, 4 ), _mm_set1_epi32( 0x070000 ))),
+                      _mm_or_si128( _mm_and_si128( _mm_slli_epi32( x, 6 ), _mm_set1_epi32( 0x00f800 )),
+                                    _mm_and_si128( _mm_slli_epi32( x, 1 ), _mm_set1_epi32( 0x000700 )))),
+        _mm_or_si128( _mm_and_si128( _mm_slli_epi32( x, 3 ), _mm_set1_epi32( 0x0000f8 )),
+                      _mm_and_si128( _mm_srli_epi32( x, 2 ), _mm_set1_epi32( 0x000007 ))));
+}
+
+static SSE2 int convert_555_to_8888_line_sse2( DWORD *dst, const WORD *src, int len )
+{
+    __m128i zero = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(src + i) );
+        _mm_storeu_si128( (__m128i *)(dst + i), expand_555_sse2( _mm_unpacklo_epi16( s, zero )));
+        _mm_storeu_si128( (__m128i *)(dst + i + 4), expand_555_sse2( _mm_unpackhi_epi16( s, zero )));
+    }
+    return i;
+}
+
+static SSE2 inline __m128i reduce_555_sse2( __m128i x )
+{
+    return _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi32( x, 9 ), _mm_set1_epi32( 0x7c00 )),
+                                       _mm_and_si128( _mm_srli_epi32( x, 6 ), _mm_set1_epi32( 0x03e0 ))),
+                         _mm_and_si128( _mm_srli_epi32( x, 3 ), _mm_set1_epi32( 0x001f )));
+}
+
+static SSE2 int convert_8888_to_555_line_sse2( WORD *dst, const DWORD *src, int len )
+{
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m128i lo = reduce_555_sse2( _mm_loadu_si128( (const __m128i *)(src + i) ));
+        __m128i hi = reduce_555_sse2( _mm_loadu_si128( (const __m128i *)(src + i + 4) ));
+        /* the values fit in 15 bits, so the signed saturation doesn't change them */
+        _mm_storeu_si128( (__m128i *)(dst + i), _mm_packs_epi32( lo, hi ));
+    }
+    return i;
+}
+
+static const struct dib_simd_funcs simd_sse2 =
+{
+    "sse2",
+    solid_line_32_sse2,
+    solid_line_16_sse2,
+    rop_codes_line_32_sse2,
+    rop_codes_line_rev_32_sse2,
+    rop_codes_line_16_sse2,
+    rop_codes_line_rev_16_sse2,
+    blend_constant_alpha_line_sse2,
+    blend_argb_line_sse2,
+    convert_24_to_8888_line_sse2,
+    convert_555_to_8888_line_sse2,
+    convert_8888_to_555_line_sse2,
+};
+
+/* AVX2 versions of the bitwise operations; the arithmetic ones gain little
+ * from the wider registers once the unpacking is accounted for. */
+
+static AVX2 int solid_line_32_avx2( DWORD *ptr, DWORD and, DWORD xor, int len )
+{
+    __m256i and_vec = _mm256_set1_epi32( and ), xor_vec = _mm256_set1_epi32( xor );
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m256i *p = (__m256i *)(ptr + i);
+        _mm256_storeu_si256( p, _mm256_xor_si256( _mm256_and_si256( _mm256_loadu_si256( p ), and_vec ), xor_vec ));
+    }
+    return i + solid_line_32_sse2( ptr + i, and, xor, len - i );
+}
+
+static AVX2 int solid_line_16_avx2( WORD *ptr, WORD and, WORD xor, int len )
+{
+    __m256i and_vec = _mm256_set1_epi16( and ), xor_vec = _mm256_set1_epi16( xor );
+    int i;
+
+    for (i = 0; i + 16 <= len; i += 16)
+    {
+        __m256i *p = (__m256i *)(ptr + i);
+        _mm256_storeu_si256( p, _mm256_xor_si256( _mm256_and_si256( _mm256_loadu_si256( p ), and_vec ), xor_vec ));
+    }
+    return i + solid_line_16_sse2( ptr + i, and, xor, len - i );
+}
+
+static AVX2 inline __m256i rop_codes_avx2( __m256i dst, __m256i src, const __m256i codes[4] )
+{
+    __m256i and = _mm256_xor_si256( _mm256_and_si256( src, codes[0] ), codes[1] );
+    __m256i xor = _mm256_xor_si256( _mm256_and_si256( src, codes[2] ), codes[3] );
+    return _mm256_xor_si256( _mm256_and_si256( dst, and ), xor );
+}
+
+static AVX2 int rop_codes_line_32_avx2( DWORD *dst, const DWORD *src, const struct rop_codes *codes, int len )
+{
+    __m256i vec[4];
+    int i;
+
+    vec[0] = _mm256_set1_epi32( codes->a1 );
+    vec[1] = _mm256_set1_epi32( codes->a2 );
+    vec[2] = _mm256_set1_epi32( codes->x1 );
+    vec[3] = _mm256_set1_epi32( codes->x2 );
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        __m256i d = _mm256_loadu_si256( (const __m256i *)(dst + i) );
+        _mm256_storeu_si256( (__m256i *)(dst + i), rop_codes_avx2( d, s, vec ));
+    }
+    return i + rop_codes_line_32_sse2( dst + i, src + i, codes, len - i );
+}
+
+static AVX2 int rop_codes_line_rev_32_avx2( DWORD *dst, const DWORD *src, const struct rop_codes *codes, int len )
+{
+    __m256i vec[4];
+    int i;
+
+    vec[0] = _mm256_set1_epi32( codes->a1 );
+    vec[1] = _mm256_set1_epi32( codes->a2 );
+    vec[2] = _mm256_set1_epi32( codes->x1 );
+    vec[3] = _mm256_set1_epi32( codes->x2 );
+    for (i = len - 8; i >= 0; i -= 8)
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        __m256i d = _mm256_loadu_si256( (const __m256i *)(dst + i) );
+        _mm256_storeu_si256( (__m256i *)(dst + i), rop_codes_avx2( d, s, vec ));
+    }
+    return len - (i + 8) + rop_codes_line_rev_32_sse2( dst, src, codes, i + 8 );
+}
+
+static AVX2 int rop_codes_line_16_avx2( WORD *dst, const WORD *src, const struct rop_codes *codes, int len )
+{
+    __m256i vec[4];
+    int i;
+
+    vec[0] = _mm256_set1_epi16( codes->a1 );
+    vec[1] = _mm256_set1_epi16( codes->a2 );
+    vec[2] = _mm256_set1_epi16( codes->x1 );
+    vec[3] = _mm256_set1_epi16( codes->x2 );
+    for (i = 0; i + 16 <= len; i += 16)
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        __m256i d = _mm256_loadu_si256( (const __m256i *)(dst + i) );
+        _mm256_storeu_si256( (__m256i *)(dst + i), rop_codes_avx2( d, s, vec ));
+    }
+    return i + rop_codes_line_16_sse2( dst + i, src + i, codes, len - i );
+}
+
+static AVX2 int rop_codes_line_rev_16_avx2( WORD *dst, const WORD *src, const struct rop_codes *codes, int len )
+{
+    __m256i vec[4];
+    int i;
+
+    vec[0] = _mm256_set1_epi16( codes->a1 );
+    vec[1] = _mm256_set1_epi16( codes->a2 );
+    vec[2] = _mm256_set1_epi16( codes->x1 );
+    vec[3] = _mm256_set1_epi16( codes->x2 );
+    for (i = len - 16; i >= 0; i -= 16)
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(src + i) );
+        __m256i d = _mm256_loadu_si256( (const __m256i *)(dst + i) );
+        _mm256_storeu_si256( (__m256i *)(dst + i), rop_codes_avx2( d, s, vec ));
+    }
+    return len - (i + 16) + rop_codes_line_rev_16_sse2( dst, src, codes, i + 16 );
+}
+
+static const struct dib_simd_funcs simd_avx2 =
+{
+    "avx2",
+    solid_line_32_avx2,
+    solid_line_16_avx2,
+    rop_codes_line_32_avx2,
+    rop_codes_line_rev_32_avx2,
+    rop_codes_line_16_avx2,
+    rop_codes_line_rev_16_avx2,
+    blend_constant_alpha_line_sse2,
+    blend_argb_line_sse2,
+    convert_24_to_8888_line_sse2,
+    convert_555_to_8888_line_sse2,
+    convert_8888_to_555_line_sse2,
+};
+
+void init_dib_simd(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports( "avx2" )) dib_simd = &simd_avx2;
+    else if (__builtin_cpu_supports( "sse2" )) dib_simd = &simd_sse2;
+    TRACE( "using %s primitives\n", dib_simd ? dib_simd->name : "generic" );
+}
+
+#else  /* USE_DIB_SIMD */
+
+void init_dib_simd(void)
+{
+}
+
+#endif  /* USE_DIB_SIMD */
@@ -3820,6 +3820,253 @@ static void test_GdiAlphaBlend(void)
     HeapFree(GetProcessHeap(), 0, bmi);
 }
 
+static DWORD row_rand( unsigned int *seed )
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) ^ (*seed << 13);
+}
+
+/* operations on a whole row must give the same results as the same
+ * operations on each pixel, whatever the width of the row */
+static void test_row_widths(void)
+{
+    static const DWORD rops[] = { SRCINVERT, SRCAND, MERGEPAINT, 0x990066 /* DSxn */ };
+    BITMAPINFO info;
+    HDC hdc_src, hdc_dst;
+    HBITMAP bmp_src, bmp_dst, bmp_24, old_src, old_dst;
+    DWORD *src_bits, *dst_bits, saved[64], expect[64], converted[64];
+    BYTE *bits_24;
+    BLENDFUNCTION blend;
+    unsigned int seed = 1, width, x, i;
+
+    memset( &info, 0, sizeof(info) );
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth = 64;
+    info.bmiHeader.biHeight = -1;
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    hdc_src = CreateCompatibleDC( 0 );
+    hdc_dst = CreateCompatibleDC( 0 );
+    bmp_src = CreateDIBSection( 0, &info, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    bmp_dst = CreateDIBSection( 0, &info, DIB_RGB_COLORS, (void **)&dst_bits, NULL, 0 );
+    ok( bmp_src && bmp_dst, "failed to create bitmaps\n" );
+    old_src = SelectObject( hdc_src, bmp_src );
+    old_dst = SelectObject( hdc_dst, bmp_dst );
+
+    for (width = 1; width < 64; width++)
+    {
+        for (x = 0; x < 64; x++)
+        {
+            src_bits[x] = row_rand( &seed );
+            saved[x] = row_rand( &seed );
+        }
+
+        if (pGdiAlphaBlend)
+        {
+            blend.BlendOp = AC_SRC_OVER;
+            blend.BlendFlags = 0;
+            for (i = 0; i < 4; i++)
+            {
+                blend.SourceConstantAlpha = (i & 1) ? 128 : 255;
+                blend.AlphaFormat = (i & 2) ? AC_SRC_ALPHA : 0;
+                memcpy( dst_bits, saved, sizeof(saved) );
+                for (x = 0; x < width; x++)
+                    pGdiAlphaBlend( hdc_dst, x, 0, 1, 1, hdc_src, x, 0, 1, 1, blend );
+                memcpy( expect, dst_bits, sizeof(expect) );
+                memcpy( dst_bits, saved, sizeof(saved) );
+                pGdiAlphaBlend( hdc_dst, 0, 0, width, 1, hdc_src, 0, 0, width, 1, blend );
+                ok( !memcmp( dst_bits, expect, sizeof(expect) ), "width %u, alpha %u, format %u: wrong blend\n",
+                    width, blend.SourceConstantAlpha, blend.AlphaFormat );
+            }
+        }
+
+        for (i = 0; i < sizeof(rops) / sizeof(rops[0]); i++)
+        {
+            memcpy( dst_bits, saved, sizeof(saved) );
+            for (x = 0; x < width; x++)
+                BitBlt( hdc_dst, x, 0, 1, 1, hdc_src, x, 0, rops[i] );
+            memcpy( expect, dst_bits, sizeof(expect) );
+            memcpy( dst_bits, saved, sizeof(saved) );
+            BitBlt( hdc_dst, 0, 0, width, 1, hdc_src, 0, 0, rops[i] );
+            ok( !memcmp( dst_bits, expect, sizeof(expect) ), "width %u, rop %06x: wrong result\n",
+                width, rops[i] );
+        }
+
+        /* overlapping source and destination */
+        memcpy( dst_bits, saved, sizeof(saved) );
+        BitBlt( hdc_dst, 1, 0, width, 1, hdc_dst, 0, 0, SRCINVERT );
+        memcpy( expect, saved, sizeof(expect) );
+        for (x = 0; x < width; x++) expect[x + 1] = saved[x + 1] ^ saved[x];
+        ok( !memcmp( dst_bits, expect, sizeof(expect) ), "width %u: wrong result moving right\n", width );
+
+        memcpy( dst_bits, saved, sizeof(saved) );
+        BitBlt( hdc_dst, 0, 0, width, 1, hdc_dst, 1, 0, SRCINVERT );
+        memcpy( expect, saved, sizeof(expect) );
+        for (x = 0; x < width; x++) expect[x] = saved[x] ^ saved[x + 1];
+        ok( !memcmp( dst_bits, expect, sizeof(expect) ), "width %u: wrong result moving left\n", width );
+
+        memcpy( dst_bits, saved, sizeof(saved) );
+        PatBlt( hdc_dst, 0, 0, width, 1, DSTINVERT );
+        memcpy( expect, saved, sizeof(expect) );
+        for (x = 0; x < width; x++) expect[x] = ~saved[x];
+        ok( !memcmp( dst_bits, expect, sizeof(expect) ), "width %u: wrong inversion\n", width );
+
+        /* 24-bpp to 32-bpp conversion */
+        info.bmiHeader.biWidth = width;
+        info.bmiHeader.biBitCount = 24;
+        bmp_24 = CreateDIBSection( 0, &info, DIB_RGB_COLORS, (void **)&bits_24, NULL, 0 );
+        ok( bmp_24 != NULL, "failed to create bitmap\n" );
+        for (x = 0; x < width * 3; x++) bits_24[x] = row_rand( &seed );
+        info.bmiHeader.biBitCount = 32;
+        memset( converted, 0xcc, sizeof(converted) );
+        GetDIBits( hdc_src, bmp_24, 0, 1, converted, &info, DIB_RGB_COLORS );
+        for (x = 0; x < width; x++)
+            ok( converted[x] == (bits_24[x * 3] | bits_24[x * 3 + 1] << 8 | bits_24[x * 3 + 2] << 16),
+                "width %u: got %08x for pixel %u\n", width, converted[x], x );
+        DeleteObject( bmp_24 );
+        info.bmiHeader.biWidth = 64;
+    }
+
+    SelectObject( hdc_src, old_src );
+    SelectObject( hdc_dst, old_dst );
+    DeleteObject( bmp_src );
+    DeleteObject( bmp_dst );
+    DeleteDC( hdc_src );
+    DeleteDC( hdc_dst );
+}
+
+static void do_large_operation( HDC hdc_dst, HDC hdc_src, unsigned int op, TRIVERTEX *vert )
+{
+    GRADIENT_RECT rect = { 0, 1 };
+    GRADIENT_TRIANGLE tri = { 0, 1, 2 };
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 192, AC_SRC_ALPHA };
+    BITMAP bm;
+
+    GetObjectW( GetCurrentObject( hdc_dst, OBJ_BITMAP ), sizeof(bm), &bm );
+    switch (op)
+    {
+    case 0:
+    case 1:
+        SetStretchBltMode( hdc_dst, op ? COLORONCOLOR : BLACKONWHITE );
+        StretchBlt( hdc_dst, 0, 0, bm.bmWidth, bm.bmHeight, hdc_src, 0, 0, 2400, 1400, SRCCOPY );
+        break;
+    case 2:
+        pGdiAlphaBlend( hdc_dst, 0, 0, bm.bmWidth, bm.bmHeight, hdc_src, 0, 0, 2400, 1400, blend );
+        break;
+    case 3:
+        pGdiGradientFill( hdc_dst, vert, 2, &rect, 1, GRADIENT_FILL_RECT_V );
+        break;
+    case 4:
+        pGdiGradientFill( hdc_dst, vert, 3, &tri, 1, GRADIENT_FILL_TRIANGLE );
+        break;
+    }
+}
+
+/* large operations must give the same results as the same operations
+ * clipped to small strips of the destination */
+static void test_large_operations(void)
+{
+    static const SIZE sizes[] = { { 1920, 1080 }, { 3840, 2160 } };
+    static const char *names[] = { "StretchBlt", "StretchBlt COLORONCOLOR", "GdiAlphaBlend",
+                                   "GdiGradientFill rect", "GdiGradientFill triangle" };
+    BITMAPINFO info;
+    HDC hdc_src, hdc_dst;
+    HBITMAP bmp_src, bmp_dst, old_src, old_dst;
+    DWORD *src_bits, *dst_bits, *saved, *expect;
+    TRIVERTEX vert[3];
+    unsigned int seed = 1, i, op, x, size, width, height;
+    HRGN rgn;
+
+    memset( &info, 0, sizeof(info) );
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth = 2400;
+    info.bmiHeader.biHeight = -1400;
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    hdc_src = CreateCompatibleDC( 0 );
+    hdc_dst = CreateCompatibleDC( 0 );
+    bmp_src = CreateDIBSection( 0, &info, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    ok( bmp_src != NULL, "failed to create bitmap\n" );
+    for (x = 0; x < 2400 * 1400; x++) src_bits[x] = row_rand( &seed );
+    old_src = SelectObject( hdc_src, bmp_src );
+
+    for (size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++)
+    {
+        width = sizes[size].cx;
+        height = sizes[size].cy;
+        info.bmiHeader.biWidth = width;
+        info.bmiHeader.biHeight = -height;
+        bmp_dst = CreateDIBSection( 0, &info, DIB_RGB_COLORS, (void **)&dst_bits, NULL, 0 );
+        saved = HeapAlloc( GetProcessHeap(), 0, width * height * 4 );
+        expect = HeapAlloc( GetProcessHeap(), 0, width * height * 4 );
+        ok( bmp_dst && saved && expect, "%ux%u: allocation failed\n", width, height );
+        if (!bmp_dst || !saved || !expect)
+        {
+            DeleteObject( bmp_dst );
+            HeapFree( GetProcessHeap(), 0, saved );
+            HeapFree( GetProcessHeap(), 0, expect );
+            continue;
+        }
+        for (x = 0; x < width * height; x++) saved[x] = row_rand( &seed );
+        old_dst = SelectObject( hdc_dst, bmp_dst );
+
+        vert[0].x = width / 8;
+        vert[0].y = height / 16;
+        vert[0].Red = 0x1000;
+        vert[0].Green = 0xff00;
+        vert[0].Blue = 0x8000;
+        vert[0].Alpha = 0;
+        vert[1].x = width - width / 16;
+        vert[1].y = height - height / 8;
+        vert[1].Red = 0xf000;
+        vert[1].Green = 0x0800;
+        vert[1].Blue = 0x4000;
+        vert[1].Alpha = 0xff00;
+        vert[2].x = width / 4;
+        vert[2].y = height;
+        vert[2].Red = 0x7700;
+        vert[2].Green = 0x3300;
+        vert[2].Blue = 0xee00;
+        vert[2].Alpha = 0x8000;
+
+        for (op = 0; op < sizeof(names) / sizeof(names[0]); op++)
+        {
+            if (op == 2 && !pGdiAlphaBlend) continue;
+            if (op >= 3 && !pGdiGradientFill) continue;
+
+            memcpy( dst_bits, saved, width * height * 4 );
+            do_large_operation( hdc_dst, hdc_src, op, vert );
+            memcpy( expect, dst_bits, width * height * 4 );
+
+            memcpy( dst_bits, saved, width * height * 4 );
+            for (i = 0; i < height; i += 50)
+            {
+                rgn = CreateRectRgn( 0, i, width, min( i + 50, height ));
+                SelectClipRgn( hdc_dst, rgn );
+                DeleteObject( rgn );
+                do_large_operation( hdc_dst, hdc_src, op, vert );
+            }
+            SelectClipRgn( hdc_dst, NULL );
+            ok( !memcmp( dst_bits, expect, width * height * 4 ), "%ux%u: %s gives different results\n",
+                width, height, names[op] );
+        }
+
+        SelectObject( hdc_dst, old_dst );
+        DeleteObject( bmp_dst );
+        HeapFree( GetProcessHeap(), 0, saved );
+        HeapFree( GetProcessHeap(), 0, expect );
+    }
+
+    SelectObject( hdc_src, old_src );
+    DeleteObject( bmp_src );
+    DeleteDC( hdc_src );
+    DeleteDC( hdc_dst );
+}
+
 static void test_GdiGradientFill(void)
 {
     HDC hdc;
@@ -5924,6 +6171,8 @@ START_TEST(bitmap)
     test_StretchBlt();
     test_StretchDIBits();
     test_GdiAlphaBlend();
+    test_row_widths();
+    test_large_operations();
     test_GdiGradientFill();
     test_32bit_ddb();
     test_bitmapinfoheadersize();
@@ -39,6 +39,7 @@
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static BOOL (WINAPI *pGetPhysicallyInstalledSystemMemory)(ULONGLONG *);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
@@ -854,6 +855,79 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static void test_low_fragmentation_heap(void)
+{
+    BYTE *p[64], *p2;
+    HANDLE heap;
+    ULONG info;
+    SIZE_T size;
+    BOOL ret;
+    int i;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapQueryInformation || !pHeapSetInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate(0, 0, 0);
+    ok(heap != NULL, "HeapCreate failed\n");
+
+    info = 2;
+    ret = pHeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    ok(ret, "HeapSetInformation error %u\n", GetLastError());
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation(heap, HeapCompatibilityInformation, &info, sizeof(info), NULL);
+    ok(ret, "HeapQueryInformation error %u\n", GetLastError());
+    ok(info == 2, "expected 2, got %u\n", info);
+
+    for (i = 0; i < sizeof(p) / sizeof(p[0]); i++)
+    {
+        p[i] = HeapAlloc(heap, HEAP_ZERO_MEMORY, i * 5);
+        ok(p[i] != NULL, "HeapAlloc failed for size %u\n", i * 5);
+        size = HeapSize(heap, 0, p[i]);
+        ok(size == i * 5, "wrong size %lu for %u\n", size, i * 5);
+        ok(!i || !p[i][i * 5 - 1], "wrong data %x\n", p[i][i * 5 - 1]);
+        ok(HeapValidate(heap, 0, p[i]), "HeapValidate failed for %p\n", p[i]);
+        memset(p[i], i, i * 5);
+    }
+
+    p2 = HeapReAlloc(heap, HEAP_ZERO_MEMORY, p[10], 4000);
+    ok(p2 != NULL, "HeapReAlloc failed\n");
+    ok(p2[49] == 10, "wrong data %x\n", p2[49]);
+    ok(!p2[50] && !p2[3999], "extra bytes not cleared\n");
+    size = HeapSize(heap, 0, p2);
+    ok(size == 4000, "wrong size %lu\n", size);
+    ok(HeapFree(heap, 0, p2), "HeapFree failed\n");
+
+    p2 = HeapReAlloc(heap, 0, p[20], 3);
+    ok(p2 != NULL, "HeapReAlloc failed\n");
+    ok(p2[2] == 20, "wrong data %x\n", p2[2]);
+    size = HeapSize(heap, 0, p2);
+    ok(size == 3, "wrong size %lu\n", size);
+    p[10] = NULL;
+    p[20] = p2;
+
+    /* shrinking a large block by more than 255 bytes */
+    p2 = HeapAlloc(heap, 0, 1000);
+    ok(p2 != NULL, "HeapAlloc failed\n");
+    memset(p2, 0x55, 1000);
+    p2 = HeapReAlloc(heap, 0, p2, 5);
+    ok(p2 != NULL, "HeapReAlloc failed\n");
+    ok(p2[0] == 0x55 && p2[4] == 0x55, "wrong data %x/%x\n", p2[0], p2[4]);
+    size = HeapSize(heap, 0, p2);
+    ok(size == 5, "wrong size %lu\n", size);
+    ok(HeapValidate(heap, 0, p2), "HeapValidate failed for %p\n", p2);
+    ok(HeapFree(heap, 0, p2), "HeapFree failed\n");
+
+    for (i = 0; i < sizeof(p) / sizeof(p[0]); i++)
+        ok(HeapFree(heap, 0, p[i]), "HeapFree failed for %p\n", p[i]);
+
+    ok(HeapValidate(heap, 0, NULL), "HeapValidate failed\n");
+    ok(HeapDestroy(heap), "HeapDestroy failed\n");
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1207,6 +1281,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_low_fragmentation_heap();
     test_GetPhysicallyInstalledSystemMemory();
 
     if (pRtlGetNtGlobalFlags)
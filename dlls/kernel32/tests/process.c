@@ -2023,10 +2023,11 @@ static void test_QueryFullProcessImageNameW(void)
 
 static void test_Handles(void)
 {
+    static HANDLE handles[10000];
     HANDLE handle = GetCurrentProcess();
     HANDLE h2, h3;
     BOOL ret;
-    DWORD code;
+    DWORD code, i;
 
     ok( handle == (HANDLE)~(ULONG_PTR)0 ||
         handle == (HANDLE)(ULONG_PTR)0x7fffffff /* win9x */,
@@ -2065,6 +2066,27 @@ static void test_Handles(void)
         broken( h2 == INVALID_HANDLE_VALUE),  /* win9x */
         "wrong handle %p/%p\n", h2, h3 );
     SetStdHandle( STD_ERROR_HANDLE, handle );
+
+    /* many handles to the same object */
+    h2 = CreateEventA( NULL, FALSE, FALSE, NULL );
+    ok( h2 != 0, "CreateEvent failed err %u\n", GetLastError() );
+    for (i = 0; i < sizeof(handles) / sizeof(handles[0]); i++)
+    {
+        ret = DuplicateHandle( GetCurrentProcess(), h2, GetCurrentProcess(), &handles[i],
+                               0, FALSE, DUPLICATE_SAME_ACCESS );
+        ok( ret, "DuplicateHandle %u failed err %u\n", i, GetLastError() );
+    }
+    for (i = 0; i < sizeof(handles) / sizeof(handles[0]); i += 2)
+        ok( CloseHandle( handles[i] ), "CloseHandle %u failed err %u\n", i, GetLastError() );
+    ret = SetEvent( handles[1] );
+    ok( ret, "SetEvent failed err %u\n", GetLastError() );
+    ok( !WaitForSingleObject( h2, 0 ), "event not signaled\n" );
+    for (i = 1; i < sizeof(handles) / sizeof(handles[0]); i += 2)
+        ok( CloseHandle( handles[i] ), "CloseHandle %u failed err %u\n", i, GetLastError() );
+    SetLastError( 0xdeadbeef );
+    ok( !CloseHandle( handles[1] ), "CloseHandle succeeded\n" );
+    ok( GetLastError() == ERROR_INVALID_HANDLE, "wrong error %u\n", GetLastError() );
+    CloseHandle( h2 );
 }
 
 static void test_IsWow64Process(void)
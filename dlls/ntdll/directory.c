@@ -175,7 +175,7 @@ struct dir_data_buffer
 struct dir_data_names
 {
     const WCHAR *long_name;          /* long file name in Unicode */
-    const WCHAR *short_name;         /* short file name in Unicode */
+    const WCHAR *short_name;         /* short file name in Unicode, NULL if not computed yet */
     const char  *unix_name;          /* Unix file name in host encoding */
 };
 
@@ -187,11 +187,16 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    BOOL                    batched; /* directory is too large, names are read in batches */
+    BOOL                    more;    /* batched directory has more names to read */
+    off_t                   next;    /* directory offset of the next batch */
+    UNICODE_STRING          mask;    /* search mask of a batched directory */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
+static const unsigned int dir_data_batch_size          = 8192;
 
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
@@ -215,6 +220,46 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION dir_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* case-insensitive cache of the names of a directory, used by find_file_in_dir */
+struct name_cache_entry
+{
+    unsigned int            next;      /* next entry in the hash bucket, or ~0u */
+    unsigned int            hash;      /* hash of the upper-case name */
+    unsigned int            name;      /* offset of the upper-case name in the names buffer */
+    unsigned int            len;       /* length of the upper-case name */
+    unsigned int            unix_name; /* offset of the Unix name in the unix_names buffer */
+};
+
+struct name_cache
+{
+    struct list             entry;      /* entry in the list of cached directories */
+    struct file_identity    id;         /* directory file identity */
+    time_t                  mtime;      /* directory modification time when it was read */
+    unsigned long           mtime_nsec;
+    unsigned int            count;      /* number of entries */
+    unsigned int            hash_size;  /* size of the hash table, a power of 2 */
+    unsigned int           *hash;       /* first entry of each hash bucket, or ~0u */
+    struct name_cache_entry *entries;
+    WCHAR                  *names;      /* upper-case names */
+    char                   *unix_names; /* null-terminated Unix names */
+};
+
+#define MAX_NAME_CACHES       64        /* maximum number of cached directories */
+#define MAX_NAME_CACHE_COUNT  0x40000   /* maximum number of entries of a cached directory */
+
+static struct list name_caches = LIST_INIT( name_caches );  /* most recently used first */
+static unsigned int name_cache_count;
+static unsigned int name_cache_lookups, name_cache_hits;
+
+static RTL_CRITICAL_SECTION name_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG name_cache_critsect_debug =
+{
+    0, 0, &name_cache_section,
+    { &name_cache_critsect_debug.ProcessLocksList, &name_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": name_cache_section") }
+};
+static RTL_CRITICAL_SECTION name_cache_section = { &name_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
 
 /* check if a given Unicode char is OK in a DOS short name */
 static inline BOOL is_invalid_dos_char( WCHAR ch )
@@ -354,7 +399,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
         data->names = names;
     }
 
-    if (short_name[0])
+    if (!short_name) names[data->count].short_name = NULL;
+    else if (short_name[0])
     {
         if (!(names[data->count].short_name = add_dir_data_nameW( data, short_name ))) return FALSE;
     }
@@ -379,9 +425,27 @@ static void free_dir_data( struct dir_data *data )
         RtlFreeHeap( GetProcessHeap(), 0, buffer );
     }
     RtlFreeHeap( GetProcessHeap(), 0, data->names );
+    RtlFreeUnicodeString( &data->mask );
     RtlFreeHeap( GetProcessHeap(), 0, data );
 }
 
+/* discard the names that have been returned already, keeping the largest buffer for reuse */
+static void reset_dir_data( struct dir_data *data )
+{
+    struct dir_data_buffer *buffer, *next;
+
+    if ((buffer = data->buffer))
+    {
+        for (next = buffer->next; next; next = buffer->next)
+        {
+            buffer->next = next->next;
+            RtlFreeHeap( GetProcessHeap(), 0, next );
+        }
+        buffer->pos = 0;
+    }
+    data->count = data->pos = 0;
+}
+
 
 /* support for a directory queue for filesystem searches */
 
@@ -1489,6 +1553,7 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
     WCHAR long_nameW[MAX_DIR_ENTRY_LEN + 1];
     WCHAR short_nameW[13];
     UNICODE_STRING str;
+    BOOLEAN spaces;
 
     long_len = ntdll_umbstowcs( 0, long_name, strlen(long_name), long_nameW, MAX_DIR_ENTRY_LEN );
     if (long_len == -1) return TRUE;
@@ -1504,30 +1569,52 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
                                      short_nameW, sizeof(short_nameW) / sizeof(WCHAR) - 1 );
         if (short_len == -1) short_len = sizeof(short_nameW) / sizeof(WCHAR) - 1;
         for (i = 0; i < short_len; i++) short_nameW[i] = toupperW( short_nameW[i] );
+        short_nameW[short_len] = 0;
     }
-    else  /* generate a short name if necessary */
-    {
-        BOOLEAN spaces;
-
-        short_len = 0;
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-            short_len = hash_short_file_name( &str, short_nameW );
-    }
-    short_nameW[short_len] = 0;
 
     TRACE( "long %s short %s mask %s\n",
-           debugstr_w( long_nameW ), debugstr_w( short_nameW ), debugstr_us( mask ));
+           debugstr_w( long_nameW ), short_name ? debugstr_w( short_nameW ) : "(lazy)", debugstr_us( mask ));
 
     if (mask && !match_filename( &str, mask ))
     {
+        if (!short_name)  /* generate a short name to match it against the mask */
+        {
+            short_len = 0;
+            if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+                short_len = hash_short_file_name( &str, short_nameW );
+            short_nameW[short_len] = 0;
+        }
         if (!short_len) return TRUE;  /* no short name to match */
         str.Buffer = short_nameW;
         str.Length = short_len * sizeof(WCHAR);
         str.MaximumLength = sizeof(short_nameW);
         if (!match_filename( &str, mask )) return TRUE;
+        return add_dir_data_names( data, long_nameW, short_nameW, long_name );
     }
 
-    return add_dir_data_names( data, long_nameW, short_nameW, long_name );
+    /* the short name is generated only if the information class needs it */
+    return add_dir_data_names( data, long_nameW, short_name ? short_nameW : NULL, long_name );
+}
+
+
+/***********************************************************************
+ *           get_dir_data_short_name
+ *
+ * Return the short name of a directory entry, generating it if necessary.
+ */
+static const WCHAR *get_dir_data_short_name( const struct dir_data_names *names, WCHAR *buffer )
+{
+    UNICODE_STRING str;
+    BOOLEAN spaces;
+    ULONG len = 0;
+
+    if (names->short_name) return names->short_name;
+
+    RtlInitUnicodeString( &str, names->long_name );
+    if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+        len = hash_short_file_name( &str, buffer );
+    buffer[len] = 0;
+    return buffer;
 }
 
 
@@ -1542,6 +1629,8 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
 {
     const struct dir_data_names *names = &dir_data->names[dir_data->pos];
     union file_directory_info *info;
+    const WCHAR *short_name;
+    WCHAR short_nameW[13];
     struct stat st;
     ULONG name_len, start, dir_size, attributes;
 
@@ -1598,15 +1687,17 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
 
     case FileBothDirectoryInformation:
         info->both.EaSize = 0; /* FIXME */
-        info->both.ShortNameLength = strlenW( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->both.ShortName, names->short_name, info->both.ShortNameLength );
+        short_name = get_dir_data_short_name( names, short_nameW );
+        info->both.ShortNameLength = strlenW( short_name ) * sizeof(WCHAR);
+        memcpy( info->both.ShortName, short_name, info->both.ShortNameLength );
         info->both.FileNameLength = name_len;
         break;
 
     case FileIdBothDirectoryInformation:
         info->id_both.EaSize = 0; /* FIXME */
-        info->id_both.ShortNameLength = strlenW( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->id_both.ShortName, names->short_name, info->id_both.ShortNameLength );
+        short_name = get_dir_data_short_name( names, short_nameW );
+        info->id_both.ShortNameLength = strlenW( short_name ) * sizeof(WCHAR);
+        memcpy( info->id_both.ShortName, short_name, info->id_both.ShortNameLength );
         info->id_both.FileNameLength = name_len;
         break;
 
@@ -1818,6 +1909,104 @@ done:
 }
 
 
+#if defined(linux) && defined(__NR_getdents64)
+
+/* the kernel dirent structure returned by getdents64 */
+struct kernel_dirent64
+{
+    ULONG64        d_ino;
+    LONG64         d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[1];
+};
+
+/***********************************************************************
+ *           read_directory_data_getdents
+ *
+ * Read a batch of at least max_count entries using the getdents64 system call,
+ * starting at the data->next directory offset; helper for NtQueryDirectoryFile.
+ * dir_section must be held by caller.
+ */
+static NTSTATUS read_directory_data_getdents( struct dir_data *data, int fd, const UNICODE_STRING *mask,
+                                              unsigned int max_count )
+{
+    static ULONG64 buffer[4096];
+    struct kernel_dirent64 *de;
+    NTSTATUS status = STATUS_NO_MEMORY;
+    off_t old_pos = lseek( fd, 0, SEEK_CUR );
+    int res, pos;
+
+    if (lseek( fd, data->next, SEEK_SET ) == -1) return STATUS_NOT_SUPPORTED;
+
+    if (!data->next)
+    {
+        if (!append_entry( data, ".", NULL, mask )) goto done;
+        if (!append_entry( data, "..", NULL, mask )) goto done;
+    }
+
+    data->more = TRUE;
+    while (data->count < max_count)
+    {
+        if ((res = syscall( __NR_getdents64, fd, buffer, sizeof(buffer) )) == -1)
+        {
+            status = data->next ? FILE_GetNtStatus() : STATUS_NOT_SUPPORTED;
+            goto done;
+        }
+        if (!res)
+        {
+            data->more = FALSE;
+            break;
+        }
+        for (pos = 0; pos < res; pos += de->d_reclen)
+        {
+            de = (struct kernel_dirent64 *)((char *)buffer + pos);
+            data->next = de->d_off;
+            if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+            if (!append_entry( data, de->d_name, NULL, mask )) goto done;
+        }
+    }
+    status = STATUS_SUCCESS;
+
+done:
+    lseek( fd, old_pos, SEEK_SET );
+    return status;
+}
+
+#endif  /* linux && __NR_getdents64 */
+
+
+/***********************************************************************
+ *           read_directory_data_batch
+ *
+ * Replace the names already returned by the next batch of a large directory.
+ */
+static NTSTATUS read_directory_data_batch( struct dir_data *data, int fd )
+{
+#if defined(linux) && defined(__NR_getdents64)
+    reset_dir_data( data );
+    return read_directory_data_getdents( data, fd, data->mask.Buffer ? &data->mask : NULL,
+                                         dir_data_batch_size );
+#else
+    return STATUS_NOT_SUPPORTED;
+#endif
+}
+
+
+/***********************************************************************
+ *           rewind_directory_data
+ *
+ * Restart the enumeration at the beginning of the directory.
+ */
+static NTSTATUS rewind_directory_data( struct dir_data *data, int fd )
+{
+    data->pos = 0;
+    if (!data->batched) return STATUS_SUCCESS;
+    data->next = 0;
+    return read_directory_data_batch( data, fd );
+}
+
+
 /***********************************************************************
  *           read_directory_data
  *
@@ -1849,6 +2038,17 @@ static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICOD
         }
     }
 
+#if defined(linux) && defined(__NR_getdents64)
+    /* large directories are not sorted, and read in batches as the entries are returned */
+    if (!(status = read_directory_data_getdents( data, fd, mask, dir_data_batch_size )))
+    {
+        data->batched = data->more;
+        return status;
+    }
+    if (status != STATUS_NOT_SUPPORTED) return status;
+    reset_dir_data( data );
+#endif
+
     return read_directory_data_readdir( data, mask );
 }
 
@@ -1886,19 +2086,31 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         return status;
     }
 
-    /* sort filenames, but not "." and ".." */
-    i = 0;
-    if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
-    if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    if (data->batched)
+    {
+        /* the mask is needed to filter the following batches */
+        if (mask && (status = RtlDuplicateUnicodeString( 0, mask, &data->mask )))
+        {
+            free_dir_data( data );
+            return status;
+        }
+    }
+    else
+    {
+        /* sort filenames, but not "." and ".." */
+        i = 0;
+        if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
+        if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
+        if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    }
 
     if (data->count)
     {
-        /* release unused space */
-        if (data->buffer)
+        /* release unused space, unless the buffers are reused for the next batches */
+        if (data->buffer && !data->batched)
             RtlReAllocateHeap( GetProcessHeap(), HEAP_REALLOC_IN_PLACE_ONLY, data->buffer,
                                offsetof( struct dir_data_buffer, data[data->buffer->pos] ));
-        if (data->count < data->size)
+        if (data->count < data->size && !data->batched)
             RtlReAllocateHeap( GetProcessHeap(), HEAP_REALLOC_IN_PLACE_ONLY, data->names,
                                data->count * sizeof(*data->names) );
         if (!fstat( fd, &st ))
@@ -1908,9 +2120,8 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         }
     }
 
-    TRACE( "mask %s found %u files\n", debugstr_us( mask ), data->count );
-    for (i = 0; i < data->count; i++)
-        TRACE( "%s %s\n", debugstr_w(data->names[i].long_name), debugstr_w(data->names[i].short_name) );
+    TRACE( "mask %s found %u files%s\n", debugstr_us( mask ), data->count, data->batched ? " in first batch" : "" );
+    for (i = 0; i < data->count; i++) TRACE( "%s\n", debugstr_w(data->names[i].long_name) );
 
     *data_ret = data;
     return data->count ? STATUS_SUCCESS : STATUS_NO_SUCH_FILE;
@@ -2043,10 +2254,16 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
         {
             union file_directory_info *last_info = NULL;
 
-            if (restart_scan) data->pos = 0;
+            if (restart_scan) status = rewind_directory_data( data, fd );
 
-            while (!status && data->pos < data->count)
+            while (!status)
             {
+                if (data->pos >= data->count)
+                {
+                    if (!data->batched || !data->more) break;
+                    if ((status = read_directory_data_batch( data, fd ))) break;
+                    continue;
+                }
                 status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info );
                 if (!status || status == STATUS_BUFFER_OVERFLOW) data->pos++;
                 if (single_entry) break;
@@ -2070,6 +2287,231 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+/***********************************************************************
+ *           get_mtime_nsec
+ */
+static inline unsigned long get_mtime_nsec( const struct stat *st )
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    return st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    return st->st_mtimespec.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+static inline unsigned int hash_name_cache_name( const WCHAR *name, unsigned int len )
+{
+    unsigned int hash = 0;
+    while (len--) hash = hash * 65599 + *name++;
+    return hash;
+}
+
+static void free_name_cache( struct name_cache *cache )
+{
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->entries );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->names );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->unix_names );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+/***********************************************************************
+ *           create_name_cache
+ *
+ * Read the names of a directory into a case-insensitive hash table.
+ */
+static struct name_cache *create_name_cache( const char *unix_name, const struct stat *st )
+{
+    unsigned int size = 256, names_size = 4096, unix_size = 4096, names_pos = 0, unix_pos = 0;
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct name_cache *cache;
+    struct dirent *de;
+    void *ptr;
+    DIR *dir;
+    int i, len;
+
+    if (!(dir = opendir( unix_name ))) return NULL;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) ))) goto error;
+    cache->id.dev     = st->st_dev;
+    cache->id.ino     = st->st_ino;
+    cache->mtime      = st->st_mtime;
+    cache->mtime_nsec = get_mtime_nsec( st );
+    if (!(cache->entries = RtlAllocateHeap( GetProcessHeap(), 0, size * sizeof(*cache->entries) ))) goto error;
+    if (!(cache->names = RtlAllocateHeap( GetProcessHeap(), 0, names_size * sizeof(WCHAR) ))) goto error;
+    if (!(cache->unix_names = RtlAllocateHeap( GetProcessHeap(), 0, unix_size ))) goto error;
+
+    while ((de = readdir( dir )))
+    {
+        size_t unix_len = strlen( de->d_name ) + 1;
+
+        if (cache->count == MAX_NAME_CACHE_COUNT) goto error;
+        if (cache->count == size)
+        {
+            if (!(ptr = RtlReAllocateHeap( GetProcessHeap(), 0, cache->entries,
+                                           size * 2 * sizeof(*cache->entries) ))) goto error;
+            cache->entries = ptr;
+            size *= 2;
+        }
+        if (names_pos + MAX_DIR_ENTRY_LEN > names_size)
+        {
+            if (!(ptr = RtlReAllocateHeap( GetProcessHeap(), 0, cache->names,
+                                           names_size * 2 * sizeof(WCHAR) ))) goto error;
+            cache->names = ptr;
+            names_size *= 2;
+        }
+        if (unix_pos + unix_len > unix_size)
+        {
+            if (!(ptr = RtlReAllocateHeap( GetProcessHeap(), 0, cache->unix_names, unix_size * 2 ))) goto error;
+            cache->unix_names = ptr;
+            unix_size *= 2;
+        }
+
+        len = ntdll_umbstowcs( 0, de->d_name, unix_len - 1, buffer, MAX_DIR_ENTRY_LEN );
+        if (len <= 0) continue;
+        for (i = 0; i < len; i++) cache->names[names_pos + i] = toupperW( buffer[i] );
+        memcpy( cache->unix_names + unix_pos, de->d_name, unix_len );
+
+        cache->entries[cache->count].hash      = hash_name_cache_name( cache->names + names_pos, len );
+        cache->entries[cache->count].name      = names_pos;
+        cache->entries[cache->count].len       = len;
+        cache->entries[cache->count].unix_name = unix_pos;
+        cache->count++;
+        names_pos += len;
+        unix_pos += unix_len;
+    }
+    closedir( dir );
+    dir = NULL;
+
+    for (cache->hash_size = 16; cache->hash_size < cache->count; cache->hash_size *= 2) /* nothing */;
+    if (!(cache->hash = RtlAllocateHeap( GetProcessHeap(), 0, cache->hash_size * sizeof(*cache->hash) )))
+        goto error;
+    memset( cache->hash, 0xff, cache->hash_size * sizeof(*cache->hash) );
+    /* insert in reverse order, so that the first entry of the directory wins like with readdir */
+    for (i = cache->count - 1; i >= 0; i--)
+    {
+        unsigned int *bucket = &cache->hash[cache->entries[i].hash & (cache->hash_size - 1)];
+        cache->entries[i].next = *bucket;
+        *bucket = i;
+    }
+    return cache;
+
+error:
+    if (dir) closedir( dir );
+    if (cache) free_name_cache( cache );
+    return NULL;
+}
+
+/***********************************************************************
+ *           lookup_name_cache
+ *
+ * Look up a name case-insensitively in a directory name cache.
+ */
+static const char *lookup_name_cache( const struct name_cache *cache, const WCHAR *name, int length )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    unsigned int i, hash;
+    int j;
+
+    if (length > MAX_DIR_ENTRY_LEN) return NULL;
+    for (j = 0; j < length; j++) buffer[j] = toupperW( name[j] );
+    hash = hash_name_cache_name( buffer, length );
+
+    for (i = cache->hash[hash & (cache->hash_size - 1)]; i != ~0u; i = cache->entries[i].next)
+    {
+        const struct name_cache_entry *entry = &cache->entries[i];
+        if (entry->hash == hash && entry->len == length &&
+            !memcmp( cache->names + entry->name, buffer, length * sizeof(WCHAR) ))
+            return cache->unix_names + entry->unix_name;
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ *           find_file_in_name_cache
+ *
+ * Find a file case-insensitively through the cached names of its directory.
+ * The directory cache is validated against the directory modification time.
+ * Returns STATUS_OBJECT_NAME_NOT_FOUND if the directory cannot be cached.
+ */
+static NTSTATUS find_file_in_name_cache( const char *unix_dir, const WCHAR *name, int length,
+                                         char *found )
+{
+    struct name_cache *cache, *new_cache = NULL;
+    const char *unix_name;
+    struct stat st;
+    NTSTATUS status = STATUS_OBJECT_PATH_NOT_FOUND;
+
+    if (stat( unix_dir, &st ) == -1) return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    RtlEnterCriticalSection( &name_cache_section );
+
+    name_cache_lookups++;
+    LIST_FOR_EACH_ENTRY( cache, &name_caches, struct name_cache, entry )
+    {
+        if (cache->id.dev != st.st_dev || cache->id.ino != st.st_ino) continue;
+        list_remove( &cache->entry );
+        if (cache->mtime == st.st_mtime && cache->mtime_nsec == get_mtime_nsec( &st ))
+        {
+            name_cache_hits++;
+            list_add_head( &name_caches, &cache->entry );
+            goto found;
+        }
+        name_cache_count--;
+        free_name_cache( cache );
+        break;
+    }
+
+    RtlLeaveCriticalSection( &name_cache_section );
+
+    if (!(new_cache = create_name_cache( unix_dir, &st ))) return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    RtlEnterCriticalSection( &name_cache_section );
+
+    TRACE( "read %u names from %s, %u/%u lookups were cached\n", new_cache->count,
+           debugstr_a(unix_dir), name_cache_hits, name_cache_lookups );
+    cache = new_cache;
+
+    /* a directory modified within the timestamp granularity may still change
+     * without updating its modification time, so it cannot be cached yet */
+    if (st.st_mtime >= time( NULL ) - 1) goto found;
+
+    LIST_FOR_EACH_ENTRY( cache, &name_caches, struct name_cache, entry )
+    {
+        if (cache->id.dev != st.st_dev || cache->id.ino != st.st_ino) continue;
+        /* another thread cached it in the meantime */
+        list_remove( &cache->entry );
+        name_cache_count--;
+        free_name_cache( cache );
+        break;
+    }
+    if (name_cache_count == MAX_NAME_CACHES)
+    {
+        cache = LIST_ENTRY( list_tail( &name_caches ), struct name_cache, entry );
+        list_remove( &cache->entry );
+        name_cache_count--;
+        free_name_cache( cache );
+    }
+    cache = new_cache;
+    new_cache = NULL;
+    list_add_head( &name_caches, &cache->entry );
+    name_cache_count++;
+
+found:
+    if ((unix_name = lookup_name_cache( cache, name, length )))
+    {
+        strcpy( found, unix_name );
+        status = STATUS_SUCCESS;
+    }
+    RtlLeaveCriticalSection( &name_cache_section );
+
+    if (new_cache) free_name_cache( new_cache );
+    return status;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2121,6 +2563,19 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
+    /* look for the long name in the cached directory contents; short names
+     * are only generated by hashing, so only names with a tilde need a scan */
+
+    switch (find_file_in_name_cache( unix_name, name, length, unix_name + pos ))
+    {
+    case STATUS_SUCCESS:
+        unix_name[pos - 1] = '/';
+        goto success;
+    case STATUS_OBJECT_PATH_NOT_FOUND:
+        if (!is_name_8_dot_3 || !memchrW( name, '~', length )) goto not_found;
+        break;
+    }
+
     /* now look for it through the directory */
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
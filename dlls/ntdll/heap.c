@@ -85,6 +85,8 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c
+#define ARENA_LFH_FREE_MAGIC   0x68666c
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -158,6 +160,7 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    SLIST_HEADER    *lfh;           /* Low-fragmentation heap buckets, if enabled */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -166,6 +169,27 @@ typedef struct tagHEAP
 #define COMMIT_MASK          0xffff  /* bitmask for commit/decommit granularity */
 #define MAX_FREE_PENDING     1024    /* max number of free requests to delay */
 
+/* The low-fragmentation heap serves the small blocks from chunks allocated
+ * from the heap itself. Each chunk is split into slots of a single size, and
+ * the free slots of each size are kept on a lock-free list, so that
+ * allocating and freeing them doesn't need to take the heap lock. */
+
+struct lfh_chunk
+{
+    DWORD            magic;         /* Magic number */
+    DWORD            block_size;    /* Size of the slots, without the arena */
+    DWORD            stride;        /* Distance between two slots */
+    DWORD            count;         /* Number of slots */
+    HEAP            *heap;          /* Heap owning the chunk */
+};
+
+#define LFH_CHUNK_MAGIC      ((DWORD)('L' | ('F'<<8) | ('H'<<16) | ('C'<<24)))
+#define LFH_CHUNK_SIZE       0x4000  /* size of the chunks, must be less than HEAP_MIN_LARGE_BLOCK_SIZE */
+#define LFH_MAX_BLOCK_SIZE   ROUND_SIZE(1024)  /* largest block size served by the LFH */
+#define LFH_NB_BUCKETS       (LFH_MAX_BLOCK_SIZE / ALIGNMENT + 1)
+/* offset of the first slot data from the start of the chunk */
+#define LFH_HEADER_SIZE      ((sizeof(struct lfh_chunk) + sizeof(ARENA_INUSE) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
 /* some undocumented flags (names are made up) */
 #define HEAP_PAGE_ALLOCS      0x01000000
 #define HEAP_VALIDATE         0x10000000
@@ -915,6 +939,7 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->flags         = flags;
         heap->magic         = HEAP_MAGIC;
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
+        heap->lfh           = NULL;
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
 
@@ -1307,6 +1332,27 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
 }
 
 
+/***********************************************************************
+ *           lfh_get_chunk
+ *
+ * Return the chunk containing an arena if it's a low-fragmentation heap slot.
+ */
+static struct lfh_chunk *lfh_get_chunk( const HEAP *heap, const ARENA_INUSE *arena )
+{
+    struct lfh_chunk *chunk;
+    DWORD offset;
+
+    if (arena->magic != ARENA_LFH_MAGIC && arena->magic != ARENA_LFH_FREE_MAGIC) return NULL;
+    offset = arena->size;
+    if (offset < LFH_HEADER_SIZE - sizeof(ARENA_INUSE) || offset >= LFH_CHUNK_SIZE) return NULL;
+    chunk = (struct lfh_chunk *)((char *)arena - offset);
+    if (chunk->magic != LFH_CHUNK_MAGIC || chunk->heap != heap) return NULL;
+    offset -= LFH_HEADER_SIZE - sizeof(ARENA_INUSE);
+    if (offset % chunk->stride || offset / chunk->stride >= chunk->count) return NULL;
+    return chunk;
+}
+
+
 /***********************************************************************
  *           HEAP_IsRealArena  [Internal]
  * Validates a block is a valid arena.
@@ -1348,7 +1394,16 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
             }
             else
                 ret = validate_large_arena( heapPtr, large_arena, quiet );
-        } else
+        }
+        else if (heapPtr->lfh && lfh_get_chunk( heapPtr, arena ))
+        {
+            if (!(ret = (arena->magic == ARENA_LFH_MAGIC)))
+            {
+                if (quiet == NOISY) ERR("Heap %p: block %p is not in use\n", heapPtr, block );
+                else if (WARN_ON(heap)) WARN("Heap %p: block %p is not in use\n", heapPtr, block );
+            }
+        }
+        else
             ret = HEAP_ValidateInUseArena( subheap, arena, quiet );
 
         if (!(flags & HEAP_NO_SERIALIZE))
@@ -1437,6 +1492,142 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/***********************************************************************
+ *           lfh_allocate
+ *
+ * Allocate a block from the low-fragmentation heap. The caller falls back
+ * to the normal allocation path if this fails.
+ */
+static void *lfh_allocate( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T rounded_size )
+{
+    SLIST_HEADER *bucket = &heap->lfh[rounded_size / ALIGNMENT];
+    struct lfh_chunk *chunk;
+    ARENA_INUSE *arena;
+    SLIST_ENTRY *entry;
+    DWORD i;
+
+    if (!(entry = RtlInterlockedPopEntrySList( bucket )))
+    {
+        /* allocate a new chunk from the heap and split it into slots */
+        if (!(chunk = RtlAllocateHeap( heap, flags & HEAP_NO_SERIALIZE, LFH_CHUNK_SIZE ))) return NULL;
+        chunk->magic      = LFH_CHUNK_MAGIC;
+        chunk->block_size = rounded_size;
+        chunk->stride     = rounded_size + sizeof(ARENA_INUSE);
+        chunk->count      = (LFH_CHUNK_SIZE - LFH_HEADER_SIZE + sizeof(ARENA_INUSE)) / chunk->stride;
+        chunk->heap       = heap;
+        for (i = 0; i < chunk->count; i++)
+        {
+            arena = (ARENA_INUSE *)((char *)chunk + LFH_HEADER_SIZE + i * chunk->stride) - 1;
+            arena->size         = (char *)arena - (char *)chunk;
+            arena->magic        = ARENA_LFH_FREE_MAGIC;
+            arena->unused_bytes = 0;
+            if (i) RtlInterlockedPushEntrySList( bucket, (SLIST_ENTRY *)(arena + 1) );
+        }
+        entry = (SLIST_ENTRY *)((char *)chunk + LFH_HEADER_SIZE);
+    }
+
+    arena = (ARENA_INUSE *)entry - 1;
+    arena->magic        = ARENA_LFH_MAGIC;
+    arena->unused_bytes = rounded_size - size;
+    notify_alloc( arena + 1, size, flags & HEAP_ZERO_MEMORY );
+    initialize_block( arena + 1, size, arena->unused_bytes, flags );
+    return arena + 1;
+}
+
+
+/***********************************************************************
+ *           lfh_free
+ *
+ * Return a block to the low-fragmentation heap.
+ */
+static BOOL lfh_free( HEAP *heap, struct lfh_chunk *chunk, ARENA_INUSE *arena )
+{
+    if (arena->magic != ARENA_LFH_MAGIC)
+    {
+        WARN( "Heap %p: block %p used after free\n", heap, arena + 1 );
+        return FALSE;
+    }
+    notify_free( arena + 1 );
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    RtlInterlockedPushEntrySList( &heap->lfh[chunk->block_size / ALIGNMENT], (SLIST_ENTRY *)(arena + 1) );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           lfh_reallocate
+ *
+ * Resize a block of the low-fragmentation heap.
+ */
+static void *lfh_reallocate( HEAP *heap, struct lfh_chunk *chunk, DWORD flags, void *ptr, SIZE_T size )
+{
+    ARENA_INUSE *arena = (ARENA_INUSE *)ptr - 1;
+    SIZE_T old_size, rounded_size = ROUND_SIZE(size);
+    void *ret;
+
+    if (arena->magic != ARENA_LFH_MAGIC)
+    {
+        WARN( "Heap %p: block %p used after free\n", heap, ptr );
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+        return NULL;
+    }
+    if (rounded_size < size) goto oom;  /* overflow */
+    if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
+
+    old_size = chunk->block_size - arena->unused_bytes;
+    /* unused_bytes is only 8 bits wide, larger shrinks move to a smaller bucket */
+    if (rounded_size <= chunk->block_size && chunk->block_size - size <= 0xff)
+    {
+        notify_realloc( ptr, old_size, size );
+        arena->unused_bytes = chunk->block_size - size;
+        if (size > old_size)
+            initialize_block( (char *)ptr + old_size, size - old_size, arena->unused_bytes, flags );
+        else
+            mark_block_tail( (char *)ptr + size, arena->unused_bytes, flags );
+        return ptr;
+    }
+
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) goto oom;
+    if (!(ret = RtlAllocateHeap( heap, flags, size ))) goto oom;
+    memcpy( ret, ptr, min( old_size, size ));
+    lfh_free( heap, chunk, arena );
+    return ret;
+
+oom:
+    if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+    RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           lfh_enable
+ *
+ * Enable the low-fragmentation heap front end.
+ */
+static NTSTATUS lfh_enable( HEAP *heap )
+{
+    SLIST_HEADER *buckets;
+
+    if (heap->lfh) return STATUS_SUCCESS;
+    if (heap->flags & (HEAP_NO_SERIALIZE | HEAP_SHARED)) return STATUS_INVALID_PARAMETER;
+    /* the debugging checks only work on normal blocks */
+    if ((heap->flags & (HEAP_VALIDATE | HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED |
+                        HEAP_PAGE_ALLOCS)) || RUNNING_ON_VALGRIND)
+        return STATUS_UNSUCCESSFUL;
+
+    if (!(buckets = RtlAllocateHeap( heap, HEAP_ZERO_MEMORY, LFH_NB_BUCKETS * sizeof(*buckets) )))
+        return STATUS_NO_MEMORY;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    if (!heap->lfh) heap->lfh = buckets;
+    else RtlFreeHeap( heap, 0, buckets );
+    RtlLeaveCriticalSection( &heap->critSection );
+    TRACE( "heap %p: enabled low-fragmentation heap\n", heap );
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1673,6 +1864,13 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh && rounded_size <= LFH_MAX_BLOCK_SIZE &&
+        (pInUse = lfh_allocate( heapPtr, flags, size, rounded_size )))
+    {
+        TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse );
+        return pInUse;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1739,6 +1937,7 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
  */
 BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 {
+    struct lfh_chunk *chunk;
     ARENA_INUSE *pInUse;
     SUBHEAP *subheap;
     HEAP *heapPtr;
@@ -1756,13 +1955,26 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+    pInUse  = (ARENA_INUSE *)ptr - 1;
+
+    if (heapPtr->lfh && !((ULONG_PTR)ptr % ALIGNMENT) && (chunk = lfh_get_chunk( heapPtr, pInUse )))
+    {
+        if (!lfh_free( heapPtr, chunk, pInUse ))
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            TRACE("(%p,%08x,%p): returning FALSE\n", heap, flags, ptr );
+            return FALSE;
+        }
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
 
     /* Some sanity checks */
-    pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
 
     if (!subheap)
@@ -1802,6 +2014,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     ARENA_INUSE *pArena;
     HEAP *heapPtr;
     SUBHEAP *subheap;
+    struct lfh_chunk *chunk;
     SIZE_T oldBlockSize, oldActualSize, rounded_size;
     void *ret;
 
@@ -1817,6 +2030,15 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    if (heapPtr->lfh && !((ULONG_PTR)ptr % ALIGNMENT) &&
+        (chunk = lfh_get_chunk( heapPtr, (ARENA_INUSE *)ptr - 1 )))
+    {
+        ret = lfh_reallocate( heapPtr, chunk, flags, ptr, size );
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE(flags);
@@ -2016,6 +2238,7 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
 {
     SIZE_T ret;
     const ARENA_INUSE *pArena;
+    const struct lfh_chunk *chunk;
     SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
 
@@ -2026,9 +2249,22 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     }
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+    pArena = (const ARENA_INUSE *)ptr - 1;
+
+    if (heapPtr->lfh && !((ULONG_PTR)ptr % ALIGNMENT) && (chunk = lfh_get_chunk( heapPtr, pArena )))
+    {
+        if (pArena->magic == ARENA_LFH_MAGIC) ret = chunk->block_size - pArena->unused_bytes;
+        else
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            ret = ~0UL;
+        }
+        TRACE("(%p,%08x,%p): returning %08lx\n", heap, flags, ptr, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
-    pArena = (const ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pArena ))
     {
         RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
@@ -2236,6 +2472,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2243,8 +2481,10 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
 
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
 
-        *(ULONG *)info = 0; /* standard heap */
+        /* 0 is the standard heap, 2 the low-fragmentation heap */
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0;
         return STATUS_SUCCESS;
 
     default:
@@ -2258,6 +2498,26 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* the low-fragmentation heap can't be disabled */
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:
+            return lfh_enable( heapPtr );
+        default:
+            return STATUS_INVALID_PARAMETER;
+        }
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
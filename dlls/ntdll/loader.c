@@ -40,6 +40,7 @@
 #include "wine/library.h"
 #include "wine/unicode.h"
 #include "wine/debug.h"
+#include "wine/list.h"
 #include "wine/server.h"
 #include "ntdll_misc.h"
 #include "ddk/wdm.h"
@@ -84,6 +85,7 @@ typedef struct _wine_modref
     LDR_MODULE            ldr;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct list           hash_entry;  /* entry in the module name hash table */
 } WINE_MODREF;
 
 /* info about the current builtin dll load */
@@ -117,12 +119,64 @@ static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
+/* modules hashed by base name, to avoid walking the load order list on every lookup */
+#define MODULE_HASH_SIZE 256
+static struct list module_hash[MODULE_HASH_SIZE];
+
+/* native dlls mapped in advance by the loader threads */
+struct prefetched_dll
+{
+    struct list entry;      /* entry in the prefetched dlls list */
+    struct list job_entry;  /* entry in the loader threads job list */
+    HANDLE      file;       /* handle to the dll file */
+    HANDLE      mapping;    /* image mapping of the file */
+    void       *module;     /* address of the mapped image */
+    SIZE_T      len;        /* size of the mapped image */
+    NTSTATUS    status;     /* result of the mapping */
+    WCHAR       name[1];    /* full path name of the dll */
+};
+
+#define MAX_LOADER_THREADS 16
+static struct list prefetched_dlls = LIST_INIT( prefetched_dlls );
+static struct list prefetch_jobs = LIST_INIT( prefetch_jobs );
+static BOOL prefetch_active;
+static LONG prefetch_pending;
+static HANDLE prefetch_semaphore;
+static HANDLE prefetch_done_event;
+static int max_loader_threads = -1;
+static unsigned int loader_thread_count;
+static DWORD loader_thread_ids[MAX_LOADER_THREADS];
+static HANDLE loader_threads[MAX_LOADER_THREADS];
+
+static RTL_CRITICAL_SECTION prefetch_section;
+static RTL_CRITICAL_SECTION_DEBUG prefetch_critsect_debug =
+{
+    0, 0, &prefetch_section,
+    { &prefetch_critsect_debug.ProcessLocksList, &prefetch_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": prefetch_section") }
+};
+static RTL_CRITICAL_SECTION prefetch_section = { &prefetch_critsect_debug, -1, 0, 0, 0, 0 };
+
+/* the loader threads don't receive thread attach and detach notifications */
+static inline BOOL is_loader_thread(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < loader_thread_count; i++)
+        if (loader_thread_ids[i] == GetCurrentThreadId()) return TRUE;
+    return FALSE;
+}
+
 static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                     DWORD exp_size, DWORD ordinal, LPCWSTR load_path );
 static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                   DWORD exp_size, const char *name, int hint, LPCWSTR load_path );
+static NTSTATUS find_dll_file( const WCHAR *load_path, const WCHAR *libname,
+                               WCHAR *filename, ULONG *size, WINE_MODREF **pwm, HANDLE *handle );
+static BOOL prefetch_imports( WINE_MODREF *wm, LPCWSTR load_path );
+static void release_prefetched_dlls(void);
 
 /* convert PE image VirtualAddress to Real Address */
 static inline void *get_rva( HMODULE module, DWORD va )
@@ -360,6 +414,26 @@ static WINE_MODREF *get_modref( HMODULE hmod )
 }
 
 
+/**********************************************************************
+ *	    get_module_hash_list
+ *
+ * Return the hash table list of modules with the base name of the specified path.
+ * The loader_section must be locked while calling this function
+ */
+static struct list *get_module_hash_list( LPCWSTR path )
+{
+    const WCHAR *p;
+    unsigned int hash = 0;
+    struct list *list;
+
+    if ((p = strrchrW( path, '\\' ))) path = p + 1;
+    while (*path) hash = hash * 65599 + tolowerW( *path++ );
+    list = &module_hash[hash % MODULE_HASH_SIZE];
+    if (!list->next) list_init( list );
+    return list;
+}
+
+
 /**********************************************************************
  *	    find_basename_module
  *
@@ -368,18 +442,19 @@ static WINE_MODREF *get_modref( HMODULE hmod )
  */
 static WINE_MODREF *find_basename_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
 
     if (cached_modref && !strcmpiW( name, cached_modref->ldr.BaseDllName.Buffer ))
         return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    /* a name containing a backslash can't match any base name */
+    if (strchrW( name, '\\' )) return NULL;
+
+    LIST_FOR_EACH_ENTRY( wm, get_module_hash_list( name ), WINE_MODREF, hash_entry )
     {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->BaseDllName.Buffer ))
+        if (!strcmpiW( name, wm->ldr.BaseDllName.Buffer ))
         {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
+            cached_modref = wm;
             return cached_modref;
         }
     }
@@ -395,18 +470,16 @@ static WINE_MODREF *find_basename_module( LPCWSTR name )
  */
 static WINE_MODREF *find_fullname_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
 
     if (cached_modref && !strcmpiW( name, cached_modref->ldr.FullDllName.Buffer ))
         return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    LIST_FOR_EACH_ENTRY( wm, get_module_hash_list( name ), WINE_MODREF, hash_entry )
     {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->FullDllName.Buffer ))
+        if (!strcmpiW( name, wm->ldr.FullDllName.Buffer ))
         {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
+            cached_modref = wm;
             return cached_modref;
         }
     }
@@ -882,6 +955,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     DWORD size;
     NTSTATUS status;
     ULONG_PTR cookie;
+    BOOL prefetched;
 
     if (!(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS)) return STATUS_SUCCESS;  /* already done */
     wm->ldr.Flags &= ~LDR_DONT_RESOLVE_REFS;
@@ -909,6 +983,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
      */
     prev = current_modref;
     current_modref = wm;
+    prefetched = prefetch_imports( wm, load_path );
     status = STATUS_SUCCESS;
     for (i = 0; i < nb_imports; i++)
     {
@@ -918,6 +993,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
             status = STATUS_DLL_NOT_FOUND;
         }
     }
+    if (prefetched) release_prefetched_dlls();
     current_modref = prev;
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
@@ -969,6 +1045,7 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
                    &wm->ldr.InLoadOrderModuleList);
     InsertTailList(&NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList,
                    &wm->ldr.InMemoryOrderModuleList);
+    list_add_tail( get_module_hash_list( wm->ldr.FullDllName.Buffer ), &wm->hash_entry );
 
     /* wait until init is called for inserting into this list */
     wm->ldr.InInitializationOrderModuleList.Flink = NULL;
@@ -1312,7 +1389,7 @@ NTSTATUS MODULE_DllThreadAttach( LPVOID lpReserved )
     NTSTATUS    status;
 
     /* don't do any attach calls if process is exiting */
-    if (process_detaching) return STATUS_SUCCESS;
+    if (process_detaching || is_loader_thread()) return STATUS_SUCCESS;
 
     RtlEnterCriticalSection( &loader_section );
 
@@ -1609,6 +1686,7 @@ static void load_builtin_callback( void *module, const char *filename )
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            list_remove( &wm->hash_entry );
             /* FIXME: free the modref */
             builtin_load_info->status = STATUS_DLL_NOT_FOUND;
             return;
@@ -1765,40 +1843,315 @@ static NTSTATUS perform_relocations( void *module, SIZE_T len )
 }
 
 /******************************************************************************
- *	load_native_dll  (internal)
+ *	map_native_dll  (internal)
+ *
+ * Map a native dll image and perform base relocation, if necessary.
  */
-static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
-                                 DWORD flags, WINE_MODREF** pwm )
+static NTSTATUS map_native_dll( HANDLE file, HANDLE *mapping, void **module, SIZE_T *len )
 {
-    void *module;
-    HANDLE mapping;
     LARGE_INTEGER size;
-    IMAGE_NT_HEADERS *nt;
-    SIZE_T len = 0;
-    WINE_MODREF *wm;
     NTSTATUS status;
 
-    TRACE("Trying native dll %s\n", debugstr_w(name));
-
     size.QuadPart = 0;
-    status = NtCreateSection( &mapping, STANDARD_RIGHTS_REQUIRED | SECTION_QUERY | SECTION_MAP_READ,
+    status = NtCreateSection( mapping, STANDARD_RIGHTS_REQUIRED | SECTION_QUERY | SECTION_MAP_READ,
                               NULL, &size, PAGE_EXECUTE_READ, SEC_IMAGE, file );
     if (status != STATUS_SUCCESS) return status;
 
-    module = NULL;
-    status = NtMapViewOfSection( mapping, NtCurrentProcess(),
-                                 &module, 0, 0, &size, &len, ViewShare, 0, PAGE_EXECUTE_READ );
-
-    /* perform base relocation, if necessary */
+    *module = NULL;
+    *len = 0;
+    status = NtMapViewOfSection( *mapping, NtCurrentProcess(),
+                                 module, 0, 0, &size, len, ViewShare, 0, PAGE_EXECUTE_READ );
 
     if (status == STATUS_IMAGE_NOT_AT_BASE)
-        status = perform_relocations( module, len );
+        status = perform_relocations( *module, *len );
 
     if (status != STATUS_SUCCESS)
     {
-        if (module) NtUnmapViewOfSection( NtCurrentProcess(), module );
-        goto done;
+        if (*module) NtUnmapViewOfSection( NtCurrentProcess(), *module );
+        NtClose( *mapping );
+    }
+    return status;
+}
+
+
+/******************************************************************************
+ *	run_prefetch_job  (internal)
+ *
+ * Map the next queued dll. Returns FALSE if there are no queued dlls.
+ */
+static BOOL run_prefetch_job(void)
+{
+    struct prefetched_dll *dll;
+    struct list *ptr;
+
+    RtlEnterCriticalSection( &prefetch_section );
+    if ((ptr = list_head( &prefetch_jobs ))) list_remove( ptr );
+    RtlLeaveCriticalSection( &prefetch_section );
+    if (!ptr) return FALSE;
+
+    dll = LIST_ENTRY( ptr, struct prefetched_dll, job_entry );
+    dll->status = map_native_dll( dll->file, &dll->mapping, &dll->module, &dll->len );
+    TRACE( "mapped %s at %p status %x\n", debugstr_w(dll->name), dll->module, dll->status );
+
+    if (interlocked_xchg_add( &prefetch_pending, -1 ) == 1) NtSetEvent( prefetch_done_event, NULL );
+    return TRUE;
+}
+
+
+/******************************************************************************
+ *	loader_thread_proc  (internal)
+ */
+static void CALLBACK loader_thread_proc( void *arg )
+{
+    for (;;)
+    {
+        NtWaitForSingleObject( prefetch_semaphore, FALSE, NULL );
+        if (!run_prefetch_job() && !prefetch_active) break;
     }
+    RtlExitUserThread( 0 );
+}
+
+
+/******************************************************************************
+ *	start_loader_threads  (internal)
+ *
+ * Start the threads that map the dlls, if enabled with WINELOADERTHREADS.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL start_loader_threads(void)
+{
+    CLIENT_ID id;
+    HANDLE thread;
+
+    if (max_loader_threads == -1)
+    {
+        const char *env = getenv( "WINELOADERTHREADS" );
+
+        max_loader_threads = env ? min( max( atoi( env ), 0 ), MAX_LOADER_THREADS ) : 0;
+        if (max_loader_threads &&
+            (NtCreateSemaphore( &prefetch_semaphore, SEMAPHORE_ALL_ACCESS, NULL, 0, MAXLONG ) ||
+             NtCreateEvent( &prefetch_done_event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE )))
+            max_loader_threads = 0;
+    }
+
+    while (loader_thread_count < max_loader_threads)
+    {
+        /* the thread id has to be known before the thread tries to send the attach notifications */
+        if (RtlCreateUserThread( NtCurrentProcess(), NULL, TRUE, NULL, 0, 0,
+                                 loader_thread_proc, NULL, &thread, &id )) break;
+        loader_threads[loader_thread_count] = thread;
+        loader_thread_ids[loader_thread_count++] = HandleToULong( id.UniqueThread );
+        NtResumeThread( thread, NULL );
+    }
+    return loader_thread_count > 0;
+}
+
+
+/******************************************************************************
+ *	find_prefetched_dll  (internal)
+ */
+static struct prefetched_dll *find_prefetched_dll( const WCHAR *name )
+{
+    struct prefetched_dll *dll;
+
+    LIST_FOR_EACH_ENTRY( dll, &prefetched_dlls, struct prefetched_dll, entry )
+        if (!strcmpiW( dll->name, name )) return dll;
+    return NULL;
+}
+
+
+/******************************************************************************
+ *	get_prefetched_dll  (internal)
+ *
+ * Retrieve the mapping of a dll mapped in advance by the loader threads.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL get_prefetched_dll( const WCHAR *name, HANDLE *mapping, void **module, SIZE_T *len,
+                                NTSTATUS *status )
+{
+    struct prefetched_dll *dll;
+
+    if (!(dll = find_prefetched_dll( name ))) return FALSE;
+
+    TRACE( "using prefetched %s at %p\n", debugstr_w(name), dll->module );
+    *mapping = dll->mapping;
+    *module  = dll->module;
+    *len     = dll->len;
+    *status  = dll->status;
+    list_remove( &dll->entry );
+    NtClose( dll->file );
+    RtlFreeHeap( GetProcessHeap(), 0, dll );
+    return TRUE;
+}
+
+
+/******************************************************************************
+ *	queue_prefetch_imports  (internal)
+ *
+ * Queue the native dlls imported by a module that haven't been loaded yet.
+ * Returns the number of queued dlls.
+ * The loader_section must be locked while calling this function.
+ */
+static unsigned int queue_prefetch_imports( HMODULE module, LPCWSTR load_path )
+{
+    const IMAGE_IMPORT_DESCRIPTOR *imports;
+    const IMAGE_THUNK_DATA *import_list;
+    struct prefetched_dll *dll;
+    WINE_MODREF *wm, *main_exe;
+    WCHAR buffer[MAX_PATH], filename[MAX_PATH];
+    unsigned int count = 0;
+    const char *name;
+    HANDLE handle;
+    DWORD len;
+    ULONG size;
+
+    if (!(imports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size )))
+        return 0;
+
+    main_exe = get_modref( NtCurrentTeb()->Peb->ImageBaseAddress );
+
+    for ( ; imports->Name && imports->FirstThunk; imports++)
+    {
+        if (imports->u.OriginalFirstThunk) import_list = get_rva( module, imports->u.OriginalFirstThunk );
+        else import_list = get_rva( module, imports->FirstThunk );
+        if (!import_list->u1.Ordinal) continue;  /* unused import */
+
+        name = get_rva( module, imports->Name );
+        len = strlen( name );
+        while (len && name[len-1] == ' ') len--;  /* remove trailing spaces */
+        if (len >= MAX_PATH) continue;
+        ascii_to_unicode( buffer, name, len );
+        buffer[len] = 0;
+
+        handle = 0;
+        size = sizeof(filename);
+        if (find_dll_file( load_path, buffer, filename, &size, &wm, &handle ) || wm || !handle) continue;
+
+        switch (get_load_order( main_exe ? main_exe->ldr.BaseDllName.Buffer : NULL, filename ))
+        {
+        case LO_INVALID:
+        case LO_DISABLED:
+        case LO_BUILTIN:
+            NtClose( handle );
+            continue;
+        default:
+            break;
+        }
+        if (find_prefetched_dll( filename ) || is_fake_dll( handle ) ||
+            !(dll = RtlAllocateHeap( GetProcessHeap(), 0,
+                                     offsetof( struct prefetched_dll, name[strlenW(filename) + 1] ))))
+        {
+            NtClose( handle );
+            continue;
+        }
+        strcpyW( dll->name, filename );
+        dll->file    = handle;
+        dll->mapping = 0;
+        dll->module  = NULL;
+        dll->len     = 0;
+        dll->status  = STATUS_PENDING;
+        list_add_tail( &prefetched_dlls, &dll->entry );
+
+        interlocked_xchg_add( &prefetch_pending, 1 );
+        RtlEnterCriticalSection( &prefetch_section );
+        list_add_tail( &prefetch_jobs, &dll->job_entry );
+        RtlLeaveCriticalSection( &prefetch_section );
+        count++;
+    }
+    return count;
+}
+
+
+/******************************************************************************
+ *	prefetch_imports  (internal)
+ *
+ * Map and relocate the native dlls of the static import graph of a module
+ * on the loader threads, before they get loaded in order by import_dll.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL prefetch_imports( WINE_MODREF *wm, LPCWSTR load_path )
+{
+    struct prefetched_dll *dll;
+    struct list *ptr, *end;
+    unsigned int count;
+
+    if (prefetch_active || !start_loader_threads()) return FALSE;
+    prefetch_active = TRUE;
+
+    /* map the graph one level at a time, the imports of each level are only known once it's mapped */
+    ptr = &prefetched_dlls;
+    count = queue_prefetch_imports( wm->ldr.BaseAddress, load_path );
+    while (count)
+    {
+        NtReleaseSemaphore( prefetch_semaphore, min( count, loader_thread_count ), NULL );
+        while (run_prefetch_job()) /* help the loader threads */;
+        while (prefetch_pending) NtWaitForSingleObject( prefetch_done_event, FALSE, NULL );
+
+        count = 0;
+        end = list_tail( &prefetched_dlls );
+        while (ptr != end)
+        {
+            ptr = list_next( &prefetched_dlls, ptr );
+            dll = LIST_ENTRY( ptr, struct prefetched_dll, entry );
+            if (!dll->status) count += queue_prefetch_imports( dll->module, load_path );
+        }
+    }
+    return TRUE;
+}
+
+
+/******************************************************************************
+ *	release_prefetched_dlls  (internal)
+ *
+ * Unmap the prefetched dlls that didn't get loaded, and stop the loader threads.
+ * The loader_section must be locked while calling this function.
+ */
+static void release_prefetched_dlls(void)
+{
+    struct prefetched_dll *dll, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( dll, next, &prefetched_dlls, struct prefetched_dll, entry )
+    {
+        TRACE( "releasing unused %s\n", debugstr_w(dll->name) );
+        list_remove( &dll->entry );
+        if (!dll->status)
+        {
+            NtUnmapViewOfSection( NtCurrentProcess(), dll->module );
+            NtClose( dll->mapping );
+        }
+        NtClose( dll->file );
+        RtlFreeHeap( GetProcessHeap(), 0, dll );
+    }
+
+    prefetch_active = FALSE;
+    NtReleaseSemaphore( prefetch_semaphore, loader_thread_count, NULL );
+    NtWaitForMultipleObjects( loader_thread_count, loader_threads, FALSE, FALSE, NULL );
+    while (loader_thread_count)
+    {
+        NtClose( loader_threads[--loader_thread_count] );
+        loader_thread_ids[loader_thread_count] = 0;
+    }
+}
+
+
+/******************************************************************************
+ *	load_native_dll  (internal)
+ */
+static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
+                                 DWORD flags, WINE_MODREF** pwm )
+{
+    void *module;
+    HANDLE mapping;
+    IMAGE_NT_HEADERS *nt;
+    SIZE_T len;
+    WINE_MODREF *wm;
+    NTSTATUS status;
+
+    TRACE("Trying native dll %s\n", debugstr_w(name));
+
+    if (!get_prefetched_dll( name, &mapping, &module, &len, &status ))
+        status = map_native_dll( file, &mapping, &module, &len );
+    if (status != STATUS_SUCCESS) return status;
 
     /* create the MODREF */
 
@@ -1823,6 +2176,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            list_remove( &wm->hash_entry );
 
             /* FIXME: there are several more dangling references
              * left. Including dlls loaded by this dll before the
@@ -2760,7 +3114,7 @@ void WINAPI LdrShutdownThread(void)
     TRACE("()\n");
 
     /* don't do any detach calls if process is exiting */
-    if (process_detaching) return;
+    if (process_detaching || is_loader_thread()) return;
 
     RtlEnterCriticalSection( &loader_section );
 
@@ -2801,6 +3155,7 @@ static void free_modref( WINE_MODREF *wm )
 {
     RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
     RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+    list_remove( &wm->hash_entry );
     if (wm->ldr.InInitializationOrderModuleList.Flink)
         RemoveEntryList(&wm->ldr.InInitializationOrderModuleList);
 
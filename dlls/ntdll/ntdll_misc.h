@@ -94,6 +94,9 @@ extern unsigned int server_select( const select_op_t *select_op, data_size_t siz
                                    UINT flags, const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
 extern unsigned int server_queue_process_apc( HANDLE process, const apc_call_t *call, apc_result_t *result ) DECLSPEC_HIDDEN;
 extern int server_remove_fd_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void server_remove_shared_sync_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+extern shared_sync_t *server_get_shared_sync( HANDLE handle, enum shared_sync_type *type,
+                                              unsigned int *access ) DECLSPEC_HIDDEN;
 extern int server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
@@ -238,6 +241,7 @@ struct ntdll_thread_data
     WINE_VM86_TEB_INFO vm86;          /* 1fc vm86 private data */
     void              *exit_frame;    /* 204 exit frame pointer */
 #endif
+    unsigned int       request_slot;  /* 208/318 slot in the shared memory request ring */
 };
 
 static inline struct ntdll_thread_data *ntdll_get_thread_data(void)
@@ -370,6 +370,7 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source,
             {
                 int fd = server_remove_fd_from_cache( source );
                 if (fd != -1) close( fd );
+                server_remove_shared_sync_from_cache( source );
             }
         }
     }
@@ -382,6 +383,7 @@ NTSTATUS close_handle( HANDLE handle )
 {
     NTSTATUS ret;
     int fd = server_remove_fd_from_cache( handle );
+    server_remove_shared_sync_from_cache( handle );
 
     SERVER_START_REQ( close_handle )
     {
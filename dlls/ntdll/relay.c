@@ -23,9 +23,17 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -70,9 +78,52 @@ struct relay_private_data
     HMODULE                  module;            /* module handle of this dll */
     unsigned int             base;              /* ordinal base */
     char                     dllname[40];       /* dll name (without .dll extension) */
+    unsigned int             log_module;        /* index of the dll in the binary log */
     struct relay_entry_point entry_points[1];   /* list of dll entry points */
 };
 
+/* binary relay log, enabled by setting WINERELAYLOG to a file name */
+/* the format is decoded by tools/decode-relay, keep them in sync */
+
+#define RELAY_LOG_MAGIC      "WineRlog"
+#define RELAY_LOG_CALL       1
+#define RELAY_LOG_RET        2
+#define RELAY_LOG_RECORDS    (1 << 20)  /* must be a power of 2 */
+#define RELAY_LOG_NAMES_SIZE (4 * 1024 * 1024)
+
+struct relay_log_header
+{
+    char      magic[8];        /* RELAY_LOG_MAGIC */
+    DWORD     pid;             /* process id */
+    DWORD     record_count;    /* size of the records ring */
+    DWORD     names_size;      /* size of the names area following the header */
+    LONG      names_pos;       /* used size of the names area */
+    LONG      next_record;     /* total count of records written so far */
+    DWORD     reserved;
+    ULONGLONG frequency;       /* frequency of the record timestamps */
+    char      pad[24];
+};
+
+struct relay_log_record
+{
+    ULONGLONG time;            /* performance counter value */
+    DWORD     tid;             /* thread id */
+    WORD      module;          /* index of the dll */
+    WORD      ordinal;         /* function ordinal */
+    BYTE      type;            /* RELAY_LOG_CALL or RELAY_LOG_RET */
+    BYTE      nb_args;         /* number of arguments of the function */
+    BYTE      pad[6];
+    ULONGLONG ret_addr;        /* return address of the call */
+    ULONGLONG args[4];         /* first arguments of a call, or return value */
+};
+
+C_ASSERT( sizeof(struct relay_log_header) == 64 );
+C_ASSERT( sizeof(struct relay_log_record) == 64 );
+
+static struct relay_log_header *relay_log;
+static struct relay_log_record *relay_log_records;
+static unsigned int relay_log_modules;
+
 static const WCHAR **debug_relay_excludelist;
 static const WCHAR **debug_relay_includelist;
 static const WCHAR **debug_snoop_excludelist;
@@ -84,6 +135,87 @@ static const WCHAR **debug_from_snoop_includelist;
 
 static RTL_RUN_ONCE init_once = RTL_RUN_ONCE_INIT;
 
+/***********************************************************************
+ *           init_relay_log
+ *
+ * Create the binary relay log file if requested.
+ */
+static void init_relay_log(void)
+{
+    const char *name = getenv( "WINERELAYLOG" );
+    size_t size = sizeof(*relay_log) + RELAY_LOG_NAMES_SIZE + RELAY_LOG_RECORDS * sizeof(*relay_log_records);
+    LARGE_INTEGER counter, frequency;
+    char *path;
+    void *ptr;
+    int fd;
+
+    if (!name || !name[0]) return;
+    if (!(path = RtlAllocateHeap( GetProcessHeap(), 0, strlen(name) + 12 ))) return;
+    sprintf( path, "%s.%u", name, GetCurrentProcessId() );
+    fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+    RtlFreeHeap( GetProcessHeap(), 0, path );
+    if (fd == -1) return;
+
+    if (!ftruncate( fd, size ) &&
+        (ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) != MAP_FAILED)
+    {
+        NtQueryPerformanceCounter( &counter, &frequency );
+        relay_log = ptr;
+        relay_log->pid          = GetCurrentProcessId();
+        relay_log->record_count = RELAY_LOG_RECORDS;
+        relay_log->names_size   = RELAY_LOG_NAMES_SIZE;
+        relay_log->frequency    = frequency.QuadPart;
+        memcpy( relay_log->magic, RELAY_LOG_MAGIC, sizeof(relay_log->magic) );
+        relay_log_records = (struct relay_log_record *)((char *)(relay_log + 1) + RELAY_LOG_NAMES_SIZE);
+    }
+    close( fd );
+}
+
+/***********************************************************************
+ *           add_relay_log_name
+ *
+ * Add a line to the names area of the binary relay log.
+ */
+static void add_relay_log_name( const char *format, ... )
+{
+    char *names = (char *)(relay_log + 1);
+    LONG pos = relay_log->names_pos;
+    va_list args;
+    int len;
+
+    va_start( args, format );
+    len = vsnprintf( names + pos, RELAY_LOG_NAMES_SIZE - pos, format, args );
+    va_end( args );
+    if (len >= 0 && len < RELAY_LOG_NAMES_SIZE - pos) relay_log->names_pos = pos + len;
+    else names[pos] = 0;
+}
+
+/***********************************************************************
+ *           add_relay_log_record
+ *
+ * Append a call or return record to the binary relay log.
+ */
+static void add_relay_log_record( const struct relay_private_data *data, WORD ordinal, BYTE type,
+                                  BYTE nb_args, const INT_PTR *args, ULONG_PTR ret_addr )
+{
+    LONG index = interlocked_xchg_add( &relay_log->next_record, 1 );
+    struct relay_log_record *record = &relay_log_records[index & (RELAY_LOG_RECORDS - 1)];
+    LARGE_INTEGER counter;
+    unsigned int i;
+
+    NtQueryPerformanceCounter( &counter, NULL );
+    record->type     = 0;  /* the record is incomplete until the type is set */
+    record->time     = counter.QuadPart;
+    record->tid      = GetCurrentThreadId();
+    record->module   = data->log_module;
+    record->ordinal  = data->base + ordinal;
+    record->nb_args  = nb_args;
+    record->ret_addr = ret_addr;
+    for (i = 0; i < sizeof(record->args) / sizeof(record->args[0]); i++)
+        record->args[i] = i < nb_args ? (ULONG_PTR)args[i] : 0;
+    record->type     = type;
+}
+
 /* compare an ASCII and a Unicode string without depending on the current codepage */
 static inline int strcmpAW( const char *strA, const WCHAR *strW )
 {
@@ -190,6 +322,8 @@ static DWORD WINAPI init_debug_lists( RTL_RUN_ONCE *once, void *param, void **co
     static const WCHAR SnoopFromIncludeW[] = {'S','n','o','o','p','F','r','o','m','I','n','c','l','u','d','e',0};
     static const WCHAR SnoopFromExcludeW[] = {'S','n','o','o','p','F','r','o','m','E','x','c','l','u','d','e',0};
 
+    init_relay_log();
+
     RtlOpenCurrentUser( KEY_ALL_ACCESS, &root );
     attr.Length = sizeof(attr);
     attr.RootDirectory = root;
@@ -337,7 +471,9 @@ void * WINAPI relay_trace_entry( struct relay_descr *descr, unsigned int idx, co
     struct relay_private_data *data = descr->private;
     struct relay_entry_point *entry_point = data->entry_points + ordinal;
 
-    if (TRACE_ON(relay))
+    if (TRACE_ON(relay) && relay_log)
+        add_relay_log_record( data, ordinal, RELAY_LOG_CALL, nb_args, stack + 1, stack[0] );
+    else if (TRACE_ON(relay))
     {
         if (TRACE_ON(timestamp)) print_timestamp();
 
@@ -367,6 +503,20 @@ void WINAPI relay_trace_exit( struct relay_descr *descr, unsigned int idx,
 
     if (!TRACE_ON(relay)) return;
 
+    if (relay_log)
+    {
+        INT_PTR ret = retval;
+
+        /* 64-bit return values are logged as two arguments */
+        if (flags & 1)
+        {
+            INT_PTR ret64[2] = { (UINT)retval, (UINT)(retval >> 32) };
+            add_relay_log_record( data, ordinal, RELAY_LOG_RET, 2, ret64, stack[0] );
+        }
+        else add_relay_log_record( data, ordinal, RELAY_LOG_RET, 1, &ret, stack[0] );
+        return;
+    }
+
     if (TRACE_ON(timestamp)) print_timestamp();
 
     if (TRACE_ON(pid))
@@ -497,7 +647,9 @@ void WINAPI __regs_relay_call_regs( struct relay_descr *descr, unsigned int idx,
     context->Eip = ret_addr;
     context->Esp += nb_args * sizeof(int);
 
-    if (TRACE_ON(relay))
+    if (TRACE_ON(relay) && relay_log)
+        add_relay_log_record( data, ordinal, RELAY_LOG_CALL, nb_args, args, ret_addr );
+    else if (TRACE_ON(relay))
     {
         if (entry_point->name)
             DPRINTF( "%04x:Call %s.%s(", GetCurrentThreadId(), data->dllname, entry_point->name );
@@ -524,7 +676,12 @@ void WINAPI __regs_relay_call_regs( struct relay_descr *descr, unsigned int idx,
 
     call_entry_point( orig_func + 12 + *(int *)(orig_func + 1), nb_args, args_copy, 0 );
 
-    if (TRACE_ON(relay))
+    if (TRACE_ON(relay) && relay_log)
+    {
+        INT_PTR ret = context->Eax;
+        add_relay_log_record( data, ordinal, RELAY_LOG_RET, 1, &ret, context->Eip );
+    }
+    else if (TRACE_ON(relay))
     {
         if (entry_point->name)
             DPRINTF( "%04x:Ret  %s.%s() retval=%08x ret=%08x\n",
@@ -727,6 +884,12 @@ void RELAY_SetupDLL( HMODULE module )
     memcpy( data->dllname, (char *)module + exports->Name, len );
     data->dllname[len] = 0;
 
+    if (relay_log)
+    {
+        data->log_module = relay_log_modules++;
+        add_relay_log_name( "M %u %s\n", data->log_module, data->dllname );
+    }
+
     /* fetch name pointer for all entry points and store them in the private structure */
 
     ordptr = (const WORD *)((char *)module + exports->AddressOfNameOrdinals);
@@ -748,6 +911,10 @@ void RELAY_SetupDLL( HMODULE module )
 
         data->entry_points[i].orig_func = (char *)module + *funcs;
         *funcs = entry_point_rva + descr->entry_point_offsets[i];
+
+        if (relay_log && data->entry_points[i].name)
+            add_relay_log_name( "F %u %u %s\n", data->log_module, i + exports->Base,
+                                data->entry_points[i].name );
     }
 }
 
@@ -28,12 +28,16 @@
 #endif
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #ifdef HAVE_LWP_H
 #include <lwp.h>
 #endif
 #ifdef HAVE_PTHREAD_NP_H
 # include <pthread_np.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -118,6 +122,11 @@ timeout_t server_start_time = 0;  /* time of server startup */
 sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 static pid_t server_pid;
+static BOOL shared_requests_disabled;
+#if defined(__linux__) && defined(__NR_futex)
+static shared_requests_t *shared_requests;  /* shared memory request ring */
+static int shared_requests_doorbell = -1;   /* pipe to wake up the server */
+#endif
 
 static RTL_CRITICAL_SECTION fd_cache_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -277,6 +286,113 @@ static inline unsigned int wait_reply( struct __server_request_info *req )
 }
 
 
+#if defined(__linux__) && defined(__NR_futex)
+
+#define SHARED_REQUEST_SPIN_COUNT 1000
+
+/***********************************************************************
+ *           use_shared_request
+ *
+ * Check if a request can be sent through the shared memory ring.
+ */
+static inline BOOL use_shared_request( const struct __server_request_info *req )
+{
+    if (!ntdll_get_thread_data()->request_slot) return FALSE;
+    if (req->u.req.request_header.request_size || req->u.req.request_header.reply_size) return FALSE;
+
+    switch (req->u.req.request_header.req)
+    {
+    case REQ_get_handle_fd:
+    case REQ_get_shared_sync:
+    case REQ_get_shared_requests:
+        return FALSE;  /* the server may send us an fd, keep it in order with the pipe replies */
+    default:
+        return TRUE;
+    }
+}
+
+
+/***********************************************************************
+ *           call_shared_request
+ *
+ * Queue a request in the shared memory ring and wait for the reply.
+ */
+static unsigned int call_shared_request( struct __server_request_info *req )
+{
+    unsigned int slot = ntdll_get_thread_data()->request_slot;
+    shared_request_t *request = &shared_requests->requests[slot];
+    struct timespec timeout;
+    struct pollfd pfd;
+    unsigned int pos, prev;
+    int i, state;
+
+    memcpy( (void *)&request->data, &req->u.req, sizeof(req->u.req) );
+    request->waiting = 0;
+    interlocked_xchg( (int *)&request->state, SHARED_REQUEST_PENDING );
+
+    /* queuing the entry is a single atomic operation, so that a thread killed */
+    /* in the middle can't leave a hole in the ring */
+    for (;;)
+    {
+        pos = shared_requests->tail;
+        prev = interlocked_cmpxchg( (int *)&shared_requests->ring[pos % SHARED_REQUEST_SLOTS],
+                                    SHARED_REQUEST_ENTRY( pos, slot ), SHARED_REQUEST_ENTRY( pos, 0 ) );
+        if (prev == SHARED_REQUEST_ENTRY( pos, 0 )) break;
+        /* the entry is already used, move the tail past it in case its owner didn't */
+        interlocked_cmpxchg( (int *)&shared_requests->tail, pos + 1, pos );
+    }
+    interlocked_cmpxchg( (int *)&shared_requests->tail, pos + 1, pos );
+    if (interlocked_xchg( (int *)&shared_requests->server_idle, 0 ))
+    {
+        char dummy = 0;
+        /* if the pipe is full the server will wake up anyway */
+        while (write( shared_requests_doorbell, &dummy, 1 ) == -1 && errno == EINTR) /* nothing */;
+    }
+
+    for (i = 0; i < SHARED_REQUEST_SPIN_COUNT; i++)
+        if (request->state != SHARED_REQUEST_PENDING) break;
+
+    if (request->state == SHARED_REQUEST_PENDING)
+    {
+        interlocked_xchg( (int *)&request->waiting, 1 );
+        while (request->state == SHARED_REQUEST_PENDING)
+        {
+            timeout.tv_sec  = 1;
+            timeout.tv_nsec = 0;
+            if (syscall( __NR_futex, &request->state, 0 /* FUTEX_WAIT */, SHARED_REQUEST_PENDING,
+                         &timeout, 0, 0 ) != -1 || errno != ETIMEDOUT) continue;
+
+            /* make sure the server didn't kill us in the meantime */
+            pfd.fd     = ntdll_get_thread_data()->reply_fd;
+            pfd.events = POLLIN;
+            if (poll( &pfd, 1, 0 ) == 1 && (pfd.revents & (POLLHUP | POLLERR))) abort_thread(0);
+        }
+    }
+
+    state = request->state;
+    if (state == SHARED_REQUEST_DONE)
+        memcpy( &req->u.reply, (void *)&request->data, sizeof(req->u.reply) );
+    request->state = SHARED_REQUEST_IDLE;
+    if (state != SHARED_REQUEST_DONE) abort_thread(0);  /* thread got killed */
+    return req->u.reply.reply_header.error;
+}
+
+
+#else  /* defined(__linux__) && defined(__NR_futex) */
+
+static inline BOOL use_shared_request( const struct __server_request_info *req )
+{
+    return FALSE;
+}
+
+static unsigned int call_shared_request( struct __server_request_info *req )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif  /* defined(__linux__) && defined(__NR_futex) */
+
+
 /***********************************************************************
  *           wine_server_call (NTDLL.@)
  *
@@ -306,8 +422,12 @@ unsigned int wine_server_call( void *req_ptr )
     unsigned int ret;
 
     pthread_sigmask( SIG_BLOCK, &server_block_set, &old_set );
-    ret = send_request( req );
-    if (!ret) ret = wait_reply( req );
+    if (use_shared_request( req )) ret = call_shared_request( req );
+    else
+    {
+        ret = send_request( req );
+        if (!ret) ret = wait_reply( req );
+    }
     pthread_sigmask( SIG_SETMASK, &old_set, NULL );
     return ret;
 }
@@ -971,6 +1091,172 @@ done:
 }
 
 
+/***********************************************************************/
+/* shared synchronization state support */
+
+#define SHARED_SYNC_ACCESS_WAIT    0x01  /* handle has SYNCHRONIZE access */
+#define SHARED_SYNC_ACCESS_MODIFY  0x02  /* handle has EVENT/SEMAPHORE_MODIFY_STATE access */
+
+#include "pshpack1.h"
+union shared_sync_cache_entry
+{
+    LONG64 data;
+    struct
+    {
+        unsigned int   index;   /* index of the object state, 0 if the object has none */
+        unsigned char  type;    /* enum shared_sync_type */
+        unsigned char  cached;  /* set once the entry has been retrieved from the server */
+        unsigned short access;  /* SHARED_SYNC_ACCESS_* flags */
+    } s;
+};
+#include "poppack.h"
+
+C_ASSERT( sizeof(union shared_sync_cache_entry) == sizeof(LONG64) );
+
+static union shared_sync_cache_entry *shared_sync_cache[FD_CACHE_ENTRIES];
+static shared_sync_t *shared_sync_base;  /* mapping of the sync area of the process */
+static unsigned int shared_sync_slots;   /* number of states in the sync area */
+static BOOL shared_sync_disabled;        /* set once the server told us it's not enabled */
+
+
+/***********************************************************************
+ *           map_shared_sync
+ *
+ * Caller must hold fd_cache_section.
+ */
+static BOOL map_shared_sync( int fd )
+{
+    struct stat st;
+    void *ptr;
+
+    if (fstat( fd, &st ) == -1) return FALSE;
+    ptr = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if (ptr == MAP_FAILED) return FALSE;
+    shared_sync_slots = st.st_size / sizeof(shared_sync_t);
+    shared_sync_base = ptr;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           add_shared_sync_to_cache
+ *
+ * Caller must hold fd_cache_section.
+ */
+static void add_shared_sync_to_cache( HANDLE handle, unsigned int index,
+                                      enum shared_sync_type type, unsigned int access )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    union shared_sync_cache_entry cache;
+
+    if (!shared_sync_cache[entry])  /* do we need to allocate a new block of entries? */
+    {
+        void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union shared_sync_cache_entry),
+                                    PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return;
+        shared_sync_cache[entry] = ptr;
+    }
+
+    cache.s.index  = index;
+    cache.s.type   = type;
+    cache.s.cached = 1;
+    cache.s.access = 0;
+    if (access & SYNCHRONIZE) cache.s.access |= SHARED_SYNC_ACCESS_WAIT;
+    if (access & EVENT_MODIFY_STATE) cache.s.access |= SHARED_SYNC_ACCESS_MODIFY;
+    interlocked_xchg64( &shared_sync_cache[entry][idx].data, cache.data );
+}
+
+
+/***********************************************************************
+ *           get_cached_shared_sync
+ */
+static inline union shared_sync_cache_entry get_cached_shared_sync( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    union shared_sync_cache_entry cache;
+
+    cache.data = 0;
+    if (shared_sync_cache[entry])
+        cache.data = interlocked_cmpxchg64( &shared_sync_cache[entry][idx].data, 0, 0 );
+    return cache;
+}
+
+
+/***********************************************************************
+ *           server_remove_shared_sync_from_cache
+ */
+void server_remove_shared_sync_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry < FD_CACHE_ENTRIES && shared_sync_cache[entry])
+        interlocked_xchg64( &shared_sync_cache[entry][idx].data, 0 );
+}
+
+
+/***********************************************************************
+ *           server_get_shared_sync
+ *
+ * Return the shared memory state of an event, semaphore or mutex, or NULL
+ * if the object state can only be accessed through the server.
+ * Access is a combination of SYNCHRONIZE and EVENT_MODIFY_STATE.
+ */
+shared_sync_t *server_get_shared_sync( HANDLE handle, enum shared_sync_type *type, unsigned int *access )
+{
+    union shared_sync_cache_entry cache;
+    unsigned int entry;
+    obj_handle_t fd_handle;
+    sigset_t sigset;
+    int fd;
+
+    if (shared_sync_disabled) return NULL;
+    handle_to_index( handle, &entry );
+    if (entry >= FD_CACHE_ENTRIES) return NULL;  /* pseudo-handle or too many handles */
+
+    cache = get_cached_shared_sync( handle );
+    if (!cache.s.cached)
+    {
+        server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+        cache = get_cached_shared_sync( handle );
+        if (!cache.s.cached)
+        {
+            SERVER_START_REQ( get_shared_sync )
+            {
+                req->handle  = wine_server_obj_handle( handle );
+                req->need_fd = !shared_sync_base;
+                if (!wine_server_call( req ))
+                {
+                    if (!reply->enabled) shared_sync_disabled = TRUE;
+                    else if (reply->index && !shared_sync_base)
+                    {
+                        if ((fd = receive_fd( &fd_handle )) != -1)
+                        {
+                            if (!map_shared_sync( fd )) shared_sync_disabled = TRUE;
+                            close( fd );
+                        }
+                        else shared_sync_disabled = TRUE;
+                    }
+                    if (!shared_sync_disabled)
+                    {
+                        add_shared_sync_to_cache( handle, reply->index, reply->type, reply->access );
+                        cache = get_cached_shared_sync( handle );
+                    }
+                }
+            }
+            SERVER_END_REQ;
+        }
+        server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+    }
+
+    if (!cache.s.index || cache.s.index >= shared_sync_slots) return NULL;
+    *type = cache.s.type;
+    *access = 0;
+    if (cache.s.access & SHARED_SYNC_ACCESS_WAIT) *access |= SYNCHRONIZE;
+    if (cache.s.access & SHARED_SYNC_ACCESS_MODIFY) *access |= EVENT_MODIFY_STATE;
+    return &shared_sync_base[cache.s.index];
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle   (NTDLL.@)
  *
@@ -1454,6 +1740,64 @@ NTSTATUS server_init_process_done(void)
 }
 
 
+/***********************************************************************
+ *           init_shared_requests
+ *
+ * Retrieve the shared memory request ring of the process from the server,
+ * and the request slot of the current thread.
+ */
+static void init_shared_requests(void)
+{
+#if defined(__linux__) && defined(__NR_futex)
+    obj_handle_t handle;
+    unsigned int slot = 0;
+    sigset_t sigset;
+    void *ptr;
+    int ret, enabled = 0, fd, doorbell;
+
+    if (shared_requests_disabled) return;
+
+    /* only the first thread retrieves the fds */
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+
+    SERVER_START_REQ( get_shared_requests )
+    {
+        req->need_fd = !shared_requests;
+        if (!(ret = wine_server_call( req )))
+        {
+            enabled = reply->enabled;
+            slot    = reply->slot;
+        }
+    }
+    SERVER_END_REQ;
+
+    if (ret || !enabled) shared_requests_disabled = TRUE;
+    else if (!shared_requests)
+    {
+        fd = receive_fd( &handle );
+        doorbell = receive_fd( &handle );
+        if (fd == -1 || doorbell == -1) server_protocol_error( "no fd for shared requests\n" );
+
+        ptr = mmap( NULL, sizeof(*shared_requests), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+        if (ptr != MAP_FAILED)
+        {
+            shared_requests_doorbell = doorbell;
+            shared_requests = ptr;
+        }
+        else
+        {
+            close( doorbell );
+            shared_requests_disabled = TRUE;
+        }
+    }
+    if (shared_requests) ntdll_get_thread_data()->request_slot = slot;
+
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+#endif
+}
+
+
 /***********************************************************************
  *           server_init_thread
  *
@@ -1509,6 +1853,7 @@ size_t server_init_thread( void *entry_point )
     switch (ret)
     {
     case STATUS_SUCCESS:
+        init_shared_requests();
         if (arch)
         {
             if (!strcmp( arch, "win32" ) && (is_win64 || is_wow64))
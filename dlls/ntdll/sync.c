@@ -47,6 +47,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <limits.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -72,6 +76,109 @@ static inline int interlocked_dec_if_nonzero( int *dest )
     return val;
 }
 
+/* shared memory state of events, semaphores and mutexes */
+
+/* mutex owner and recursion count, modified together */
+union mutex_state
+{
+    struct
+    {
+        unsigned int owner;
+        unsigned int count;
+    } s;
+    LONG64 value;
+};
+
+static inline thread_id_t current_thread_id(void)
+{
+    return HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+}
+
+/* get the shared state of an object of one of the given types, with the given access */
+static shared_sync_t *get_shared_sync( HANDLE handle, enum shared_sync_type type1,
+                                       enum shared_sync_type type2, unsigned int access )
+{
+    enum shared_sync_type type;
+    unsigned int granted;
+    shared_sync_t *sync;
+
+    if (!(sync = server_get_shared_sync( handle, &type, &granted ))) return NULL;
+    if (type != type1 && type != type2) return NULL;
+    if ((granted & access) != access) return NULL;
+    return sync;
+}
+
+/* atomically replace the bits of the state selected by mask, unless the server has waiters */
+/* returns FALSE if the operation has to be done by the server */
+static BOOL update_shared_sync( shared_sync_t *sync, unsigned int mask, unsigned int value )
+{
+    unsigned int state, prev;
+
+    for (state = sync->state; !(state & SHARED_SYNC_SERVER_WAIT); state = prev)
+    {
+        prev = interlocked_cmpxchg( (int *)&sync->state, (state & ~mask) | (value & mask), state );
+        if (prev == state) return TRUE;
+    }
+    return FALSE;
+}
+
+/* atomically replace the owner and recursion count of a mutex, unless the server has waiters */
+static BOOL update_mutex_state( shared_sync_t *sync, union mutex_state *old, unsigned int owner,
+                                unsigned int count )
+{
+    union mutex_state new;
+
+    new.s.owner = owner;
+    new.s.count = count;
+    return interlocked_cmpxchg64( (LONG64 *)sync, new.value, old->value ) == old->value;
+}
+
+/* try to acquire a shared object without blocking */
+/* returns the wait status, STATUS_TIMEOUT if not signaled, or STATUS_PENDING to ask the server */
+static NTSTATUS try_acquire_shared_sync( shared_sync_t *sync, enum shared_sync_type type )
+{
+    union mutex_state mutex;
+    unsigned int state, prev, tid;
+
+    for (;;)
+    {
+        state = sync->state;
+        switch (type)
+        {
+        case SHARED_SYNC_MANUAL_EVENT:
+            return (state & 1) ? STATUS_WAIT_0 : STATUS_TIMEOUT;
+        case SHARED_SYNC_AUTO_EVENT:
+            if (state & SHARED_SYNC_SERVER_WAIT) return STATUS_PENDING;
+            if (!state) return STATUS_TIMEOUT;
+            prev = interlocked_cmpxchg( (int *)&sync->state, 0, state );
+            if (prev == state) return STATUS_WAIT_0;
+            break;
+        case SHARED_SYNC_SEMAPHORE:
+            if (state & SHARED_SYNC_SERVER_WAIT) return STATUS_PENDING;
+            if (!state) return STATUS_TIMEOUT;
+            prev = interlocked_cmpxchg( (int *)&sync->state, state - 1, state );
+            if (prev == state) return STATUS_WAIT_0;
+            break;
+        case SHARED_SYNC_MUTEX:
+            if (state & SHARED_SYNC_SERVER_WAIT) return STATUS_PENDING;
+            mutex.s.owner = state;
+            mutex.s.count = sync->count;
+            tid = current_thread_id();
+            if (state == tid)
+            {
+                if (mutex.s.count >= MAXLONG) return STATUS_PENDING;
+                if (update_mutex_state( sync, &mutex, tid, mutex.s.count + 1 )) return STATUS_WAIT_0;
+                break;
+            }
+            if (state && state != SHARED_SYNC_MUTEX_ABANDONED) return STATUS_TIMEOUT;
+            if (!update_mutex_state( sync, &mutex, tid, 1 )) break;
+            return state == SHARED_SYNC_MUTEX_ABANDONED ? STATUS_ABANDONED_WAIT_0 : STATUS_WAIT_0;
+        default:
+            return STATUS_PENDING;
+        }
+    }
+}
+
 /* creates a struct security_descriptor and contained information in one contiguous piece of memory */
 NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                   data_size_t *ret_len )
@@ -265,7 +372,25 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
  */
 NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous )
 {
+    shared_sync_t *sync;
     NTSTATUS ret;
+
+    if ((sync = get_shared_sync( handle, SHARED_SYNC_SEMAPHORE, SHARED_SYNC_SEMAPHORE,
+                                 SEMAPHORE_MODIFY_STATE )))
+    {
+        unsigned int state, prev;
+
+        for (state = sync->state; !(state & SHARED_SYNC_SERVER_WAIT); state = prev)
+        {
+            if (state + count < state || state + count > sync->count)
+                return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+            prev = interlocked_cmpxchg( (int *)&sync->state, state + count, state );
+            if (prev != state) continue;
+            if (previous) *previous = state;
+            return STATUS_SUCCESS;
+        }
+    }
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -342,10 +467,16 @@ NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_AT
  */
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    shared_sync_t *sync;
     NTSTATUS ret;
 
     /* FIXME: set NumberOfThreadsReleased */
 
+    if ((sync = get_shared_sync( handle, SHARED_SYNC_AUTO_EVENT, SHARED_SYNC_MANUAL_EVENT,
+                                 EVENT_MODIFY_STATE )) &&
+        update_shared_sync( sync, 1, 1 ))
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -361,11 +492,17 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
  */
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    shared_sync_t *sync;
     NTSTATUS ret;
 
     /* resetting an event can't release any thread... */
     if (NumberOfThreadsReleased) *NumberOfThreadsReleased = 0;
 
+    if ((sync = get_shared_sync( handle, SHARED_SYNC_AUTO_EVENT, SHARED_SYNC_MANUAL_EVENT,
+                                 EVENT_MODIFY_STATE )) &&
+        update_shared_sync( sync, 1, 0 ))
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -509,6 +646,26 @@ NTSTATUS WINAPI NtOpenMutant( HANDLE *handle, ACCESS_MASK access, const OBJECT_A
 NTSTATUS WINAPI NtReleaseMutant( IN HANDLE handle, OUT PLONG prev_count OPTIONAL)
 {
     NTSTATUS    status;
+    shared_sync_t *sync;
+
+    if ((sync = get_shared_sync( handle, SHARED_SYNC_MUTEX, SHARED_SYNC_MUTEX, 0 )))
+    {
+        unsigned int tid = current_thread_id();
+        union mutex_state mutex;
+
+        for (;;)
+        {
+            mutex.s.owner = sync->state;
+            mutex.s.count = sync->count;
+            if ((mutex.s.owner & ~SHARED_SYNC_SERVER_WAIT) != tid) return STATUS_MUTANT_NOT_OWNED;
+            /* the server has to wake up the waiters */
+            if (mutex.s.owner & SHARED_SYNC_SERVER_WAIT) break;
+            if (!update_mutex_state( sync, &mutex, mutex.s.count > 1 ? tid : 0, mutex.s.count - 1 ))
+                continue;
+            if (prev_count) *prev_count = 1 - mutex.s.count;
+            return STATUS_SUCCESS;
+        }
+    }
 
     SERVER_START_REQ( release_mutex )
     {
@@ -992,6 +1149,29 @@ NTSTATUS WINAPI NtSetTimerResolution(IN ULONG resolution,
 
 /* wait operations */
 
+/* try to acquire one of the objects without blocking, if they all have a shared state */
+/* returns the wait status, STATUS_TIMEOUT if none is signaled, or STATUS_PENDING to ask the server */
+static NTSTATUS try_wait_shared_objects( DWORD count, const HANDLE *handles )
+{
+    shared_sync_t *syncs[MAXIMUM_WAIT_OBJECTS];
+    enum shared_sync_type types[MAXIMUM_WAIT_OBJECTS];
+    unsigned int i, access;
+    NTSTATUS ret;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(syncs[i] = server_get_shared_sync( handles[i], &types[i], &access ))) return STATUS_PENDING;
+        if (!(access & SYNCHRONIZE)) return STATUS_PENDING;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if ((ret = try_acquire_shared_sync( syncs[i], types[i] )) == STATUS_TIMEOUT) continue;
+        if (ret == STATUS_PENDING) return ret;
+        return ret + i;
+    }
+    return STATUS_TIMEOUT;
+}
+
 static NTSTATUS wait_objects( DWORD count, const HANDLE *handles,
                               BOOLEAN wait_any, BOOLEAN alertable,
                               const LARGE_INTEGER *timeout )
@@ -1001,6 +1181,14 @@ static NTSTATUS wait_objects( DWORD count, const HANDLE *handles,
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    /* try to grab one of the objects without a server round-trip */
+    if (wait_any && !alertable)
+    {
+        NTSTATUS ret = try_wait_shared_objects( count, handles );
+        if (ret != STATUS_PENDING && (ret != STATUS_TIMEOUT || (timeout && !timeout->QuadPart)))
+            return ret;
+    }
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_any ? SELECT_WAIT : SELECT_WAIT_ALL;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
@@ -1524,6 +1712,322 @@ DWORD WINAPI RtlRunOnceExecuteOnce( RTL_RUN_ONCE *once, PRTL_RUN_ONCE_INIT_FN fu
 }
 
 
+#if defined(__linux__) && defined(__NR_futex)
+
+/* On Linux, SRW locks and condition variables are implemented on top of
+ * futexes, so that contended waits don't need a server round-trip. The
+ * keyed event implementation below is used when futexes are not available.
+ *
+ * The memory layout used by the futex-based SRW lock is:
+ *
+ * 32 31            16 15 14             0
+ *  ________________ __ ______________
+ * | X| #exclusive  | S|   #shared    |
+ *  ¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯¯
+ * X is set while the lock is owned exclusively, #exclusive counts the
+ * threads waiting for exclusive access, S is set when shared access threads
+ * are waiting and #shared counts the shared owners. Exclusive waiters have
+ * priority over new shared owners. Both kinds of waiters sleep on the same
+ * futex, and are told apart with the futex bitset.
+ */
+
+#define SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT        0x80000000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK    0x7fff0000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC     0x00010000
+#define SRWLOCK_FUTEX_SHARED_WAITERS_BIT        0x00008000
+#define SRWLOCK_FUTEX_SHARED_OWNERS_MASK        0x00007fff
+#define SRWLOCK_FUTEX_SHARED_OWNERS_INC         0x00000001
+
+#define SRWLOCK_FUTEX_BITSET_EXCLUSIVE  1
+#define SRWLOCK_FUTEX_BITSET_SHARED     2
+
+static int wait_op = 128; /*FUTEX_WAIT|FUTEX_PRIVATE_FLAG*/
+static int wake_op = 129; /*FUTEX_WAKE|FUTEX_PRIVATE_FLAG*/
+static int wait_bitset_op = 137; /*FUTEX_WAIT_BITSET|FUTEX_PRIVATE_FLAG*/
+static int wake_bitset_op = 138; /*FUTEX_WAKE_BITSET|FUTEX_PRIVATE_FLAG*/
+
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, wait_op, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake( int *addr, int val )
+{
+    return syscall( __NR_futex, addr, wake_op, val, NULL, 0, 0 );
+}
+
+static inline int futex_wait_bitset( int *addr, int val, struct timespec *timeout, int mask )
+{
+    return syscall( __NR_futex, addr, wait_bitset_op, val, timeout, 0, mask );
+}
+
+static inline int futex_wake_bitset( int *addr, int val, int mask )
+{
+    return syscall( __NR_futex, addr, wake_bitset_op, val, NULL, 0, mask );
+}
+
+static inline int use_futexes(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        futex_wait_bitset( &supported, 10, NULL, ~0 );
+        if (errno == ENOSYS)
+        {
+            wait_op = 0; /*FUTEX_WAIT*/
+            wake_op = 1; /*FUTEX_WAKE*/
+            wait_bitset_op = 9; /*FUTEX_WAIT_BITSET*/
+            wake_bitset_op = 10; /*FUTEX_WAKE_BITSET*/
+            futex_wait_bitset( &supported, 10, NULL, ~0 );
+        }
+        supported = (errno != ENOSYS);
+    }
+    return supported;
+}
+
+static void timespec_from_timeout( struct timespec *timespec, const LARGE_INTEGER *timeout )
+{
+    LARGE_INTEGER now;
+    LONGLONG diff;
+
+    if (timeout->QuadPart > 0)
+    {
+        NtQuerySystemTime( &now );
+        diff = timeout->QuadPart - now.QuadPart;
+    }
+    else diff = -timeout->QuadPart;
+
+    if (diff < 0) diff = 0;
+    timespec->tv_sec  = diff / 10000000;
+    timespec->tv_nsec = (diff % 10000000) * 100;
+}
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int *futex = (int *)&lock->Ptr;
+    unsigned int old;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    old = *futex;
+    if (old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_SHARED_OWNERS_MASK)) return STATUS_TIMEOUT;
+    if (interlocked_cmpxchg( futex, old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT, old ) != old)
+        return STATUS_TIMEOUT;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int *futex = (int *)&lock->Ptr;
+    unsigned int old, new;
+    BOOL wait;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    /* register as an exclusive waiter, so that no new shared owners get in */
+    do
+    {
+        old = *futex;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK) == SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)
+            return STATUS_RESOURCE_NOT_OWNED;
+        new = old + SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC;
+    } while (interlocked_cmpxchg( futex, new, old ) != old);
+
+    for (;;)
+    {
+        do
+        {
+            old = *futex;
+            if (!(old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_SHARED_OWNERS_MASK)))
+            {
+                new = (old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) - SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC;
+                wait = FALSE;
+            }
+            else
+            {
+                new = old;
+                wait = TRUE;
+            }
+        } while (interlocked_cmpxchg( futex, new, old ) != old);
+
+        if (!wait) return STATUS_SUCCESS;
+        futex_wait_bitset( futex, new, NULL, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    }
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int *futex = (int *)&lock->Ptr;
+    unsigned int old;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *futex;
+        if (old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+            return STATUS_TIMEOUT;
+        if ((old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) == SRWLOCK_FUTEX_SHARED_OWNERS_MASK)
+            return STATUS_RESOURCE_NOT_OWNED;
+    } while (interlocked_cmpxchg( futex, old + SRWLOCK_FUTEX_SHARED_OWNERS_INC, old ) != old);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int *futex = (int *)&lock->Ptr;
+    unsigned int old, new;
+    BOOL wait;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    for (;;)
+    {
+        do
+        {
+            old = *futex;
+            if (!(old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)))
+            {
+                if ((old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) == SRWLOCK_FUTEX_SHARED_OWNERS_MASK)
+                    return STATUS_RESOURCE_NOT_OWNED;
+                new = old + SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+                wait = FALSE;
+            }
+            else
+            {
+                new = old | SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+                wait = TRUE;
+            }
+        } while (interlocked_cmpxchg( futex, new, old ) != old);
+
+        if (!wait) return STATUS_SUCCESS;
+        futex_wait_bitset( futex, new, NULL, SRWLOCK_FUTEX_BITSET_SHARED );
+    }
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int *futex = (int *)&lock->Ptr;
+    unsigned int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *futex;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT)) return STATUS_RESOURCE_NOT_OWNED;
+        new = old & ~SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT;
+        if (!(new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)) new &= ~SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+    } while (interlocked_cmpxchg( futex, new, old ) != old);
+
+    /* exclusive waiters are processed first, followed by the shared waiters */
+    if (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)
+        futex_wake_bitset( futex, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    else if (old & SRWLOCK_FUTEX_SHARED_WAITERS_BIT)
+        futex_wake_bitset( futex, INT_MAX, SRWLOCK_FUTEX_BITSET_SHARED );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    int *futex = (int *)&lock->Ptr;
+    unsigned int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *futex;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || !(old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+            return STATUS_RESOURCE_NOT_OWNED;
+        new = old - SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+    } while (interlocked_cmpxchg( futex, new, old ) != old);
+
+    /* wake up one exclusive thread as soon as the last shared owner has left */
+    if (!(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) && (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        futex_wake_bitset( futex, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    return STATUS_SUCCESS;
+}
+
+/* with futexes, the condition variable is a sequence number incremented on each wake */
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    struct timespec timespec;
+    int ret;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    if (timeout)
+    {
+        timespec_from_timeout( &timespec, timeout );
+        ret = futex_wait( (int *)&variable->Ptr, val, &timespec );
+    }
+    else ret = futex_wait( (int *)&variable->Ptr, val, NULL );
+
+    if (ret == -1 && errno == ETIMEDOUT) return STATUS_TIMEOUT;
+    return STATUS_WAIT_0;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    interlocked_xchg_add( (int *)&variable->Ptr, 1 );
+    futex_wake( (int *)&variable->Ptr, count );
+    return STATUS_SUCCESS;
+}
+
+#else  /* defined(__linux__) && defined(__NR_futex) */
+
+static inline int use_futexes(void)
+{
+    return 0;
+}
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif  /* defined(__linux__) && defined(__NR_futex) */
+
+
 /* SRW locks implementation
  *
  * The memory layout used by the lock is:
@@ -1653,7 +2157,8 @@ static inline void srwlock_leave_shared( RTL_SRWLOCK *lock, unsigned int val )
  *  It doesn't make any difference which thread for example unlocks an
  *  SRWLock (see corresponding tests). This implementation uses two
  *  keyed events (one for the exclusive waiters and one for the shared
- *  waiters) and is limited to 2^15-1 waiting threads.
+ *  waiters) and is limited to 2^15-1 waiting threads. On Linux a futex
+ *  is used instead, which is limited to 2^15-1 shared owners.
  */
 void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
 {
@@ -1670,6 +2175,14 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    NTSTATUS status;
+
+    if ((status = fast_acquire_srw_exclusive( lock )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (status) RtlRaiseStatus( status );
+        return;
+    }
+
     if (srwlock_lock_exclusive( (unsigned int *)&lock->Ptr, SRWLOCK_RES_EXCLUSIVE ))
         NtWaitForKeyedEvent( keyed_event, srwlock_key_exclusive(lock), FALSE, NULL );
 }
@@ -1684,6 +2197,14 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+    NTSTATUS status;
+
+    if ((status = fast_acquire_srw_shared( lock )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (status) RtlRaiseStatus( status );
+        return;
+    }
+
     /* Acquires a shared lock. If it's currently not possible to add elements to
      * the shared queue, then request exclusive access instead. */
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
@@ -1714,6 +2235,14 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    NTSTATUS status;
+
+    if ((status = fast_release_srw_exclusive( lock )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (status) RtlRaiseStatus( status );
+        return;
+    }
+
     srwlock_leave_exclusive( lock, srwlock_unlock_exclusive( (unsigned int *)&lock->Ptr,
                              - SRWLOCK_RES_EXCLUSIVE ) - SRWLOCK_RES_EXCLUSIVE );
 }
@@ -1723,6 +2252,14 @@ void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
 {
+    NTSTATUS status;
+
+    if ((status = fast_release_srw_shared( lock )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (status) RtlRaiseStatus( status );
+        return;
+    }
+
     srwlock_leave_shared( lock, srwlock_lock_exclusive( (unsigned int *)&lock->Ptr,
                           - SRWLOCK_RES_SHARED ) - SRWLOCK_RES_SHARED );
 }
@@ -1736,6 +2273,11 @@ void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
  */
 BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    NTSTATUS status;
+
+    if ((status = fast_try_acquire_srw_exclusive( lock )) != STATUS_NOT_IMPLEMENTED)
+        return status == STATUS_SUCCESS;
+
     return interlocked_cmpxchg( (int *)&lock->Ptr, SRWLOCK_MASK_IN_EXCLUSIVE |
                                 SRWLOCK_RES_EXCLUSIVE, 0 ) == 0;
 }
@@ -1746,6 +2288,14 @@ BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 BOOLEAN WINAPI RtlTryAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+    NTSTATUS status;
+
+    if ((status = fast_try_acquire_srw_shared( lock )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (status == STATUS_RESOURCE_NOT_OWNED) RtlRaiseStatus( status );
+        return status == STATUS_SUCCESS;
+    }
+
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
     {
         if (val & SRWLOCK_MASK_EXCLUSIVE_QUEUE)
@@ -1789,7 +2339,8 @@ void WINAPI RtlInitializeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
-    if (interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
+    if (fast_wake_cv( variable, 1 ) == STATUS_NOT_IMPLEMENTED &&
+        interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
 
@@ -1800,7 +2351,11 @@ void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeAllConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
-    int val = interlocked_xchg( (int *)&variable->Ptr, 0 );
+    int val;
+
+    if (fast_wake_cv( variable, INT_MAX ) != STATUS_NOT_IMPLEMENTED) return;
+
+    val = interlocked_xchg( (int *)&variable->Ptr, 0 );
     while (val-- > 0)
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1824,14 +2379,19 @@ NTSTATUS WINAPI RtlSleepConditionVariableCS( RTL_CONDITION_VARIABLE *variable, R
                                              const LARGE_INTEGER *timeout )
 {
     NTSTATUS status;
-    interlocked_xchg_add( (int *)&variable->Ptr, 1 );
+    int val = *(int *)&variable->Ptr;
+
+    if (!use_futexes()) interlocked_xchg_add( (int *)&variable->Ptr, 1 );
     RtlLeaveCriticalSection( crit );
 
-    status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, timeout );
-    if (status != STATUS_SUCCESS)
+    if ((status = fast_wait_cv( variable, val, timeout )) == STATUS_NOT_IMPLEMENTED)
     {
-        if (!interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
-            status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
+        status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, timeout );
+        if (status != STATUS_SUCCESS)
+        {
+            if (!interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
+                status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
+        }
     }
 
     RtlEnterCriticalSection( crit );
@@ -1861,18 +2421,23 @@ NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable,
                                               const LARGE_INTEGER *timeout, ULONG flags )
 {
     NTSTATUS status;
-    interlocked_xchg_add( (int *)&variable->Ptr, 1 );
+    int val = *(int *)&variable->Ptr;
+
+    if (!use_futexes()) interlocked_xchg_add( (int *)&variable->Ptr, 1 );
 
     if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
         RtlReleaseSRWLockShared( lock );
     else
         RtlReleaseSRWLockExclusive( lock );
 
-    status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, timeout );
-    if (status != STATUS_SUCCESS)
+    if ((status = fast_wait_cv( variable, val, timeout )) == STATUS_NOT_IMPLEMENTED)
     {
-        if (!interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
-            status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
+        status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, timeout );
+        if (status != STATUS_SUCCESS)
+        {
+            if (!interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
+                status = NtWaitForKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
+        }
     }
 
     if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
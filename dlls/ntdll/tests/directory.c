@@ -823,6 +823,223 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+#define LARGE_DIR_COUNT 9000  /* more than a single read batch */
+
+static unsigned int large_dir_seen[LARGE_DIR_COUNT];
+
+/* every fourth file has a long name, which needs a short name */
+static void get_large_dir_name( char *name, unsigned int index )
+{
+    if (index % 4) sprintf( name, "f%05u.dat", index );
+    else sprintf( name, "long name %05u.text", index );
+}
+
+static void check_large_dir_entry( const char *testdir, FILE_BOTH_DIRECTORY_INFORMATION *info,
+                                   unsigned int *count, unsigned int *short_names )
+{
+    char name[MAX_PATH], expect[MAX_PATH], path[MAX_PATH];
+    unsigned int index = LARGE_DIR_COUNT, len, i;
+
+    len = WideCharToMultiByte( CP_ACP, 0, info->FileName, info->FileNameLength / sizeof(WCHAR),
+                               name, sizeof(name) - 1, NULL, NULL );
+    name[len] = 0;
+    if (!strcmp( name, "." ) || !strcmp( name, ".." )) return;
+
+    if (name[0] == 'f') sscanf( name, "f%u", &index );
+    else sscanf( name, "long name %u", &index );
+    if (index < LARGE_DIR_COUNT) get_large_dir_name( expect, index );
+    if (index >= LARGE_DIR_COUNT || strcmp( name, expect ))
+    {
+        ok( 0, "unexpected file %s\n", name );
+        return;
+    }
+    large_dir_seen[index]++;
+    (*count)++;
+
+    if (index % 4 || !info->ShortNameLength) return;
+    (*short_names)++;
+
+    /* the short name must be a valid 8.3 name that refers to the same file */
+    len = info->ShortNameLength / sizeof(WCHAR);
+    ok( len <= 12, "file %s: short name too long %s\n", name, wine_dbgstr_wn( info->ShortName, len ));
+    for (i = 0; i < len; i++)
+        ok( info->ShortName[i] > ' ', "file %s: invalid short name %s\n", name, wine_dbgstr_wn( info->ShortName, len ));
+    sprintf( path, "%s\\", testdir );
+    WideCharToMultiByte( CP_ACP, 0, info->ShortName, len, path + strlen(path), 13, NULL, NULL );
+    path[strlen( testdir ) + 1 + len] = 0;
+    len = GetLongPathNameA( path, expect, sizeof(expect) );
+    ok( len && !strcmp( strrchr( expect, '\\' ) + 1, name ), "file %s: short name %s refers to %s\n",
+        name, path, len ? expect : "nothing" );
+}
+
+/* enumerate the directory, restarting the scan once after "restart_after" files if not zero */
+static void enum_large_directory( HANDLE handle, const char *testdir, UNICODE_STRING *mask,
+                                  unsigned int restart_after )
+{
+    FILE_BOTH_DIRECTORY_INFORMATION *info;
+    unsigned int i, count = 0, short_names = 0;
+    BOOLEAN restart = TRUE;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    BYTE data[4096];
+
+    memset( large_dir_seen, 0, sizeof(large_dir_seen) );
+    for (;;)
+    {
+        status = pNtQueryDirectoryFile( handle, 0, NULL, NULL, &io, data, sizeof(data),
+                                        FileBothDirectoryInformation, FALSE, mask, restart );
+        if (status == STATUS_NO_MORE_FILES) break;
+        ok( status == STATUS_SUCCESS, "failed to query directory; status %x\n", status );
+        if (status) break;
+        restart = FALSE;
+
+        for (info = (FILE_BOTH_DIRECTORY_INFORMATION *)data; ;
+             info = (FILE_BOTH_DIRECTORY_INFORMATION *)((BYTE *)info + info->NextEntryOffset))
+        {
+            check_large_dir_entry( testdir, info, &count, &short_names );
+            if (!info->NextEntryOffset) break;
+        }
+
+        if (restart_after && count >= restart_after)
+        {
+            memset( large_dir_seen, 0, sizeof(large_dir_seen) );
+            count = short_names = 0;
+            restart_after = 0;
+            restart = TRUE;
+        }
+    }
+
+    for (i = 0; i < LARGE_DIR_COUNT; i++)
+    {
+        unsigned int expect = (mask && i % 4) ? 0 : 1;
+        if (large_dir_seen[i] != expect) break;
+    }
+    ok( i == LARGE_DIR_COUNT, "file %u returned %u times\n", i, i < LARGE_DIR_COUNT ? large_dir_seen[i] : 0 );
+    ok( count == (mask ? LARGE_DIR_COUNT / 4 : LARGE_DIR_COUNT), "got %u files\n", count );
+    if (!short_names) skip( "short names are not supported\n" );
+    else ok( short_names == LARGE_DIR_COUNT / 4, "got %u short names\n", short_names );
+}
+
+static void test_large_directory(void)
+{
+    static WCHAR maskW[] = {'*','.','t','e','x','t'};
+    char testdir[MAX_PATH], name[MAX_PATH], path[2 * MAX_PATH];
+    WCHAR testdir_w[MAX_PATH];
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING ntdirname, mask;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    unsigned int i;
+    HANDLE handle;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "largedir.tmp" );
+    if (!CreateDirectoryA( testdir, NULL ) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        skip( "can't create %s, error %u\n", testdir, GetLastError() );
+        return;
+    }
+    for (i = 0; i < LARGE_DIR_COUNT; i++)
+    {
+        get_large_dir_name( name, i );
+        sprintf( path, "%s\\%s", testdir, name );
+        handle = CreateFileA( path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+        ok( handle != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", path, GetLastError() );
+        if (handle == INVALID_HANDLE_VALUE) goto done;
+        CloseHandle( handle );
+    }
+
+    pRtlMultiByteToUnicodeN( testdir_w, sizeof(testdir_w), NULL, testdir, strlen(testdir) + 1 );
+    if (!pRtlDosPathNameToNtPathName_U( testdir_w, &ntdirname, NULL, NULL ))
+    {
+        ok( 0, "RtlDosPathNametoNtPathName_U failed\n" );
+        goto done;
+    }
+    InitializeObjectAttributes( &attr, &ntdirname, OBJ_CASE_INSENSITIVE, 0, NULL );
+    status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( status == STATUS_SUCCESS, "failed to open dir %s, status %x\n", testdir, status );
+    if (status)
+    {
+        pRtlFreeUnicodeString( &ntdirname );
+        goto done;
+    }
+
+    enum_large_directory( handle, testdir, NULL, 0 );
+    /* restart past the first batch */
+    enum_large_directory( handle, testdir, NULL, LARGE_DIR_COUNT - 500 );
+    pNtClose( handle );
+
+    /* restart a scan with a mask */
+    status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( status == STATUS_SUCCESS, "failed to open dir %s, status %x\n", testdir, status );
+    if (!status)
+    {
+        mask.Buffer = maskW;
+        mask.Length = mask.MaximumLength = sizeof(maskW);
+        enum_large_directory( handle, testdir, &mask, LARGE_DIR_COUNT / 8 );
+        pNtClose( handle );
+    }
+    pRtlFreeUnicodeString( &ntdirname );
+
+done:
+    for (i = 0; i < LARGE_DIR_COUNT; i++)
+    {
+        get_large_dir_name( name, i );
+        sprintf( path, "%s\\%s", testdir, name );
+        DeleteFileA( path );
+    }
+    RemoveDirectoryA( testdir );
+}
+
+static void test_file_lookup_case(void)
+{
+    char testdir[MAX_PATH], path[MAX_PATH];
+    HANDLE file;
+    int i;
+
+    GetTempPathA(MAX_PATH, testdir);
+    strcat(testdir, "lookup.tmp");
+    CreateDirectoryA(testdir, NULL);
+    for (i = 0; i < 64; i++)
+    {
+        sprintf(path, "%s\\MixedCase%02d.Txt", testdir, i);
+        file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+        ok(file != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", path, GetLastError());
+        CloseHandle(file);
+    }
+
+    /* make sure that the directory modification time is in the past */
+    Sleep(2100);
+
+    for (i = 0; i < 64; i++)
+    {
+        sprintf(path, "%s\\MIXEDcase%02d.tXT", testdir, i);
+        ok(GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n",
+           path, GetLastError());
+    }
+    sprintf(path, "%s\\mixedcase64.txt", testdir);
+    ok(GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES, "%s unexpectedly found\n", path);
+
+    /* changes to the directory are visible immediately */
+    sprintf(path, "%s\\MixedCase64.Txt", testdir);
+    file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", path, GetLastError());
+    CloseHandle(file);
+    sprintf(path, "%s\\mixedcase64.txt", testdir);
+    ok(GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", path, GetLastError());
+    ok(DeleteFileA(path), "failed to delete %s, error %u\n", path, GetLastError());
+    ok(GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES, "%s unexpectedly found\n", path);
+
+    for (i = 0; i < 64; i++)
+    {
+        sprintf(path, "%s\\mixedcase%02d.txt", testdir, i);
+        DeleteFileA(path);
+    }
+    RemoveDirectoryA(testdir);
+}
+
 static void test_redirection(void)
 {
     ULONG old, cur;
@@ -901,5 +1118,7 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_file_lookup_case();
+    test_large_directory();
     test_redirection();
 }
@@ -356,7 +356,6 @@ static void test_RtlRegisterWait(void)
     ok(!status, "RtlDeregisterWaitEx failed with status %x\n", status);
     ok(info.userdata == 0, "expected info.userdata = 0, got %u\n", info.userdata);
     result = WaitForSingleObject(event, 200);
-    todo_wine
     ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
 
     /* test RtlDeregisterWaitEx after wait expired */
@@ -393,7 +392,6 @@ static void test_RtlRegisterWait(void)
     ok(!status, "RtlDeregisterWaitEx failed with status %x\n", status);
     ok(info.userdata == 0x10000, "expected info.userdata = 0x10000, got %u\n", info.userdata);
     result = WaitForSingleObject(event, 200);
-    todo_wine
     ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
 
     /* test RtlDeregisterWaitEx while callback is running */
@@ -705,6 +703,60 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+struct blocking_info
+{
+    LONG   started;
+    LONG   finished;
+    LONG   count;
+    HANDLE event;
+};
+
+static void CALLBACK blocking_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct blocking_info *info = userdata;
+    DWORD result;
+
+    if (InterlockedIncrement(&info->started) == info->count) SetEvent(info->event);
+    result = WaitForSingleObject(info->event, 5000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    InterlockedIncrement(&info->finished);
+}
+
+static void test_tp_work_blocking(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    struct blocking_info info;
+    NTSTATUS status;
+    TP_POOL *pool;
+    int i;
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+
+    /* all the callbacks have to run at the same time to finish */
+    info.started  = 0;
+    info.finished = 0;
+    info.count    = 16;
+    info.event    = CreateEventA(NULL, TRUE, FALSE, NULL);
+    ok(info.event != NULL, "CreateEventA failed %u\n", GetLastError());
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+    for (i = 0; i < info.count; i++)
+    {
+        status = pTpSimpleTryPost(blocking_cb, &info, &environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    }
+    for (i = 0; i < 100 && info.finished < info.count; i++) Sleep(50);
+    ok(info.finished == info.count, "expected %u finished callbacks, got %u\n", info.count, info.finished);
+
+    pTpReleasePool(pool);
+    CloseHandle(info.event);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -1897,6 +1949,89 @@ static void test_tp_multi_wait(void)
     CloseHandle(semaphore);
 }
 
+static void CALLBACK many_waits_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WAIT *wait, TP_WAIT_RESULT result)
+{
+    HANDLE semaphore = userdata;
+    ok(result == WAIT_OBJECT_0, "expected WAIT_OBJECT_0, got %u\n", result);
+    ReleaseSemaphore(semaphore, 1, NULL);
+}
+
+static void test_tp_many_waits(void)
+{
+    static const int count = 4096;
+    TP_CALLBACK_ENVIRON environment;
+    HANDLE *events, semaphore, mutex;
+    TP_WAIT **waits, *wait;
+    NTSTATUS status;
+    TP_POOL *pool;
+    DWORD result;
+    int i;
+
+    semaphore = CreateSemaphoreW(NULL, 0, count, NULL);
+    ok(semaphore != NULL, "failed to create semaphore\n");
+    events = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*events));
+    waits = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*waits));
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    /* many more wait objects than a thread can wait for at once */
+    for (i = 0; i < count; i++)
+    {
+        events[i] = CreateEventW(NULL, FALSE, FALSE, NULL);
+        ok(events[i] != NULL, "failed to create event %d\n", i);
+
+        waits[i] = NULL;
+        status = pTpAllocWait(&waits[i], many_waits_cb, semaphore, &environment);
+        ok(!status, "TpAllocWait failed with status %x\n", status);
+        ok(waits[i] != NULL, "expected waits[%d] != NULL\n", i);
+
+        pTpSetWait(waits[i], events[i], NULL);
+    }
+
+    for (i = 0; i < count; i++) SetEvent(events[i]);
+    for (i = 0; i < count; i++)
+    {
+        result = WaitForSingleObject(semaphore, 1000);
+        ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u after %d callbacks\n", result, i);
+        if (result != WAIT_OBJECT_0) break;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        pTpReleaseWait(waits[i]);
+        CloseHandle(events[i]);
+    }
+
+    /* mutexes are waited for by a thread, mixed with the other waits */
+    mutex = CreateMutexW(NULL, TRUE, NULL);
+    ok(mutex != NULL, "failed to create mutex\n");
+
+    wait = NULL;
+    status = pTpAllocWait(&wait, many_waits_cb, semaphore, &environment);
+    ok(!status, "TpAllocWait failed with status %x\n", status);
+    ok(wait != NULL, "expected wait != NULL\n");
+    pTpSetWait(wait, mutex, NULL);
+    result = WaitForSingleObject(semaphore, 100);
+    ok(result == WAIT_TIMEOUT, "WaitForSingleObject returned %u\n", result);
+    ReleaseMutex(mutex);
+    result = WaitForSingleObject(semaphore, 1000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    pTpReleaseWait(wait);
+    CloseHandle(mutex);
+
+    pTpReleasePool(pool);
+    HeapFree(GetProcessHeap(), 0, events);
+    HeapFree(GetProcessHeap(), 0, waits);
+    CloseHandle(semaphore);
+}
+
 START_TEST(threadpool)
 {
     test_RtlQueueWorkItem();
@@ -1908,6 +2043,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_blocking();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -1916,4 +2052,5 @@ START_TEST(threadpool)
     test_tp_window_length();
     test_tp_wait();
     test_tp_multi_wait();
+    test_tp_many_waits();
 }
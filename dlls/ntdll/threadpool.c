@@ -33,6 +33,7 @@
 
 #include "wine/debug.h"
 #include "wine/list.h"
+#include "wine/server.h"
 
 #include "ntdll_misc.h"
 
@@ -82,6 +83,7 @@ struct wait_work_item
     HANDLE CompletionEvent;
     LONG DeleteCount;
     BOOLEAN CallbackInProgress;
+    TP_WAIT *Wait;              /* thread pool wait, NULL if waiting in a dedicated thread */
 };
 
 struct timer_queue;
@@ -131,6 +133,7 @@ struct threadpool
     int                     min_workers;
     int                     num_workers;
     int                     num_busy_workers;
+    BOOL                    worker_starting;
 };
 
 enum threadpool_objtype
@@ -198,6 +201,8 @@ struct threadpool_object
             struct list     wait_entry;
             ULONGLONG       timeout;
             HANDLE          handle;
+            HANDLE          completion;     /* server-side wait completion */
+            ULONG           serial;         /* identifies the current server-side wait */
         } wait;
     } u;
 };
@@ -287,6 +292,7 @@ struct waitqueue_bucket
     struct list             reserved;
     struct list             waiting;
     HANDLE                  update_event;
+    HANDLE                  port;           /* completion port for server-side waits, or NULL */
 };
 
 static inline struct threadpool *impl_from_TP_POOL( TP_POOL *pool )
@@ -493,10 +499,51 @@ static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout
 
 static void delete_wait_work_item(struct wait_work_item *wait_work_item)
 {
-    NtClose( wait_work_item->CancelEvent );
+    if (wait_work_item->CancelEvent) NtClose( wait_work_item->CancelEvent );
     RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
 }
 
+static void CALLBACK rtl_wait_callback( TP_CALLBACK_INSTANCE *instance, void *userdata,
+                                        TP_WAIT *wait, TP_WAIT_RESULT result )
+{
+    struct wait_work_item *wait_work_item = userdata;
+    LARGE_INTEGER timeout;
+
+    if (wait_work_item->DeleteCount) return;
+
+    if (result == WAIT_OBJECT_0)
+        TRACE( "object %p signaled, calling callback %p with context %p\n",
+               wait_work_item->Object, wait_work_item->Callback, wait_work_item->Context );
+    else
+        TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
+               wait_work_item->Object, wait_work_item->Callback, wait_work_item->Context );
+
+    wait_work_item->CallbackInProgress = TRUE;
+    wait_work_item->Callback( wait_work_item->Context, result != WAIT_OBJECT_0 );
+    wait_work_item->CallbackInProgress = FALSE;
+
+    if (!(wait_work_item->Flags & WT_EXECUTEONLYONCE) && !wait_work_item->DeleteCount)
+        TpSetWait( wait, wait_work_item->Object, get_nt_timeout( &timeout, wait_work_item->Milliseconds ) );
+}
+
+/* stop the thread pool wait of a deregistered wait and free it once its callbacks are done */
+static DWORD CALLBACK delete_tp_wait_work_item( LPVOID Arg )
+{
+    struct wait_work_item *wait_work_item = Arg;
+    HANDLE completion_event = wait_work_item->CompletionEvent;
+
+    /* a running callback may have re-armed the wait before seeing DeleteCount, so stop it twice */
+    TpSetWait( wait_work_item->Wait, NULL, NULL );
+    TpWaitForWait( wait_work_item->Wait, TRUE );
+    TpSetWait( wait_work_item->Wait, NULL, NULL );
+    TpWaitForWait( wait_work_item->Wait, TRUE );
+    TpReleaseWait( wait_work_item->Wait );
+
+    if (completion_event) NtSetEvent( completion_event, NULL );
+    delete_wait_work_item( wait_work_item );
+    return 0;
+}
+
 static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
 {
     struct wait_work_item *wait_work_item = Arg;
@@ -574,12 +621,17 @@ static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
  *|WT_EXECUTEINPERSISTENTTHREAD - Executes the work item in a thread that is persistent.
  *|WT_EXECUTELONGFUNCTION - Hints that the execution can take a long time.
  *|WT_TRANSFER_IMPERSONATION - Executes the function with the current access token.
+ *
+ *  Unless WT_EXECUTEINIOTHREAD is specified, the wait is performed by the
+ *  thread pool wait queue instead of a dedicated thread.
  */
 NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
                                 RTL_WAITORTIMERCALLBACKFUNC Callback,
                                 PVOID Context, ULONG Milliseconds, ULONG Flags)
 {
     struct wait_work_item *wait_work_item;
+    TP_CALLBACK_ENVIRON environment;
+    LARGE_INTEGER timeout;
     NTSTATUS status;
 
     TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
@@ -596,6 +648,28 @@ NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
     wait_work_item->CallbackInProgress = FALSE;
     wait_work_item->DeleteCount = 0;
     wait_work_item->CompletionEvent = NULL;
+    wait_work_item->CancelEvent = NULL;
+    wait_work_item->Wait = NULL;
+
+    /* I/O threads have to wait alertably for APCs, which needs a dedicated thread */
+    if (!(Flags & WT_EXECUTEINIOTHREAD))
+    {
+        memset( &environment, 0, sizeof(environment) );
+        environment.Version = 1;
+        environment.u.s.LongFunction = (Flags & WT_EXECUTELONGFUNCTION) != 0;
+        environment.u.s.Persistent   = (Flags & WT_EXECUTEINPERSISTENTTHREAD) != 0;
+
+        status = TpAllocWait( &wait_work_item->Wait, rtl_wait_callback, wait_work_item, &environment );
+        if (status != STATUS_SUCCESS)
+        {
+            RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
+            return status;
+        }
+        TpSetWait( wait_work_item->Wait, Object, get_nt_timeout( &timeout, Milliseconds ) );
+
+        *NewWaitObject = wait_work_item;
+        return STATUS_SUCCESS;
+    }
 
     status = NtCreateEvent( &wait_work_item->CancelEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
     if (status != STATUS_SUCCESS)
@@ -640,6 +714,23 @@ NTSTATUS WINAPI RtlDeregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent)
     if (WaitHandle == NULL)
         return STATUS_INVALID_HANDLE;
 
+    if (wait_work_item->Wait)
+    {
+        interlocked_xchg( &wait_work_item->DeleteCount, 1 );
+        if (CompletionEvent == INVALID_HANDLE_VALUE)
+        {
+            wait_work_item->CompletionEvent = NULL;
+            delete_tp_wait_work_item( wait_work_item );
+            return STATUS_SUCCESS;
+        }
+
+        if (wait_work_item->CallbackInProgress) status = STATUS_PENDING;
+        wait_work_item->CompletionEvent = CompletionEvent;
+        if (RtlQueueWorkItem( delete_tp_wait_work_item, wait_work_item, WT_EXECUTEDEFAULT ))
+            delete_tp_wait_work_item( wait_work_item );
+        return status;
+    }
+
     NtSetEvent( wait_work_item->CancelEvent, NULL );
     if (wait_work_item->CallbackInProgress)
     {
@@ -1298,11 +1389,29 @@ static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
         interlocked_inc( &pool->refcount );
         pool->num_workers++;
         pool->num_busy_workers++;
+        pool->worker_starting = TRUE;
         NtClose( thread );
     }
     return status;
 }
 
+/***********************************************************************
+ *           tp_update_workers    (internal)
+ *
+ * Makes sure that the pending work items of a pool get processed. An idle
+ * worker is woken up if there is one, otherwise a new worker thread is
+ * started. Only one thread is started at a time; the new thread calls this
+ * function again when it picks up a work item, so that threads are added
+ * gradually while the pool is saturated. The pool must be locked.
+ */
+static void tp_update_workers( struct threadpool *pool )
+{
+    if (pool->num_busy_workers < pool->num_workers)
+        RtlWakeConditionVariable( &pool->update_event );
+    else if (!pool->worker_starting && pool->num_workers < pool->max_workers)
+        tp_new_worker_thread( pool );
+}
+
 /***********************************************************************
  *           tp_timerqueue_lock    (internal)
  *
@@ -1476,7 +1585,7 @@ static void CALLBACK waitqueue_thread_proc( void *param )
             struct waitqueue_bucket *other_bucket;
             LIST_FOR_EACH_ENTRY( other_bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
             {
-                if (other_bucket != bucket && other_bucket->objcount &&
+                if (other_bucket != bucket && !other_bucket->port && other_bucket->objcount &&
                     other_bucket->objcount + bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 2 / 3)
                 {
                     other_bucket->objcount += bucket->objcount;
@@ -1529,59 +1638,219 @@ static void CALLBACK waitqueue_thread_proc( void *param )
 }
 
 /***********************************************************************
- *           tp_waitqueue_lock    (internal)
+ *           tp_waitqueue_cancel_completion    (internal)
+ *
+ * Cancels the server-side wait of a wait object in a multiplexed bucket.
+ * Returns TRUE if the object was signaled in the meantime. Must be called
+ * with waitqueue.cs held.
  */
-static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+static BOOL tp_waitqueue_cancel_completion( struct threadpool_object *wait )
+{
+    int state = WAIT_COMPLETION_DELIVERED;
+
+    SERVER_START_REQ( cancel_wait_completion )
+    {
+        req->handle = wine_server_obj_handle( wait->u.wait.completion );
+        if (!wine_server_call( req )) state = reply->state;
+    }
+    SERVER_END_REQ;
+
+    /* A delivered completion is handled by the wait queue thread, which
+     * also releases the reference held by the server-side wait. */
+    if (state == WAIT_COMPLETION_DELIVERED)
+        return FALSE;
+
+    tp_object_release( wait );
+    return state == WAIT_COMPLETION_REMOVED;
+}
+
+/***********************************************************************
+ *           tp_waitqueue_associate_completion    (internal)
+ *
+ * Starts a server-side wait, which queues a completion to the port of
+ * the bucket once the handle is signaled. Must be called with waitqueue.cs held.
+ */
+static NTSTATUS tp_waitqueue_associate_completion( struct threadpool_object *wait, HANDLE handle )
 {
-    struct waitqueue_bucket *bucket;
     NTSTATUS status;
-    HANDLE thread;
-    assert( wait->type == TP_OBJECT_TYPE_WAIT );
 
-    wait->u.wait.signaled       = 0;
-    wait->u.wait.bucket         = NULL;
-    wait->u.wait.wait_pending   = FALSE;
-    wait->u.wait.timeout        = 0;
-    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+    /* The server-side wait holds a reference until its completion is processed. */
+    interlocked_inc( &wait->refcount );
+
+    SERVER_START_REQ( associate_wait_completion )
+    {
+        req->handle = wine_server_obj_handle( wait->u.wait.completion );
+        req->port   = wine_server_obj_handle( wait->u.wait.bucket->port );
+        req->object = wine_server_obj_handle( handle );
+        req->ckey   = wine_server_client_ptr( wait );
+        req->cvalue = ++wait->u.wait.serial;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    if (status) tp_object_release( wait );
+    return status;
+}
+
+/***********************************************************************
+ *           waitqueue_port_thread_proc    (internal)
+ *
+ * Wait queue thread of a multiplexed bucket. The server queues a completion
+ * to the port of the bucket for each signaled wait object, so that a single
+ * thread can handle an unlimited number of wait objects.
+ */
+static void CALLBACK waitqueue_port_thread_proc( void *param )
+{
+    struct waitqueue_bucket *bucket = param;
+    struct threadpool_object *wait, *next;
+    LARGE_INTEGER now, timeout;
+    ULONG_PTR key, value;
+    IO_STATUS_BLOCK iosb;
+    NTSTATUS status;
+
+    TRACE( "starting wait queue port thread\n" );
 
     RtlEnterCriticalSection( &waitqueue.cs );
 
-    /* Try to assign to existing bucket if possible. */
-    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+    for (;;)
     {
-        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS)
+        NtQuerySystemTime( &now );
+        timeout.QuadPart = TIMEOUT_INFINITE;
+
+        /* The waiting list is sorted by timeout. */
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object,
+                                  u.wait.wait_entry )
         {
+            assert( wait->type == TP_OBJECT_TYPE_WAIT );
+            if (wait->u.wait.timeout > now.QuadPart)
+            {
+                timeout.QuadPart = wait->u.wait.timeout;
+                break;
+            }
+
+            /* Wait object timed out, unless it was signaled in the meantime. */
+            list_remove( &wait->u.wait.wait_entry );
             list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-            wait->u.wait.bucket = bucket;
-            bucket->objcount++;
+            wait->u.wait.wait_pending = FALSE;
+            tp_object_submit( wait, tp_waitqueue_cancel_completion( wait ) );
+        }
 
-            status = STATUS_SUCCESS;
-            goto out;
+        /* If no wait objects are created within some amount of time,
+         * then we can shutdown this thread. */
+        if (!bucket->objcount)
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+
+        RtlLeaveCriticalSection( &waitqueue.cs );
+        status = NtRemoveIoCompletion( bucket->port, &key, &value, &iosb, &timeout );
+        RtlEnterCriticalSection( &waitqueue.cs );
+
+        if (status == STATUS_SUCCESS && key)
+        {
+            wait = (struct threadpool_object *)key;
+            assert( wait->type == TP_OBJECT_TYPE_WAIT );
+            if (wait->u.wait.bucket == bucket && wait->u.wait.wait_pending &&
+                value == wait->u.wait.serial)
+            {
+                /* Wait object signaled. */
+                list_remove( &wait->u.wait.wait_entry );
+                list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+                wait->u.wait.wait_pending = FALSE;
+                tp_object_submit( wait, TRUE );
+            }
+            else
+                TRACE( "ignoring stale completion for wait object %p\n", wait );
+
+            /* Release the reference held by the server-side wait, outside of
+             * the lock since the object might be destroyed. */
+            RtlLeaveCriticalSection( &waitqueue.cs );
+            tp_object_release( wait );
+            RtlEnterCriticalSection( &waitqueue.cs );
         }
+        else if (status == STATUS_TIMEOUT && !bucket->objcount)
+            break;
+    }
+
+    /* Remove this bucket from the list. */
+    list_remove( &bucket->bucket_entry );
+    if (!--waitqueue.num_buckets)
+        assert( list_empty( &waitqueue.buckets ) );
+
+    RtlLeaveCriticalSection( &waitqueue.cs );
+
+    TRACE( "terminating wait queue port thread\n" );
+
+    assert( bucket->objcount == 0 );
+    assert( list_empty( &bucket->reserved ) );
+    assert( list_empty( &bucket->waiting ) );
+    NtClose( bucket->port );
+
+    RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    RtlExitUserThread( 0 );
+}
+
+/***********************************************************************
+ *           tp_waitqueue_wake    (internal)
+ *
+ * Wakes up the thread of a wait queue bucket to update its wait.
+ */
+static void tp_waitqueue_wake( struct waitqueue_bucket *bucket )
+{
+    if (bucket->port)
+        NtSetIoCompletion( bucket->port, 0, 0, STATUS_SUCCESS, 0 );
+    else
+        NtSetEvent( bucket->update_event, NULL );
+}
+
+/***********************************************************************
+ *           tp_waitqueue_add    (internal)
+ *
+ * Adds a wait object to a bucket, which is multiplexed through server-side
+ * wait completions or limited to MAXIMUM_WAITQUEUE_OBJECTS handles. Must be
+ * called with waitqueue.cs held.
+ */
+static NTSTATUS tp_waitqueue_add( struct threadpool_object *wait, BOOL multiplexed )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    HANDLE thread;
+
+    /* Try to assign to existing bucket if possible. */
+    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+    {
+        if (multiplexed ? !bucket->port : (bucket->port || bucket->objcount >= MAXIMUM_WAITQUEUE_OBJECTS))
+            continue;
+
+        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+        wait->u.wait.bucket = bucket;
+        bucket->objcount++;
+        return STATUS_SUCCESS;
     }
 
     /* Create a new bucket and corresponding worker thread. */
     bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) );
     if (!bucket)
-    {
-        status = STATUS_NO_MEMORY;
-        goto out;
-    }
+        return STATUS_NO_MEMORY;
 
     bucket->objcount = 0;
+    bucket->update_event = NULL;
+    bucket->port = NULL;
     list_init( &bucket->reserved );
     list_init( &bucket->waiting );
 
-    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
-                            NULL, SynchronizationEvent, FALSE );
+    if (multiplexed)
+        status = NtCreateIoCompletion( &bucket->port, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
+    else
+        status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
+                                NULL, SynchronizationEvent, FALSE );
     if (status)
     {
         RtlFreeHeap( GetProcessHeap(), 0, bucket );
-        goto out;
+        return status;
     }
 
     status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                  waitqueue_thread_proc, bucket, &thread, NULL );
+                                  multiplexed ? waitqueue_port_thread_proc : waitqueue_thread_proc,
+                                  bucket, &thread, NULL );
     if (status == STATUS_SUCCESS)
     {
         list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
@@ -1595,12 +1864,51 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
     }
     else
     {
-        NtClose( bucket->update_event );
+        NtClose( multiplexed ? bucket->port : bucket->update_event );
         RtlFreeHeap( GetProcessHeap(), 0, bucket );
     }
 
-out:
+    return status;
+}
+
+/***********************************************************************
+ *           tp_waitqueue_lock    (internal)
+ */
+static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+{
+    NTSTATUS status;
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
+
+    wait->u.wait.signaled       = 0;
+    wait->u.wait.bucket         = NULL;
+    wait->u.wait.wait_pending   = FALSE;
+    wait->u.wait.timeout        = 0;
+    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+    wait->u.wait.completion     = NULL;
+    wait->u.wait.serial         = 0;
+
+    SERVER_START_REQ( create_wait_completion )
+    {
+        req->access     = GENERIC_ALL;
+        req->attributes = 0;
+        if (!wine_server_call( req ))
+            wait->u.wait.completion = wine_server_ptr_handle( reply->handle );
+    }
+    SERVER_END_REQ;
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    /* Fall back to a bucket limited to MAXIMUM_WAITQUEUE_OBJECTS handles
+     * when server-side waits are not available. */
+    if (!wait->u.wait.completion || tp_waitqueue_add( wait, TRUE ))
+        status = tp_waitqueue_add( wait, FALSE );
+    else
+        status = STATUS_SUCCESS;
+
     RtlLeaveCriticalSection( &waitqueue.cs );
+
+    if (status && wait->u.wait.completion)
+        NtClose( wait->u.wait.completion );
     return status;
 }
 
@@ -1618,10 +1926,19 @@ static void tp_waitqueue_unlock( struct threadpool_object *wait )
         assert( bucket->objcount > 0 );
 
         list_remove( &wait->u.wait.wait_entry );
+        if (bucket->port && wait->u.wait.wait_pending)
+            tp_waitqueue_cancel_completion( wait );
         wait->u.wait.bucket = NULL;
+        wait->u.wait.wait_pending = FALSE;
         bucket->objcount--;
 
-        NtSetEvent( bucket->update_event, NULL );
+        if (!bucket->port || !bucket->objcount)
+            tp_waitqueue_wake( bucket );
+    }
+    if (wait->u.wait.completion)
+    {
+        NtClose( wait->u.wait.completion );
+        wait->u.wait.completion = NULL;
     }
     RtlLeaveCriticalSection( &waitqueue.cs );
 }
@@ -1653,6 +1970,7 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     pool->min_workers           = 0;
     pool->num_workers           = 0;
     pool->num_busy_workers      = 0;
+    pool->worker_starting       = FALSE;
 
     TRACE( "allocated threadpool %p\n", pool );
 
@@ -1911,18 +2229,12 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 {
     struct threadpool *pool = object->pool;
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
 
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
     RtlEnterCriticalSection( &pool->cs );
 
-    /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers &&
-        pool->num_workers < pool->max_workers)
-        status = tp_new_worker_thread( pool );
-
     /* Queue work item and increment refcount. */
     interlocked_inc( &object->refcount );
     if (!object->num_pending_callbacks++)
@@ -1932,12 +2244,9 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
-    if (status != STATUS_SUCCESS)
-    {
-        assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
-    }
+    /* Wake up an idle thread, or start a new one. */
+    assert( pool->num_workers > 0 );
+    tp_update_workers( pool );
 
     RtlLeaveCriticalSection( &pool->cs );
 }
@@ -2064,6 +2373,7 @@ static void CALLBACK threadpool_worker_proc( void *param )
 
     RtlEnterCriticalSection( &pool->cs );
     pool->num_busy_workers--;
+    pool->worker_starting = FALSE;
     for (;;)
     {
         while ((ptr = list_head( &pool->pool )))
@@ -2088,6 +2398,9 @@ static void CALLBACK threadpool_worker_proc( void *param )
             object->num_associated_callbacks++;
             object->num_running_callbacks++;
             pool->num_busy_workers++;
+
+            /* Make sure that the remaining work items don't have to wait for this callback. */
+            if (list_head( &pool->pool )) tp_update_workers( pool );
             RtlLeaveCriticalSection( &pool->cs );
 
             /* Initialize threadpool instance struct. */
@@ -2813,6 +3126,10 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
         struct waitqueue_bucket *bucket = this->u.wait.bucket;
         list_remove( &this->u.wait.wait_entry );
 
+        /* Cancel the previous server-side wait. */
+        if (bucket->port && this->u.wait.wait_pending)
+            tp_waitqueue_cancel_completion( this );
+
         /* Convert relative timeout to absolute timestamp. */
         if (handle && timeout)
         {
@@ -2830,10 +3147,40 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
             }
         }
 
+        /* Objects which cannot be waited for by the server, like mutexes,
+         * are moved to a bucket with a thread waiting for them. */
+        if (handle && bucket->port && tp_waitqueue_associate_completion( this, handle ))
+        {
+            if (!tp_waitqueue_add( this, FALSE ))
+            {
+                list_remove( &this->u.wait.wait_entry );
+                if (!--bucket->objcount) tp_waitqueue_wake( bucket );
+                bucket = this->u.wait.bucket;
+            }
+            else
+            {
+                ERR( "failed to move wait object %p to a wait queue thread\n", this );
+                handle = NULL;
+            }
+        }
+
         /* Add wait object back into one of the queues. */
         if (handle)
         {
-            list_add_tail( &bucket->waiting, &this->u.wait.wait_entry );
+            struct list *ptr = &bucket->waiting;
+
+            /* Multiplexed buckets keep the waiting list sorted by timeout. */
+            if (bucket->port)
+            {
+                struct threadpool_object *other;
+                LIST_FOR_EACH_ENTRY_REV( other, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+                {
+                    if (other->u.wait.timeout <= timestamp) break;
+                    ptr = &other->u.wait.wait_entry;
+                }
+            }
+
+            list_add_before( ptr, &this->u.wait.wait_entry );
             this->u.wait.wait_pending = TRUE;
             this->u.wait.timeout = timestamp;
         }
@@ -2843,8 +3190,11 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
             this->u.wait.wait_pending = FALSE;
         }
 
-        /* Wake up the wait queue thread. */
-        NtSetEvent( bucket->update_event, NULL );
+        /* Wake up the wait queue thread, multiplexed buckets only need to
+         * update their timeout when the wait object is the next to expire. */
+        if (!bucket->port || (handle && timestamp != TIMEOUT_INFINITE &&
+                              list_head( &bucket->waiting ) == &this->u.wait.wait_entry))
+            tp_waitqueue_wake( bucket );
     }
 
     RtlLeaveCriticalSection( &waitqueue.cs );
@@ -8881,7 +8881,7 @@ static void test_timers(void)
 {
     struct timer_info info;
     DWORD start;
-    DWORD id;
+    DWORD id, i;
     MSG msg;
 
     info.hWnd = CreateWindowA("TestWindowClass", NULL,
@@ -8948,6 +8948,24 @@ static void test_timers(void)
         ok(pKillSystemTimer(info.hWnd, id), "KillSystemTimer failed\n");
     }
 
+    /* many timers on the same window */
+    for (i = 1; i <= 500; i++)
+    {
+        id = SetTimer(info.hWnd, i, 10000 + i, NULL);
+        ok(id == i, "SetTimer returned %u for id %u\n", id, i);
+    }
+    for (i = 1; i <= 500; i += 2) ok(KillTimer(info.hWnd, i), "KillTimer %u failed\n", i);
+    for (i = 1; i <= 500; i += 2) ok(!KillTimer(info.hWnd, i), "KillTimer %u succeeded\n", i);
+    for (i = 2; i <= 500; i += 2) ok(KillTimer(info.hWnd, i), "KillTimer %u failed\n", i);
+
+    /* the timer that expires first is received first */
+    SetTimer(info.hWnd, 1, 300, NULL);
+    SetTimer(info.hWnd, 2, 50, NULL);
+    SetTimer(info.hWnd, 3, 200, NULL);
+    ok(GetMessageA(&msg, info.hWnd, WM_TIMER, WM_TIMER), "GetMessage failed\n");
+    ok(msg.wParam == 2, "got timer %lu\n", msg.wParam);
+    for (i = 1; i <= 3; i++) ok(KillTimer(info.hWnd, i), "KillTimer %u failed\n", i);
+
     ok(DestroyWindow(info.hWnd), "failed to destroy window\n");
 }
 
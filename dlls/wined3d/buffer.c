@@ -35,6 +35,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(d3d);
 #define WINED3D_BUFFER_DISCARD      0x08    /* A DISCARD lock has occurred since the last preload. */
 #define WINED3D_BUFFER_SYNC         0x10    /* There has been at least one synchronized map since the last preload. */
 #define WINED3D_BUFFER_APPLESYNC    0x20    /* Using sync as in GL_APPLE_flush_buffer_range. */
+#define WINED3D_BUFFER_STREAMING    0x40    /* The buffer is mapped through the device streaming ring. */
 
 #define VB_MAXDECLCHANGES     100     /* After that number of decl changes we stop converting */
 #define VB_RESETDECLCHANGE    1000    /* Reset the decl changecount after that number of draws */
@@ -508,6 +509,177 @@ BYTE *buffer_get_sysmem(struct wined3d_buffer *buffer, struct wined3d_context *c
     return buffer->resource.heap_memory;
 }
 
+static void wined3d_stream_ring_init(struct wined3d_stream_ring *ring, struct wined3d_device *device)
+{
+    const struct wined3d_gl_info *gl_info;
+    struct wined3d_context *context;
+    GLbitfield flags;
+    unsigned int i;
+
+    ring->current = ~0u;
+
+    context = context_acquire(device, NULL);
+    gl_info = context->gl_info;
+
+    if (!gl_info->supported[ARB_BUFFER_STORAGE] || !gl_info->supported[ARB_COPY_BUFFER]
+            || !gl_info->supported[ARB_MAP_BUFFER_RANGE] || !gl_info->supported[ARB_SYNC])
+    {
+        TRACE("Persistent buffer mappings not supported, not using a streaming ring.\n");
+        context_release(context);
+        return;
+    }
+
+    for (i = 0; i < WINED3D_STREAM_RING_CHUNKS; ++i)
+    {
+        if (!(ring->chunks[i].query = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ring->chunks[i].query))))
+        {
+            ERR("Failed to allocate event query memory.\n");
+            context_release(context);
+            return;
+        }
+    }
+
+    flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GL_EXTCALL(glGenBuffers(1, &ring->buffer_object));
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->buffer_object));
+    GL_EXTCALL(glBufferStorage(GL_COPY_READ_BUFFER, WINED3D_STREAM_RING_SIZE, NULL, flags));
+    ring->ptr = GL_EXTCALL(glMapBufferRange(GL_COPY_READ_BUFFER, 0, WINED3D_STREAM_RING_SIZE, flags));
+    checkGLcall("create streaming ring");
+
+    if (!ring->ptr || ((DWORD_PTR)ring->ptr & (RESOURCE_ALIGNMENT - 1)))
+    {
+        WARN("Failed to map the streaming ring, pointer %p.\n", ring->ptr);
+        if (ring->ptr)
+            GL_EXTCALL(glUnmapBuffer(GL_COPY_READ_BUFFER));
+        GL_EXTCALL(glDeleteBuffers(1, &ring->buffer_object));
+        checkGLcall("delete streaming ring");
+        ring->buffer_object = 0;
+        ring->ptr = NULL;
+    }
+    else
+    {
+        TRACE("Created streaming ring %u, pointer %p.\n", ring->buffer_object, ring->ptr);
+    }
+
+    context_release(context);
+}
+
+/* Returns NULL if the device has no usable streaming ring. */
+static struct wined3d_stream_ring *wined3d_device_get_stream_ring(struct wined3d_device *device)
+{
+    struct wined3d_stream_ring *ring;
+
+    if (!(ring = device->stream_ring))
+    {
+        if (!(ring = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ring))))
+            return NULL;
+        wined3d_stream_ring_init(ring, device);
+        device->stream_ring = ring;
+    }
+
+    return ring->ptr ? ring : NULL;
+}
+
+/* The context has to be current. */
+void wined3d_stream_ring_destroy(struct wined3d_device *device, const struct wined3d_gl_info *gl_info)
+{
+    struct wined3d_stream_ring *ring;
+    unsigned int i;
+
+    if (!(ring = device->stream_ring))
+        return;
+
+    if (ring->ptr)
+    {
+        GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->buffer_object));
+        GL_EXTCALL(glUnmapBuffer(GL_COPY_READ_BUFFER));
+        GL_EXTCALL(glDeleteBuffers(1, &ring->buffer_object));
+        checkGLcall("delete streaming ring");
+    }
+
+    for (i = 0; i < WINED3D_STREAM_RING_CHUNKS; ++i)
+    {
+        if (ring->chunks[i].query)
+            wined3d_event_query_destroy(ring->chunks[i].query);
+    }
+
+    HeapFree(GetProcessHeap(), 0, ring);
+    device->stream_ring = NULL;
+}
+
+static void wined3d_stream_ring_fence_chunk(struct wined3d_stream_ring *ring,
+        struct wined3d_device *device, unsigned int idx)
+{
+    struct wined3d_stream_chunk *chunk = &ring->chunks[idx];
+
+    /* The copies from the chunk have all been submitted, reusing the chunk
+     * only has to wait for them. */
+    if (chunk->closed && !chunk->pending && !chunk->fenced)
+    {
+        wined3d_event_query_issue(chunk->query, device);
+        chunk->fenced = TRUE;
+    }
+}
+
+static BOOL wined3d_stream_ring_alloc(struct wined3d_stream_ring *ring,
+        struct wined3d_device *device, unsigned int size, unsigned int *offset)
+{
+    struct wined3d_stream_chunk *chunk;
+    enum wined3d_event_query_result ret;
+    unsigned int idx;
+
+    size = (size + RESOURCE_ALIGNMENT - 1) & ~(RESOURCE_ALIGNMENT - 1);
+    if (size > WINED3D_STREAM_CHUNK_SIZE)
+        return FALSE;
+
+    if (ring->current != ~0u && ring->head + size > (ring->current + 1) * WINED3D_STREAM_CHUNK_SIZE)
+    {
+        idx = ring->current;
+        ring->chunks[idx].closed = TRUE;
+        wined3d_stream_ring_fence_chunk(ring, device, idx);
+        ring->current = ~0u;
+        ring->head = ((idx + 1) % WINED3D_STREAM_RING_CHUNKS) * WINED3D_STREAM_CHUNK_SIZE;
+    }
+
+    if (ring->current == ~0u)
+    {
+        idx = ring->head / WINED3D_STREAM_CHUNK_SIZE;
+        chunk = &ring->chunks[idx];
+
+        /* A buffer stayed mapped while the ring wrapped around. */
+        if (chunk->pending)
+        {
+            TRACE("Chunk %u is still in use.\n", idx);
+            return FALSE;
+        }
+
+        if (chunk->fenced)
+        {
+            if ((ret = wined3d_event_query_finish(chunk->query, device)) != WINED3D_EVENT_QUERY_OK)
+                ERR("Failed to wait for streaming ring chunk %u, ret %#x.\n", idx, ret);
+            chunk->fenced = FALSE;
+        }
+
+        chunk->closed = FALSE;
+        ring->current = idx;
+    }
+
+    *offset = ring->head;
+    ring->head += size;
+    ++ring->chunks[ring->current].pending;
+
+    return TRUE;
+}
+
+static void wined3d_stream_ring_release(struct wined3d_stream_ring *ring,
+        struct wined3d_device *device, unsigned int offset)
+{
+    unsigned int idx = offset / WINED3D_STREAM_CHUNK_SIZE;
+
+    --ring->chunks[idx].pending;
+    wined3d_stream_ring_fence_chunk(ring, device, idx);
+}
+
 static void buffer_unload(struct wined3d_resource *resource)
 {
     struct wined3d_buffer *buffer = buffer_from_resource(resource);
@@ -521,6 +693,13 @@ static void buffer_unload(struct wined3d_resource *resource)
 
         context = context_acquire(device, NULL);
 
+        if (buffer->flags & WINED3D_BUFFER_STREAMING)
+        {
+            wined3d_stream_ring_release(device->stream_ring, device, buffer->stream_offset);
+            buffer->flags &= ~WINED3D_BUFFER_STREAMING;
+            buffer->map_ptr = NULL;
+        }
+
         /* Download the buffer, but don't permanently enable double buffering */
         if (!(buffer->flags & WINED3D_BUFFER_DOUBLEBUFFER))
         {
@@ -935,6 +1114,53 @@ struct wined3d_resource * CDECL wined3d_buffer_get_resource(struct wined3d_buffe
     return &buffer->resource;
 }
 
+/* Maps the buffer to a new region of the streaming ring. The previous
+ * contents of the buffer are not visible through the mapping, and the whole
+ * region is copied back on unmap, so this is only done for DISCARD maps.
+ * The ring is mapped write-only, so the buffer has to be WRITEONLY as well. */
+static BOOL buffer_map_stream(struct wined3d_buffer *buffer, DWORD flags)
+{
+    struct wined3d_device *device = buffer->resource.device;
+    struct wined3d_stream_ring *ring;
+
+    if (!(buffer->resource.usage & WINED3DUSAGE_DYNAMIC) || !(buffer->resource.usage & WINED3DUSAGE_WRITEONLY)
+            || buffer->conversion_map || !(flags & WINED3D_MAP_DISCARD) || (flags & WINED3D_MAP_READONLY))
+        return FALSE;
+    /* The ring is not synchronized with the command stream thread. */
+    if (device->cs->thread)
+        return FALSE;
+
+    if (!(ring = wined3d_device_get_stream_ring(device)))
+        return FALSE;
+    if (!wined3d_stream_ring_alloc(ring, device, buffer->resource.size, &buffer->stream_offset))
+        return FALSE;
+
+    buffer->map_ptr = ring->ptr + buffer->stream_offset;
+    buffer->flags |= WINED3D_BUFFER_STREAMING;
+
+    return TRUE;
+}
+
+/* The caller provides a context. */
+static void buffer_unmap_stream(struct wined3d_buffer *buffer, const struct wined3d_gl_info *gl_info)
+{
+    struct wined3d_device *device = buffer->resource.device;
+    struct wined3d_stream_ring *ring = device->stream_ring;
+    unsigned int i;
+
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->buffer_object));
+    GL_EXTCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->buffer_object));
+    for (i = 0; i < buffer->modified_areas; ++i)
+    {
+        GL_EXTCALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                buffer->stream_offset + buffer->maps[i].offset, buffer->maps[i].offset, buffer->maps[i].size));
+    }
+    checkGLcall("streaming ring copy");
+
+    wined3d_stream_ring_release(ring, device, buffer->stream_offset);
+    buffer->flags &= ~WINED3D_BUFFER_STREAMING;
+}
+
 HRESULT CDECL wined3d_buffer_map(struct wined3d_buffer *buffer, UINT offset, UINT size, BYTE **data, DWORD flags)
 {
     LONG count;
@@ -966,7 +1192,7 @@ HRESULT CDECL wined3d_buffer_map(struct wined3d_buffer *buffer, UINT offset, UIN
 
         if (!(buffer->flags & WINED3D_BUFFER_DOUBLEBUFFER))
         {
-            if (count == 1)
+            if (count == 1 && !buffer_map_stream(buffer, flags))
             {
                 struct wined3d_device *device = buffer->resource.device;
                 struct wined3d_context *context;
@@ -1069,6 +1295,18 @@ void CDECL wined3d_buffer_unmap(struct wined3d_buffer *buffer)
         context = context_acquire(device, NULL);
         gl_info = context->gl_info;
 
+        if (buffer->flags & WINED3D_BUFFER_STREAMING)
+        {
+            buffer_unmap_stream(buffer, gl_info);
+            if (wined3d_settings.strict_draw_ordering)
+                gl_info->gl_ops.gl.p_glFlush(); /* Flush to ensure ordering across contexts. */
+            context_release(context);
+
+            buffer_clear_dirty_areas(buffer);
+            buffer->map_ptr = NULL;
+            return;
+        }
+
         buffer_bind(buffer, context);
 
         if (gl_info->supported[ARB_MAP_BUFFER_RANGE])
@@ -1345,6 +1345,11 @@ void context_release(struct wined3d_context *context)
 
     if (!--context->level)
     {
+        const struct wined3d_cs *cs = context->swapchain->device->cs;
+
+        /* Make the results visible to the command stream worker thread. */
+        if (cs && cs->thread && cs->thread_id != GetCurrentThreadId())
+            context->gl_info->gl_ops.gl.p_glFlush();
         if (context_restore_pixel_format(context))
             context->needs_set = 1;
         if (context->restore_ctx)
@@ -3524,6 +3529,14 @@ struct wined3d_context *context_acquire(const struct wined3d_device *device, str
 
     TRACE("device %p, target %p.\n", device, target);
 
+    /* GL calls made outside of the command stream have to be ordered after
+     * the commands that were queued before them. This has to wait for the
+     * whole queue, not just for the resources the caller is about to touch:
+     * the worker thread may have any of the device's contexts current, and
+     * it updates their dirty state from the queued packets. */
+    if (device->cs)
+        wined3d_cs_finish(device->cs);
+
     if (current_context && current_context->destroyed)
         current_context = NULL;
 
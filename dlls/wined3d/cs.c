@@ -26,6 +26,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(d3d);
 
 enum wined3d_cs_op
 {
+    WINED3D_CS_OP_NOP,
     WINED3D_CS_OP_PRESENT,
     WINED3D_CS_OP_CLEAR,
     WINED3D_CS_OP_DRAW,
@@ -52,10 +53,19 @@ enum wined3d_cs_op
     WINED3D_CS_OP_SET_CLIP_PLANE,
     WINED3D_CS_OP_SET_COLOR_KEY,
     WINED3D_CS_OP_SET_MATERIAL,
+    WINED3D_CS_OP_SET_LIGHT,
+    WINED3D_CS_OP_SET_LIGHT_ENABLE,
     WINED3D_CS_OP_RESET_STATE,
     WINED3D_CS_OP_DESTROY_OBJECT,
     WINED3D_CS_OP_QUERY_ISSUE,
     WINED3D_CS_OP_UNLOAD_RESOURCE,
+    WINED3D_CS_OP_PUSH_CONSTANTS,
+    WINED3D_CS_OP_STOP,
+};
+
+struct wined3d_cs_nop
+{
+    enum wined3d_cs_op opcode;
 };
 
 struct wined3d_cs_present
@@ -82,6 +92,7 @@ struct wined3d_cs_clear
 struct wined3d_cs_draw
 {
     enum wined3d_cs_op opcode;
+    GLenum primitive_type;
     int base_vertex_idx;
     unsigned int start_idx;
     unsigned int index_count;
@@ -257,6 +268,19 @@ struct wined3d_cs_set_material
     struct wined3d_material material;
 };
 
+struct wined3d_cs_set_light
+{
+    enum wined3d_cs_op opcode;
+    struct wined3d_light_info light;
+};
+
+struct wined3d_cs_set_light_enable
+{
+    enum wined3d_cs_op opcode;
+    unsigned int idx;
+    BOOL enable;
+};
+
 struct wined3d_cs_reset_state
 {
     enum wined3d_cs_op opcode;
@@ -282,6 +306,72 @@ struct wined3d_cs_unload_resource
     struct wined3d_resource *resource;
 };
 
+struct wined3d_cs_push_constants
+{
+    enum wined3d_cs_op opcode;
+    enum wined3d_push_constants type;
+    unsigned int start_idx;
+    unsigned int count;
+    BYTE constants[1];
+};
+
+struct wined3d_cs_stop
+{
+    enum wined3d_cs_op opcode;
+};
+
+static const struct
+{
+    size_t offset;
+    size_t size;
+    DWORD mask;
+}
+wined3d_cs_push_constant_info[] =
+{
+    /* WINED3D_PUSH_CONSTANTS_VS_F */
+    {FIELD_OFFSET(struct wined3d_state, vs_consts_f), sizeof(struct wined3d_vec4),  WINED3D_SHADER_CONST_VS_F},
+    /* WINED3D_PUSH_CONSTANTS_PS_F */
+    {FIELD_OFFSET(struct wined3d_state, ps_consts_f), sizeof(struct wined3d_vec4),  WINED3D_SHADER_CONST_PS_F},
+    /* WINED3D_PUSH_CONSTANTS_VS_I */
+    {FIELD_OFFSET(struct wined3d_state, vs_consts_i), sizeof(struct wined3d_ivec4), WINED3D_SHADER_CONST_VS_I},
+    /* WINED3D_PUSH_CONSTANTS_PS_I */
+    {FIELD_OFFSET(struct wined3d_state, ps_consts_i), sizeof(struct wined3d_ivec4), WINED3D_SHADER_CONST_PS_I},
+    /* WINED3D_PUSH_CONSTANTS_VS_B */
+    {FIELD_OFFSET(struct wined3d_state, vs_consts_b), sizeof(BOOL),                 WINED3D_SHADER_CONST_VS_B},
+    /* WINED3D_PUSH_CONSTANTS_PS_B */
+    {FIELD_OFFSET(struct wined3d_state, ps_consts_b), sizeof(BOOL),                 WINED3D_SHADER_CONST_PS_B},
+};
+
+/* Called by the application thread to wait for the worker thread to move
+ * the tail of the queue past "tail". Like the worker thread, spin for a
+ * while before blocking on an event. */
+static void wined3d_cs_mt_wait_tail(struct wined3d_cs *cs, LONG tail, unsigned int *spin_count)
+{
+    if (++*spin_count < WINED3D_CS_SPIN_COUNT)
+    {
+        wined3d_pause();
+        return;
+    }
+    *spin_count = 0;
+
+    InterlockedExchange(&cs->app_waiting_for_event, TRUE);
+
+    /* The worker thread may have moved the tail between the caller's check
+     * and setting the flag, in which case it may or may not have signalled
+     * the event. A spurious wakeup is harmless. */
+    if (cs->queue->tail != tail)
+    {
+        InterlockedExchange(&cs->app_waiting_for_event, FALSE);
+        return;
+    }
+
+    WaitForSingleObject(cs->app_event, INFINITE);
+}
+
+static void wined3d_cs_exec_nop(struct wined3d_cs *cs, const void *data)
+{
+}
+
 static void wined3d_cs_exec_present(struct wined3d_cs *cs, const void *data)
 {
     const struct wined3d_cs_present *op = data;
@@ -298,6 +388,8 @@ static void wined3d_cs_exec_present(struct wined3d_cs *cs, const void *data)
     {
         wined3d_resource_release(&swapchain->back_buffers[i]->resource);
     }
+
+    InterlockedDecrement(&cs->pending_presents);
 }
 
 void wined3d_cs_emit_present(struct wined3d_cs *cs, struct wined3d_swapchain *swapchain,
@@ -320,7 +412,27 @@ void wined3d_cs_emit_present(struct wined3d_cs *cs, struct wined3d_swapchain *sw
         wined3d_resource_acquire(&swapchain->back_buffers[i]->resource);
     }
 
+    InterlockedIncrement(&cs->pending_presents);
+
     cs->ops->submit(cs);
+
+    /* Don't let the application get more than one frame ahead of the worker
+     * thread, to limit input latency and the size of the queue. The worker
+     * thread decrements the count before moving the tail past the present,
+     * so waiting for the tail to move can't miss the decrement. */
+    if (cs->queue)
+    {
+        unsigned int spin_count = 0;
+        LONG tail;
+
+        for (;;)
+        {
+            tail = cs->queue->tail;
+            if (cs->pending_presents <= 1)
+                break;
+            wined3d_cs_mt_wait_tail(cs, tail, &spin_count);
+        }
+    }
 }
 
 static void wined3d_cs_exec_clear(struct wined3d_cs *cs, const void *data)
@@ -332,10 +444,10 @@ static void wined3d_cs_exec_clear(struct wined3d_cs *cs, const void *data)
     RECT draw_rect;
 
     device = cs->device;
-    state = &device->state;
+    state = &cs->state;
     wined3d_get_draw_rect(state, &draw_rect);
     device_clear_render_targets(device, device->adapter->gl_info.limits.buffers,
-            &device->fb, op->rect_count, op->rects, &draw_rect, op->flags,
+            &cs->fb, op->rect_count, op->rects, &draw_rect, op->flags,
             &op->color, op->depth, op->stencil);
 
     if (op->flags & WINED3DCLEAR_TARGET)
@@ -382,13 +494,20 @@ void wined3d_cs_emit_clear(struct wined3d_cs *cs, DWORD rect_count, const RECT *
 
 static void wined3d_cs_exec_draw(struct wined3d_cs *cs, const void *data)
 {
-    struct wined3d_state *state = &cs->device->state;
+    struct wined3d_state *state = &cs->state;
     struct wined3d_shader_sampler_map_entry *entry;
     struct wined3d_shader_resource_view *view;
     const struct wined3d_cs_draw *op = data;
     struct wined3d_shader *shader;
     unsigned int i, j;
 
+    if (state->gl_primitive_type != op->primitive_type)
+    {
+        if (state->gl_primitive_type == GL_POINTS || op->primitive_type == GL_POINTS)
+            device_invalidate_state(cs->device, STATE_POINT_ENABLE);
+        state->gl_primitive_type = op->primitive_type;
+    }
+
     if (!cs->device->adapter->gl_info.supported[ARB_DRAW_ELEMENTS_BASE_VERTEX]
             && state->load_base_vertex_index != op->base_vertex_idx)
     {
@@ -441,7 +560,7 @@ static void wined3d_cs_exec_draw(struct wined3d_cs *cs, const void *data)
     }
 }
 
-void wined3d_cs_emit_draw(struct wined3d_cs *cs, int base_vertex_idx, unsigned int start_idx,
+void wined3d_cs_emit_draw(struct wined3d_cs *cs, GLenum primitive_type, int base_vertex_idx, unsigned int start_idx,
         unsigned int index_count, unsigned int start_instance, unsigned int instance_count, BOOL indexed)
 {
     const struct wined3d_state *state = &cs->device->state;
@@ -453,6 +572,7 @@ void wined3d_cs_emit_draw(struct wined3d_cs *cs, int base_vertex_idx, unsigned i
 
     op = cs->ops->require_space(cs, sizeof(*op));
     op->opcode = WINED3D_CS_OP_DRAW;
+    op->primitive_type = primitive_type;
     op->base_vertex_idx = base_vertex_idx;
     op->start_idx = start_idx;
     op->index_count = index_count;
@@ -1191,6 +1311,87 @@ void wined3d_cs_emit_set_material(struct wined3d_cs *cs, const struct wined3d_ma
     cs->ops->submit(cs);
 }
 
+static void wined3d_cs_exec_set_light(struct wined3d_cs *cs, const void *data)
+{
+    const struct wined3d_cs_set_light *op = data;
+    struct wined3d_light_info *light_info;
+    unsigned int light_idx;
+
+    light_idx = op->light.OriginalIndex;
+
+    if (!(light_info = wined3d_state_get_light(&cs->state, light_idx)))
+    {
+        TRACE("Adding new light.\n");
+        if (!(light_info = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*light_info))))
+        {
+            ERR("Failed to allocate light info.\n");
+            return;
+        }
+
+        list_add_head(&cs->state.light_map[LIGHTMAP_HASHFUNC(light_idx)], &light_info->entry);
+        light_info->glIndex = -1;
+        light_info->OriginalIndex = light_idx;
+    }
+
+    if (light_info->glIndex != -1)
+    {
+        if (light_info->OriginalParms.type != op->light.OriginalParms.type)
+            device_invalidate_state(cs->device, STATE_LIGHT_TYPE);
+        device_invalidate_state(cs->device, STATE_ACTIVELIGHT(light_info->glIndex));
+    }
+
+    light_info->OriginalParms = op->light.OriginalParms;
+    light_info->position = op->light.position;
+    light_info->direction = op->light.direction;
+    light_info->exponent = op->light.exponent;
+    light_info->cutoff = op->light.cutoff;
+}
+
+void wined3d_cs_emit_set_light(struct wined3d_cs *cs, const struct wined3d_light_info *light)
+{
+    struct wined3d_cs_set_light *op;
+
+    op = cs->ops->require_space(cs, sizeof(*op));
+    op->opcode = WINED3D_CS_OP_SET_LIGHT;
+    op->light = *light;
+
+    cs->ops->submit(cs);
+}
+
+static void wined3d_cs_exec_set_light_enable(struct wined3d_cs *cs, const void *data)
+{
+    const struct wined3d_cs_set_light_enable *op = data;
+    struct wined3d_device *device = cs->device;
+    struct wined3d_light_info *light_info;
+    int prev_idx;
+
+    if (!(light_info = wined3d_state_get_light(&cs->state, op->idx)))
+    {
+        ERR("Light doesn't exist.\n");
+        return;
+    }
+
+    prev_idx = light_info->glIndex;
+    wined3d_state_enable_light(&cs->state, &device->adapter->gl_info, light_info, op->enable);
+    if (light_info->glIndex != prev_idx)
+    {
+        device_invalidate_state(device, STATE_LIGHT_TYPE);
+        device_invalidate_state(device, STATE_ACTIVELIGHT(op->enable ? light_info->glIndex : prev_idx));
+    }
+}
+
+void wined3d_cs_emit_set_light_enable(struct wined3d_cs *cs, unsigned int idx, BOOL enable)
+{
+    struct wined3d_cs_set_light_enable *op;
+
+    op = cs->ops->require_space(cs, sizeof(*op));
+    op->opcode = WINED3D_CS_OP_SET_LIGHT_ENABLE;
+    op->idx = idx;
+    op->enable = enable;
+
+    cs->ops->submit(cs);
+}
+
 static void wined3d_cs_exec_reset_state(struct wined3d_cs *cs, const void *data)
 {
     struct wined3d_adapter *adapter = cs->device->adapter;
@@ -1272,8 +1473,54 @@ void wined3d_cs_emit_unload_resource(struct wined3d_cs *cs, struct wined3d_resou
     cs->ops->submit(cs);
 }
 
+static void wined3d_cs_st_push_constants(struct wined3d_cs *cs, enum wined3d_push_constants p,
+        unsigned int start_idx, unsigned int count, const void *constants)
+{
+    struct wined3d_device *device = cs->device;
+    unsigned int context_count;
+    unsigned int i;
+    size_t offset;
+
+    if (p == WINED3D_PUSH_CONSTANTS_VS_F)
+        device->shader_backend->shader_update_float_vertex_constants(device, start_idx, count);
+    else if (p == WINED3D_PUSH_CONSTANTS_PS_F)
+        device->shader_backend->shader_update_float_pixel_constants(device, start_idx, count);
+
+    offset = wined3d_cs_push_constant_info[p].offset + start_idx * wined3d_cs_push_constant_info[p].size;
+    memcpy((BYTE *)&cs->state + offset, constants, count * wined3d_cs_push_constant_info[p].size);
+    for (i = 0, context_count = device->context_count; i < context_count; ++i)
+    {
+        device->contexts[i]->constant_update_mask |= wined3d_cs_push_constant_info[p].mask;
+    }
+}
+
+static void wined3d_cs_exec_push_constants(struct wined3d_cs *cs, const void *data)
+{
+    const struct wined3d_cs_push_constants *op = data;
+
+    wined3d_cs_st_push_constants(cs, op->type, op->start_idx, op->count, op->constants);
+}
+
+static void wined3d_cs_mt_push_constants(struct wined3d_cs *cs, enum wined3d_push_constants p,
+        unsigned int start_idx, unsigned int count, const void *constants)
+{
+    struct wined3d_cs_push_constants *op;
+    size_t size;
+
+    size = count * wined3d_cs_push_constant_info[p].size;
+    op = cs->ops->require_space(cs, FIELD_OFFSET(struct wined3d_cs_push_constants, constants[size]));
+    op->opcode = WINED3D_CS_OP_PUSH_CONSTANTS;
+    op->type = p;
+    op->start_idx = start_idx;
+    op->count = count;
+    memcpy(op->constants, constants, size);
+
+    cs->ops->submit(cs);
+}
+
 static void (* const wined3d_cs_op_handlers[])(struct wined3d_cs *cs, const void *data) =
 {
+    /* WINED3D_CS_OP_NOP                        */ wined3d_cs_exec_nop,
     /* WINED3D_CS_OP_PRESENT                    */ wined3d_cs_exec_present,
     /* WINED3D_CS_OP_CLEAR                      */ wined3d_cs_exec_clear,
     /* WINED3D_CS_OP_DRAW                       */ wined3d_cs_exec_draw,
@@ -1300,10 +1547,13 @@ static void (* const wined3d_cs_op_handlers[])(struct wined3d_cs *cs, const void
     /* WINED3D_CS_OP_SET_CLIP_PLANE             */ wined3d_cs_exec_set_clip_plane,
     /* WINED3D_CS_OP_SET_COLOR_KEY              */ wined3d_cs_exec_set_color_key,
     /* WINED3D_CS_OP_SET_MATERIAL               */ wined3d_cs_exec_set_material,
+    /* WINED3D_CS_OP_SET_LIGHT                  */ wined3d_cs_exec_set_light,
+    /* WINED3D_CS_OP_SET_LIGHT_ENABLE           */ wined3d_cs_exec_set_light_enable,
     /* WINED3D_CS_OP_RESET_STATE                */ wined3d_cs_exec_reset_state,
     /* WINED3D_CS_OP_DESTROY_OBJECT             */ wined3d_cs_exec_destroy_object,
     /* WINED3D_CS_OP_QUERY_ISSUE                */ wined3d_cs_exec_query_issue,
     /* WINED3D_CS_OP_UNLOAD_RESOURCE            */ wined3d_cs_exec_unload_resource,
+    /* WINED3D_CS_OP_PUSH_CONSTANTS             */ wined3d_cs_exec_push_constants,
 };
 
 static void *wined3d_cs_st_require_space(struct wined3d_cs *cs, size_t size)
@@ -1330,56 +1580,215 @@ static void wined3d_cs_st_submit(struct wined3d_cs *cs)
     wined3d_cs_op_handlers[opcode](cs, cs->data);
 }
 
-static void wined3d_cs_st_push_constants(struct wined3d_cs *cs, enum wined3d_push_constants p,
-        unsigned int start_idx, unsigned int count, const void *constants)
+static void wined3d_cs_st_finish(struct wined3d_cs *cs)
 {
-    struct wined3d_device *device = cs->device;
-    unsigned int context_count;
-    unsigned int i;
-    size_t offset;
+}
+
+static const struct wined3d_cs_ops wined3d_cs_st_ops =
+{
+    wined3d_cs_st_require_space,
+    wined3d_cs_st_submit,
+    wined3d_cs_st_finish,
+    wined3d_cs_st_push_constants,
+};
+
+/* The multithreaded command stream. The application thread writes packets
+ * to a ring buffer, and the worker thread executes them, making all the GL
+ * calls of the command stream on its own contexts. Only the application
+ * thread writes the head of the queue, and only the worker thread writes the
+ * tail, so no locking is needed. Packets queued by the worker thread itself,
+ * e.g. while destroying an object, are executed immediately. */
+static void wined3d_cs_mt_submit(struct wined3d_cs *cs)
+{
+    struct wined3d_cs_queue *queue = cs->queue;
+    struct wined3d_cs_packet *packet;
 
-    static const struct
+    if (cs->thread_id == GetCurrentThreadId())
     {
-        size_t offset;
-        size_t size;
-        DWORD mask;
+        wined3d_cs_st_submit(cs);
+        return;
     }
-    push_constant_info[] =
+
+    packet = (struct wined3d_cs_packet *)&queue->data[queue->head];
+    InterlockedExchange(&queue->head, (queue->head + packet->size) & WINED3D_CS_QUEUE_MASK);
+
+    if (InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
+        SetEvent(cs->event);
+}
+
+static BOOL wined3d_cs_queue_has_space(const struct wined3d_cs_queue *queue, size_t size)
+{
+    size_t used = (queue->head - queue->tail) & WINED3D_CS_QUEUE_MASK;
+
+    /* The head may never catch up with the tail, an empty queue would be
+     * indistinguishable from a full one. */
+    return used + size < WINED3D_CS_QUEUE_SIZE;
+}
+
+static void *wined3d_cs_mt_require_space(struct wined3d_cs *cs, size_t size)
+{
+    struct wined3d_cs_queue *queue = cs->queue;
+    struct wined3d_cs_packet *packet;
+    size_t packet_size, remaining;
+    unsigned int spin_count;
+    LONG tail;
+
+    if (cs->thread_id == GetCurrentThreadId())
+        return wined3d_cs_st_require_space(cs, size);
+
+    /* Keep the packets aligned, this also guarantees that there's always room
+     * for at least a nop packet at the end of the queue. */
+    packet_size = (FIELD_OFFSET(struct wined3d_cs_packet, data[size]) + 15) & ~15;
+    if (packet_size >= WINED3D_CS_QUEUE_SIZE)
     {
-        /* WINED3D_PUSH_CONSTANTS_VS_F */
-        {FIELD_OFFSET(struct wined3d_state, vs_consts_f), sizeof(struct wined3d_vec4),  WINED3D_SHADER_CONST_VS_F},
-        /* WINED3D_PUSH_CONSTANTS_PS_F */
-        {FIELD_OFFSET(struct wined3d_state, ps_consts_f), sizeof(struct wined3d_vec4),  WINED3D_SHADER_CONST_PS_F},
-        /* WINED3D_PUSH_CONSTANTS_VS_I */
-        {FIELD_OFFSET(struct wined3d_state, vs_consts_i), sizeof(struct wined3d_ivec4), WINED3D_SHADER_CONST_VS_I},
-        /* WINED3D_PUSH_CONSTANTS_PS_I */
-        {FIELD_OFFSET(struct wined3d_state, ps_consts_i), sizeof(struct wined3d_ivec4), WINED3D_SHADER_CONST_PS_I},
-        /* WINED3D_PUSH_CONSTANTS_VS_B */
-        {FIELD_OFFSET(struct wined3d_state, vs_consts_b), sizeof(BOOL),                 WINED3D_SHADER_CONST_VS_B},
-        /* WINED3D_PUSH_CONSTANTS_PS_B */
-        {FIELD_OFFSET(struct wined3d_state, ps_consts_b), sizeof(BOOL),                 WINED3D_SHADER_CONST_PS_B},
-    };
+        ERR("Packet size %lu >= queue size %u.\n", (unsigned long)packet_size, WINED3D_CS_QUEUE_SIZE);
+        return NULL;
+    }
 
-    if (p == WINED3D_PUSH_CONSTANTS_VS_F)
-        device->shader_backend->shader_update_float_vertex_constants(device, start_idx, count);
-    else if (p == WINED3D_PUSH_CONSTANTS_PS_F)
-        device->shader_backend->shader_update_float_pixel_constants(device, start_idx, count);
+    remaining = WINED3D_CS_QUEUE_SIZE - queue->head;
+    if (remaining < packet_size)
+    {
+        struct wined3d_cs_nop *nop;
 
-    offset = push_constant_info[p].offset + start_idx * push_constant_info[p].size;
-    memcpy((BYTE *)&cs->state + offset, constants, count * push_constant_info[p].size);
-    for (i = 0, context_count = device->context_count; i < context_count; ++i)
+        TRACE("Inserting a nop of %lu bytes.\n", (unsigned long)remaining);
+
+        nop = wined3d_cs_mt_require_space(cs, remaining - FIELD_OFFSET(struct wined3d_cs_packet, data[0]));
+        nop->opcode = WINED3D_CS_OP_NOP;
+        wined3d_cs_mt_submit(cs);
+    }
+
+    for (spin_count = 0;;)
     {
-        device->contexts[i]->constant_update_mask |= push_constant_info[p].mask;
+        tail = queue->tail;
+        if (wined3d_cs_queue_has_space(queue, packet_size))
+            break;
+        wined3d_cs_mt_wait_tail(cs, tail, &spin_count);
     }
+
+    packet = (struct wined3d_cs_packet *)&queue->data[queue->head];
+    packet->size = packet_size;
+    return packet->data;
 }
 
-static const struct wined3d_cs_ops wined3d_cs_st_ops =
+static void wined3d_cs_mt_finish(struct wined3d_cs *cs)
 {
-    wined3d_cs_st_require_space,
-    wined3d_cs_st_submit,
-    wined3d_cs_st_push_constants,
+    unsigned int spin_count = 0;
+    LONG tail;
+
+    if (cs->thread_id == GetCurrentThreadId())
+        return;
+
+    while ((tail = cs->queue->tail) != cs->queue->head)
+        wined3d_cs_mt_wait_tail(cs, tail, &spin_count);
+}
+
+static const struct wined3d_cs_ops wined3d_cs_mt_ops =
+{
+    wined3d_cs_mt_require_space,
+    wined3d_cs_mt_submit,
+    wined3d_cs_mt_finish,
+    wined3d_cs_mt_push_constants,
 };
 
+static void wined3d_cs_flush_context(void)
+{
+    struct wined3d_context *context = context_get_current();
+
+    /* Commands issued on the worker thread's context have to reach the
+     * driver before another context can depend on their results. */
+    if (context && !context->destroyed)
+        context->gl_info->gl_ops.gl.p_glFlush();
+}
+
+static void wined3d_cs_wait_event(struct wined3d_cs *cs)
+{
+    InterlockedExchange(&cs->waiting_for_event, TRUE);
+
+    /* The application thread may have queued a packet between our last check
+     * of the queue and setting the flag, in which case it may or may not
+     * have signalled the event. A spurious wakeup is harmless. */
+    if (cs->queue->head != cs->queue->tail)
+    {
+        InterlockedExchange(&cs->waiting_for_event, FALSE);
+        return;
+    }
+
+    WaitForSingleObject(cs->event, INFINITE);
+}
+
+static DWORD WINAPI wined3d_cs_run(void *ctx)
+{
+    struct wined3d_cs *cs = ctx;
+    struct wined3d_cs_queue *queue = cs->queue;
+    struct wined3d_cs_packet *packet;
+    unsigned int spin_count = 0;
+    enum wined3d_cs_op opcode;
+    LONG tail;
+
+    TRACE("Started.\n");
+
+    for (;;)
+    {
+        tail = queue->tail;
+        if (tail == queue->head)
+        {
+            if (++spin_count >= WINED3D_CS_SPIN_COUNT)
+            {
+                wined3d_cs_wait_event(cs);
+                spin_count = 0;
+            }
+            else
+            {
+                wined3d_pause();
+            }
+            continue;
+        }
+        spin_count = 0;
+
+        packet = (struct wined3d_cs_packet *)&queue->data[tail];
+        opcode = *(const enum wined3d_cs_op *)packet->data;
+
+        if (opcode == WINED3D_CS_OP_STOP)
+        {
+            InterlockedExchange(&queue->tail, (tail + packet->size) & WINED3D_CS_QUEUE_MASK);
+            break;
+        }
+
+        if (opcode > WINED3D_CS_OP_STOP)
+            ERR("Invalid opcode %#x.\n", opcode);
+        else
+            wined3d_cs_op_handlers[opcode](cs, packet->data);
+
+        tail = (tail + packet->size) & WINED3D_CS_QUEUE_MASK;
+        if (tail == queue->head)
+            wined3d_cs_flush_context();
+        InterlockedExchange(&queue->tail, tail);
+
+        if (InterlockedCompareExchange(&cs->app_waiting_for_event, FALSE, TRUE))
+            SetEvent(cs->app_event);
+    }
+
+    wined3d_cs_flush_context();
+    context_set_current(NULL);
+
+    TRACE("Stopped.\n");
+    return 0;
+}
+
+static void wined3d_cs_stop(struct wined3d_cs *cs)
+{
+    struct wined3d_cs_stop *op;
+
+    op = cs->ops->require_space(cs, sizeof(*op));
+    op->opcode = WINED3D_CS_OP_STOP;
+    cs->ops->submit(cs);
+
+    WaitForSingleObject(cs->thread, INFINITE);
+    CloseHandle(cs->thread);
+    cs->thread = NULL;
+    cs->thread_id = 0;
+}
+
 struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
 {
     const struct wined3d_gl_info *gl_info = &device->adapter->gl_info;
@@ -1409,11 +1818,48 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
         return NULL;
     }
 
+    if (wined3d_settings.cs_multithreaded)
+    {
+        if (!(cs->queue = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cs->queue))))
+            ERR("Failed to allocate the command stream queue.\n");
+        else if (!(cs->event = CreateEventW(NULL, FALSE, FALSE, NULL)))
+            ERR("Failed to create the command stream event, last error %#x.\n", GetLastError());
+        else if (!(cs->app_event = CreateEventW(NULL, FALSE, FALSE, NULL)))
+            ERR("Failed to create the application event, last error %#x.\n", GetLastError());
+        else if (!(cs->thread = CreateThread(NULL, 0, wined3d_cs_run, cs, 0, &cs->thread_id)))
+            ERR("Failed to create the command stream thread, last error %#x.\n", GetLastError());
+
+        if (cs->thread)
+        {
+            TRACE("Using the multithreaded command stream, thread %04x.\n", cs->thread_id);
+            cs->ops = &wined3d_cs_mt_ops;
+        }
+        else
+        {
+            if (cs->event)
+                CloseHandle(cs->event);
+            cs->event = NULL;
+            if (cs->app_event)
+                CloseHandle(cs->app_event);
+            cs->app_event = NULL;
+            HeapFree(GetProcessHeap(), 0, cs->queue);
+            cs->queue = NULL;
+        }
+    }
+
     return cs;
 }
 
 void wined3d_cs_destroy(struct wined3d_cs *cs)
 {
+    if (cs->thread)
+    {
+        wined3d_cs_stop(cs);
+        CloseHandle(cs->event);
+        CloseHandle(cs->app_event);
+        HeapFree(GetProcessHeap(), 0, cs->queue);
+    }
+
     state_cleanup(&cs->state);
     HeapFree(GetProcessHeap(), 0, cs->fb.render_targets);
     HeapFree(GetProcessHeap(), 0, cs->data);
@@ -42,6 +42,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d_shader);
 WINE_DECLARE_DEBUG_CHANNEL(d3d);
+WINE_DECLARE_DEBUG_CHANNEL(d3d_perf);
 WINE_DECLARE_DEBUG_CHANNEL(winediag);
 
 #define WINED3D_GLSL_SAMPLE_PROJECTED   0x01
@@ -93,6 +94,53 @@ struct constant_heap
     unsigned int size;
 };
 
+#define GLSL_PROGRAM_CACHE_MAGIC    0x43505357  /* "WSPC" */
+#define GLSL_PROGRAM_CACHE_VERSION  1
+
+/* Layout of the persistent program binary cache file: a header, followed by
+ * records made of a glsl_program_cache_record and the program binary. */
+struct glsl_program_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    UINT64 driver_hash;
+};
+
+struct glsl_program_cache_record
+{
+    UINT64 key;
+    DWORD format;
+    DWORD size;
+    DWORD checksum;
+    DWORD reserved;
+};
+
+struct glsl_program_cache_entry
+{
+    struct wine_rb_entry entry;
+    UINT64 key;
+    GLenum format;
+    DWORD size;
+    DWORD checksum;
+    DWORD offset;   /* 0 if the program can't be loaded */
+};
+
+struct glsl_program_cache
+{
+    BOOL initialized;
+    HANDLE file;
+    UINT64 driver_hash;
+    struct wine_rb_tree entries;
+    DWORD file_size;
+    DWORD max_size;
+
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int failures;
+    LONGLONG link_time;
+    LONGLONG load_time;
+};
+
 /* GLSL shader private data */
 struct shader_glsl_priv {
     struct wined3d_string_buffer shader_buffer;
@@ -111,6 +159,8 @@ struct shader_glsl_priv {
     struct wine_rb_tree ffp_fragment_shaders;
     BOOL ffp_proj_control;
     BOOL legacy_lighting;
+
+    struct glsl_program_cache program_cache;
 };
 
 struct glsl_vs_program
@@ -5401,6 +5451,433 @@ static void delete_glsl_program_entry(struct shader_glsl_priv *priv, const struc
     HeapFree(GetProcessHeap(), 0, entry);
 }
 
+static UINT64 glsl_program_cache_hash(UINT64 hash, const void *data, size_t size)
+{
+    const BYTE *ptr = data;
+
+    /* 64-bit FNV-1a */
+    while (size--)
+    {
+        hash ^= *ptr++;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static int glsl_program_cache_compare(const void *key, const struct wine_rb_entry *entry)
+{
+    const struct glsl_program_cache_entry *e = WINE_RB_ENTRY_VALUE(entry, const struct glsl_program_cache_entry, entry);
+    UINT64 k = *(const UINT64 *)key;
+
+    if (k > e->key) return 1;
+    if (k < e->key) return -1;
+    return 0;
+}
+
+static const struct wine_rb_functions glsl_program_cache_rb_functions =
+{
+    wined3d_rb_alloc,
+    wined3d_rb_realloc,
+    wined3d_rb_free,
+    glsl_program_cache_compare,
+};
+
+static void glsl_program_cache_add_entry(struct glsl_program_cache *cache,
+        const struct glsl_program_cache_record *record, DWORD offset)
+{
+    struct glsl_program_cache_entry *entry;
+
+    if (wine_rb_get(&cache->entries, &record->key))
+        return;
+    if (!(entry = HeapAlloc(GetProcessHeap(), 0, sizeof(*entry))))
+        return;
+    entry->key = record->key;
+    entry->format = record->format;
+    entry->size = record->size;
+    entry->checksum = record->checksum;
+    entry->offset = offset;
+    if (wine_rb_put(&cache->entries, &entry->key, &entry->entry) == -1)
+        HeapFree(GetProcessHeap(), 0, entry);
+}
+
+static void glsl_program_cache_free_entry(struct wine_rb_entry *entry, void *context)
+{
+    HeapFree(GetProcessHeap(), 0, WINE_RB_ENTRY_VALUE(entry, struct glsl_program_cache_entry, entry));
+}
+
+static BOOL glsl_program_cache_read(HANDLE file, DWORD offset, void *data, DWORD size)
+{
+    OVERLAPPED ovl;
+    DWORD count;
+
+    memset(&ovl, 0, sizeof(ovl));
+    ovl.u.s.Offset = offset;
+    return ReadFile(file, data, size, &count, &ovl) && count == size;
+}
+
+static DWORD glsl_program_cache_checksum(const void *data, DWORD size)
+{
+    UINT64 hash = glsl_program_cache_hash(0xcbf29ce484222325ull, data, size);
+
+    return (DWORD)(hash ^ (hash >> 32));
+}
+
+/* The cache file can be shared by several processes. Writers are serialized
+ * by locking a byte that is past any valid data, so that readers aren't
+ * blocked. */
+static BOOL glsl_program_cache_lock(HANDLE file)
+{
+    OVERLAPPED ovl;
+
+    memset(&ovl, 0, sizeof(ovl));
+    ovl.u.s.OffsetHigh = 1;
+    return LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ovl);
+}
+
+static void glsl_program_cache_unlock(HANDLE file)
+{
+    OVERLAPPED ovl;
+
+    memset(&ovl, 0, sizeof(ovl));
+    ovl.u.s.OffsetHigh = 1;
+    UnlockFileEx(file, 0, 1, 0, &ovl);
+}
+
+/* Index the records between "start" and "end". Records with a bad checksum,
+ * typically left by a process that crashed while writing them, are skipped. */
+static void glsl_program_cache_index(struct glsl_program_cache *cache, HANDLE file, DWORD start, DWORD end)
+{
+    struct glsl_program_cache_record record;
+    DWORD offset, buffer_size = 0;
+    void *buffer = NULL, *tmp;
+
+    for (offset = start; offset + sizeof(record) <= end; offset += sizeof(record) + record.size)
+    {
+        if (!glsl_program_cache_read(file, offset, &record, sizeof(record))
+                || record.size > end - offset - sizeof(record))
+            break;
+        if (wine_rb_get(&cache->entries, &record.key))
+            continue;
+        if (record.size > buffer_size)
+        {
+            if (!(tmp = buffer ? HeapReAlloc(GetProcessHeap(), 0, buffer, record.size)
+                    : HeapAlloc(GetProcessHeap(), 0, record.size)))
+                break;
+            buffer = tmp;
+            buffer_size = record.size;
+        }
+        if (!glsl_program_cache_read(file, offset + sizeof(record), buffer, record.size)
+                || glsl_program_cache_checksum(buffer, record.size) != record.checksum)
+        {
+            TRACE("Skipping invalid record at offset %#x.\n", offset);
+            continue;
+        }
+        glsl_program_cache_add_entry(cache, &record, offset + sizeof(record));
+    }
+    HeapFree(GetProcessHeap(), 0, buffer);
+}
+
+/* Open the cache file of the current driver, and index the programs it
+ * contains. The file is discarded if it is invalid or too large.
+ * Context activation is done by the caller. */
+static void glsl_program_cache_init(const struct wined3d_gl_info *gl_info, struct glsl_program_cache *cache)
+{
+    static const WCHAR localappdataW[] = {'L','O','C','A','L','A','P','P','D','A','T','A',0};
+    static const WCHAR dirW[] = {'\\','w','i','n','e','d','3','d',0};
+    static const WCHAR fileW[] = {'\\','g','l','s','l','-','%','0','8','x','%','0','8','x','.','b','i','n',0};
+    static const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    struct glsl_program_cache_header header;
+    WCHAR path[MAX_PATH];
+    const char *str;
+    GLint format_count = 0;
+    OVERLAPPED ovl;
+    unsigned int i;
+    HANDLE file;
+    DWORD len;
+
+    cache->initialized = TRUE;
+    cache->file = INVALID_HANDLE_VALUE;
+
+    if (!wined3d_settings.shader_cache_size || !gl_info->supported[ARB_GET_PROGRAM_BINARY])
+        return;
+    gl_info->gl_ops.gl.p_glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    if (!format_count)
+    {
+        TRACE("The driver doesn't support any program binary format.\n");
+        return;
+    }
+
+    cache->driver_hash = 0xcbf29ce484222325ull;
+    for (i = 0; i < sizeof(strings) / sizeof(*strings); ++i)
+    {
+        if (!(str = (const char *)gl_info->gl_ops.gl.p_glGetString(strings[i])))
+            return;
+        cache->driver_hash = glsl_program_cache_hash(cache->driver_hash, str, strlen(str) + 1);
+    }
+
+    len = GetEnvironmentVariableW(localappdataW, path, MAX_PATH);
+    if (!len || len + strlenW(dirW) + 32 > MAX_PATH)
+        return;
+    strcatW(path, dirW);
+    CreateDirectoryW(path, NULL);
+    sprintfW(path + strlenW(path), fileW, (DWORD)(cache->driver_hash >> 32), (DWORD)cache->driver_hash);
+
+    file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to open %s, last error %#x.\n", debugstr_w(path), GetLastError());
+        return;
+    }
+    if (!glsl_program_cache_lock(file))
+    {
+        WARN("Failed to lock %s, last error %#x.\n", debugstr_w(path), GetLastError());
+        CloseHandle(file);
+        return;
+    }
+
+    wine_rb_init(&cache->entries, &glsl_program_cache_rb_functions);
+    cache->max_size = min(wined3d_settings.shader_cache_size, 2047) * 1024 * 1024;
+    cache->file_size = GetFileSize(file, NULL);
+
+    if (cache->file_size == INVALID_FILE_SIZE || cache->file_size > cache->max_size
+            || (cache->file_size && (!glsl_program_cache_read(file, 0, &header, sizeof(header))
+            || header.magic != GLSL_PROGRAM_CACHE_MAGIC || header.version != GLSL_PROGRAM_CACHE_VERSION
+            || header.driver_hash != cache->driver_hash)))
+    {
+        TRACE("Discarding %s.\n", debugstr_w(path));
+        cache->file_size = 0;
+    }
+
+    if (!cache->file_size)
+    {
+        header.magic = GLSL_PROGRAM_CACHE_MAGIC;
+        header.version = GLSL_PROGRAM_CACHE_VERSION;
+        header.driver_hash = cache->driver_hash;
+        memset(&ovl, 0, sizeof(ovl));
+        if (!WriteFile(file, &header, sizeof(header), &len, &ovl) || len != sizeof(header)
+                || SetFilePointer(file, sizeof(header), NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER
+                || !SetEndOfFile(file))
+        {
+            glsl_program_cache_unlock(file);
+            wine_rb_destroy(&cache->entries, glsl_program_cache_free_entry, NULL);
+            CloseHandle(file);
+            return;
+        }
+        cache->file_size = sizeof(header);
+    }
+
+    glsl_program_cache_index(cache, file, sizeof(header), cache->file_size);
+    glsl_program_cache_unlock(file);
+
+    TRACE("Opened %s, %u bytes.\n", debugstr_w(path), cache->file_size);
+    cache->file = file;
+}
+
+static void glsl_program_cache_cleanup(struct glsl_program_cache *cache)
+{
+    if (cache->file == INVALID_HANDLE_VALUE)
+        return;
+
+    TRACE_(d3d_perf)("Program cache: %u hits, %u misses, %u failures, %s ms linking, %s ms loading.\n",
+            cache->hits, cache->misses, cache->failures,
+            wine_dbgstr_longlong(cache->link_time / 1000), wine_dbgstr_longlong(cache->load_time / 1000));
+    if (cache->misses && cache->hits)
+        TRACE_(d3d_perf)("Estimated link time saved: %s ms.\n",
+                wine_dbgstr_longlong((cache->link_time / cache->misses * cache->hits - cache->load_time) / 1000));
+
+    wine_rb_destroy(&cache->entries, glsl_program_cache_free_entry, NULL);
+    CloseHandle(cache->file);
+    cache->file = INVALID_HANDLE_VALUE;
+}
+
+static LONGLONG glsl_program_cache_elapsed(const LARGE_INTEGER *start)
+{
+    LARGE_INTEGER end, freq;
+
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&freq);
+    return (end.QuadPart - start->QuadPart) * 1000000 / freq.QuadPart;
+}
+
+/* Compute the cache key of a program from the source of its attached shaders.
+ * The generated GLSL covers the shader bytecode and the compile arguments.
+ * Context activation is done by the caller. */
+static UINT64 glsl_program_cache_get_key(const struct wined3d_gl_info *gl_info,
+        const struct glsl_program_cache *cache, GLuint program_id, const void *params, size_t params_size)
+{
+    UINT64 key, hashes[8], tmp;
+    GLint count = 0, length;
+    GLuint shaders[8];
+    unsigned int i, j;
+    char *source;
+
+    GL_EXTCALL(glGetAttachedShaders(program_id, sizeof(shaders) / sizeof(*shaders), &count, shaders));
+    for (i = 0; i < count; ++i)
+    {
+        length = 0;
+        GL_EXTCALL(glGetShaderiv(shaders[i], GL_SHADER_SOURCE_LENGTH, &length));
+        if (!length || !(source = HeapAlloc(GetProcessHeap(), 0, length)))
+            return 0;
+        GL_EXTCALL(glGetShaderSource(shaders[i], length, NULL, source));
+        hashes[i] = glsl_program_cache_hash(0xcbf29ce484222325ull, source, length);
+        HeapFree(GetProcessHeap(), 0, source);
+    }
+    checkGLcall("get program sources");
+
+    /* The order of the attached shaders isn't guaranteed. */
+    for (i = 1; i < count; ++i)
+    {
+        for (j = i; j && hashes[j - 1] > hashes[j]; --j)
+        {
+            tmp = hashes[j];
+            hashes[j] = hashes[j - 1];
+            hashes[j - 1] = tmp;
+        }
+    }
+
+    key = glsl_program_cache_hash(cache->driver_hash, hashes, count * sizeof(*hashes));
+    return glsl_program_cache_hash(key, params, params_size);
+}
+
+/* Context activation is done by the caller. */
+static BOOL glsl_program_cache_load(const struct wined3d_gl_info *gl_info,
+        struct glsl_program_cache *cache, GLuint program_id, UINT64 key)
+{
+    struct glsl_program_cache_entry *entry;
+    struct wine_rb_entry *rb_entry;
+    GLint status = GL_FALSE;
+    void *binary;
+
+    if (!(rb_entry = wine_rb_get(&cache->entries, &key)))
+        return FALSE;
+    entry = WINE_RB_ENTRY_VALUE(rb_entry, struct glsl_program_cache_entry, entry);
+    if (!entry->offset || !(binary = HeapAlloc(GetProcessHeap(), 0, entry->size)))
+        return FALSE;
+
+    if (glsl_program_cache_read(cache->file, entry->offset, binary, entry->size)
+            && glsl_program_cache_checksum(binary, entry->size) == entry->checksum)
+    {
+        GL_EXTCALL(glProgramBinary(program_id, entry->format, binary, entry->size));
+        GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+        checkGLcall("glProgramBinary");
+    }
+    HeapFree(GetProcessHeap(), 0, binary);
+
+    if (status != GL_TRUE)
+    {
+        /* Typically a driver update that didn't change the version string.
+         * Don't try to load this program again. */
+        TRACE("Failed to load program %s from the cache.\n", wine_dbgstr_longlong(key));
+        entry->offset = 0;
+        ++cache->failures;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Context activation is done by the caller. */
+static void glsl_program_cache_store(const struct wined3d_gl_info *gl_info,
+        struct glsl_program_cache *cache, GLuint program_id, UINT64 key)
+{
+    struct glsl_program_cache_record record;
+    GLint length = 0, status = GL_FALSE;
+    DWORD count = 0, size;
+    OVERLAPPED ovl;
+    GLenum format;
+    void *binary;
+
+    GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+    GL_EXTCALL(glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (status != GL_TRUE || length <= 0)
+        return;
+    if (cache->file_size + sizeof(record) + length > cache->max_size)
+    {
+        TRACE("Program cache is full.\n");
+        return;
+    }
+    if (!(binary = HeapAlloc(GetProcessHeap(), 0, sizeof(record) + length)))
+        return;
+
+    GL_EXTCALL(glGetProgramBinary(program_id, length, &length, &format, (BYTE *)binary + sizeof(record)));
+    checkGLcall("glGetProgramBinary");
+
+    record.key = key;
+    record.format = format;
+    record.size = length;
+    record.checksum = glsl_program_cache_checksum((BYTE *)binary + sizeof(record), length);
+    record.reserved = 0;
+    memcpy(binary, &record, sizeof(record));
+
+    /* Other processes may have appended programs since the file was indexed. */
+    if (!glsl_program_cache_lock(cache->file))
+    {
+        HeapFree(GetProcessHeap(), 0, binary);
+        return;
+    }
+    if ((size = GetFileSize(cache->file, NULL)) != INVALID_FILE_SIZE && size >= cache->file_size)
+    {
+        glsl_program_cache_index(cache, cache->file, cache->file_size, size);
+        cache->file_size = size;
+
+        if (wine_rb_get(&cache->entries, &key))
+            TRACE("Program %s was stored by another process.\n", wine_dbgstr_longlong(key));
+        else if (cache->file_size + sizeof(record) + length > cache->max_size)
+            TRACE("Program cache is full.\n");
+        else
+        {
+            memset(&ovl, 0, sizeof(ovl));
+            ovl.u.s.Offset = cache->file_size;
+            if (WriteFile(cache->file, binary, sizeof(record) + length, &count, &ovl)
+                    && count == sizeof(record) + length)
+                glsl_program_cache_add_entry(cache, &record, cache->file_size + sizeof(record));
+            cache->file_size += count;
+        }
+    }
+    glsl_program_cache_unlock(cache->file);
+    HeapFree(GetProcessHeap(), 0, binary);
+}
+
+/* Link a program, or load it from the persistent cache. The parameters are
+ * the link state that isn't part of the shader sources.
+ * Context activation is done by the caller. */
+static void shader_glsl_link_program(const struct wined3d_gl_info *gl_info, struct shader_glsl_priv *priv,
+        GLuint program_id, const void *params, size_t params_size)
+{
+    struct glsl_program_cache *cache = &priv->program_cache;
+    LARGE_INTEGER start;
+    UINT64 key = 0;
+
+    if (!cache->initialized)
+        glsl_program_cache_init(gl_info, cache);
+
+    if (cache->file != INVALID_HANDLE_VALUE)
+    {
+        QueryPerformanceCounter(&start);
+        if ((key = glsl_program_cache_get_key(gl_info, cache, program_id, params, params_size))
+                && glsl_program_cache_load(gl_info, cache, program_id, key))
+        {
+            TRACE("Loaded GLSL shader program %u from the cache.\n", program_id);
+            cache->load_time += glsl_program_cache_elapsed(&start);
+            ++cache->hits;
+            return;
+        }
+        GL_EXTCALL(glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        QueryPerformanceCounter(&start);
+    }
+
+    TRACE("Linking GLSL shader program %u.\n", program_id);
+    GL_EXTCALL(glLinkProgram(program_id));
+    shader_glsl_validate_link(gl_info, program_id);
+
+    if (cache->file != INVALID_HANDLE_VALUE && key)
+    {
+        cache->link_time += glsl_program_cache_elapsed(&start);
+        ++cache->misses;
+        glsl_program_cache_store(gl_info, cache, program_id, key);
+    }
+}
+
 static void shader_glsl_setup_vs3_output(struct shader_glsl_priv *priv,
         const struct wined3d_gl_info *gl_info, const DWORD *map,
         const struct wined3d_shader_signature *input_signature,
@@ -7653,6 +8130,7 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
     struct list *ps_list, *vs_list;
     WORD attribs_map;
     struct wined3d_string_buffer *tmp_name;
+    DWORD link_params[3];
 
     if (!(context->shader_update_mask & (1u << WINED3D_SHADER_TYPE_VERTEX)) && ctx_data->glsl_program)
     {
@@ -7863,9 +8341,14 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
     }
 
     /* Link the program */
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    memset(link_params, 0, sizeof(link_params));
+    if (gshader && gl_info->supported[WINED3D_GL_LEGACY_CONTEXT])
+    {
+        link_params[0] = gshader->u.gs.input_type;
+        link_params[1] = gshader->u.gs.output_type;
+        link_params[2] = gshader->u.gs.vertices_out;
+    }
+    shader_glsl_link_program(gl_info, priv, program_id, link_params, sizeof(link_params));
 
     shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
             vshader ? vshader->limits->constant_float : 0);
@@ -8532,6 +9015,7 @@ static void shader_glsl_free(struct wined3d_device *device)
         }
     }
 
+    glsl_program_cache_cleanup(&priv->program_cache);
     wine_rb_destroy(&priv->program_lookup, NULL, NULL);
     constant_heap_free(&priv->pconst_heap);
     constant_heap_free(&priv->vconst_heap);
@@ -1007,13 +1007,23 @@ DWORD CDECL wined3d_texture_set_lod(struct wined3d_texture *texture, DWORD lod)
 
     if (texture->lod != lod)
     {
+        struct wined3d_device *device = texture->resource.device;
+        unsigned int i;
+
         wined3d_resource_wait_idle(&texture->resource);
         texture->lod = lod;
 
         texture->texture_rgb.base_level = ~0u;
         texture->texture_srgb.base_level = ~0u;
-        if (texture->resource.bind_count)
-            device_invalidate_state(texture->resource.device, STATE_SAMPLER(texture->sampler));
+
+        /* Reapply the sampler states through the command stream, so that
+         * the worker thread picks up the new base level. */
+        for (i = 0; i < MAX_COMBINED_SAMPLERS; ++i)
+        {
+            if (device->state.textures[i] == texture)
+                wined3d_cs_emit_set_sampler_state(device->cs, i, WINED3D_SAMP_MAX_MIP_LEVEL,
+                        device->state.sampler_states[i][WINED3D_SAMP_MAX_MIP_LEVEL]);
+        }
     }
 
     return old;
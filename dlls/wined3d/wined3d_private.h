@@ -310,6 +310,8 @@ struct wined3d_settings
     unsigned int max_sm_ps;
     unsigned int max_sm_cs;
     BOOL no_3d;
+    BOOL cs_multithreaded;
+    DWORD shader_cache_size;
 };
 
 extern struct wined3d_settings wined3d_settings DECLSPEC_HIDDEN;
@@ -2494,6 +2496,9 @@ struct wined3d_device
     /* Command stream */
     struct wined3d_cs *cs;
 
+    /* Streaming ring for dynamic buffers */
+    struct wined3d_stream_ring *stream_ring;
+
     /* Context management */
     struct wined3d_context **contexts;
     UINT context_count;
@@ -2587,9 +2592,17 @@ static inline void wined3d_resource_release(struct wined3d_resource *resource)
     InterlockedDecrement(&resource->access_count);
 }
 
+static inline void wined3d_pause(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__("rep; nop" : : : "memory");
+#endif
+}
+
 static inline void wined3d_resource_wait_idle(struct wined3d_resource *resource)
 {
-    while (InterlockedCompareExchange(&resource->access_count, 0, 0));
+    while (InterlockedCompareExchange(&resource->access_count, 0, 0))
+        wined3d_pause();
 }
 
 void resource_cleanup(struct wined3d_resource *resource) DECLSPEC_HIDDEN;
@@ -3009,6 +3022,10 @@ void state_init(struct wined3d_state *state, struct wined3d_fb_state *fb,
         const struct wined3d_gl_info *gl_info, const struct wined3d_d3d_info *d3d_info,
         DWORD flags) DECLSPEC_HIDDEN;
 void state_unbind_resources(struct wined3d_state *state) DECLSPEC_HIDDEN;
+void wined3d_state_enable_light(struct wined3d_state *state, const struct wined3d_gl_info *gl_info,
+        struct wined3d_light_info *light_info, BOOL enable) DECLSPEC_HIDDEN;
+struct wined3d_light_info *wined3d_state_get_light(const struct wined3d_state *state,
+        unsigned int idx) DECLSPEC_HIDDEN;
 
 enum wined3d_push_constants
 {
@@ -3020,10 +3037,27 @@ enum wined3d_push_constants
     WINED3D_PUSH_CONSTANTS_PS_B,
 };
 
+#define WINED3D_CS_QUEUE_SIZE 0x400000u
+#define WINED3D_CS_QUEUE_MASK (WINED3D_CS_QUEUE_SIZE - 1)
+#define WINED3D_CS_SPIN_COUNT 10000u
+
+struct wined3d_cs_packet
+{
+    size_t size;
+    BYTE data[1];
+};
+
+struct wined3d_cs_queue
+{
+    LONG volatile head, tail;
+    BYTE data[WINED3D_CS_QUEUE_SIZE];
+};
+
 struct wined3d_cs_ops
 {
     void *(*require_space)(struct wined3d_cs *cs, size_t size);
     void (*submit)(struct wined3d_cs *cs);
+    void (*finish)(struct wined3d_cs *cs);
     void (*push_constants)(struct wined3d_cs *cs, enum wined3d_push_constants p,
             unsigned int start_idx, unsigned int count, const void *constants);
 };
@@ -3037,6 +3071,15 @@ struct wined3d_cs
 
     size_t data_size;
     void *data;
+
+    HANDLE thread;
+    DWORD thread_id;
+    HANDLE event;
+    LONG waiting_for_event;
+    HANDLE app_event;
+    LONG app_waiting_for_event;
+    LONG volatile pending_presents;
+    struct wined3d_cs_queue *queue;
 };
 
 struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device) DECLSPEC_HIDDEN;
@@ -3046,8 +3089,9 @@ void wined3d_cs_emit_clear(struct wined3d_cs *cs, DWORD rect_count, const RECT *
         DWORD flags, const struct wined3d_color *color, float depth, DWORD stencil) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_destroy_object(struct wined3d_cs *cs,
         void (*callback)(void *object), void *object) DECLSPEC_HIDDEN;
-void wined3d_cs_emit_draw(struct wined3d_cs *cs, int base_vertex_idx, unsigned int start_idx, unsigned int index_count,
-        unsigned int start_instance, unsigned int instance_count, BOOL indexed) DECLSPEC_HIDDEN;
+void wined3d_cs_emit_draw(struct wined3d_cs *cs, GLenum primitive_type, int base_vertex_idx, unsigned int start_idx,
+        unsigned int index_count, unsigned int start_instance, unsigned int instance_count,
+        BOOL indexed) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_present(struct wined3d_cs *cs, struct wined3d_swapchain *swapchain,
         const RECT *src_rect, const RECT *dst_rect, HWND dst_window_override, DWORD flags) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_query_issue(struct wined3d_cs *cs, struct wined3d_query *query, DWORD flags) DECLSPEC_HIDDEN;
@@ -3062,6 +3106,8 @@ void wined3d_cs_emit_set_depth_stencil_view(struct wined3d_cs *cs,
         struct wined3d_rendertarget_view *view) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_set_index_buffer(struct wined3d_cs *cs, struct wined3d_buffer *buffer,
         enum wined3d_format_id format_id, unsigned int offset) DECLSPEC_HIDDEN;
+void wined3d_cs_emit_set_light(struct wined3d_cs *cs, const struct wined3d_light_info *light) DECLSPEC_HIDDEN;
+void wined3d_cs_emit_set_light_enable(struct wined3d_cs *cs, unsigned int idx, BOOL enable) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_set_material(struct wined3d_cs *cs, const struct wined3d_material *material) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_set_predication(struct wined3d_cs *cs,
         struct wined3d_query *predicate, BOOL value) DECLSPEC_HIDDEN;
@@ -3102,6 +3148,13 @@ static inline void wined3d_cs_push_constants(struct wined3d_cs *cs, enum wined3d
     cs->ops->push_constants(cs, p, start_idx, count, constants);
 }
 
+/* Wait for the worker thread to execute all the queued commands. This is
+ * required before the application thread can make GL calls of its own. */
+static inline void wined3d_cs_finish(struct wined3d_cs *cs)
+{
+    cs->ops->finish(cs);
+}
+
 /* TODO: Add tests and support for FLOAT16_4 POSITIONT, D3DCOLOR position, other
  * fixed function semantics as D3DCOLOR or FLOAT16 */
 enum wined3d_buffer_conversion_type
@@ -3117,6 +3170,33 @@ struct wined3d_map_range
     UINT size;
 };
 
+/* Dynamic write-only buffers mapped with WINED3D_MAP_DISCARD are written to a
+ * region of a persistently mapped buffer object shared by the device, and
+ * copied to their own buffer object when they are unmapped. */
+#define WINED3D_STREAM_RING_SIZE    0x1000000u
+#define WINED3D_STREAM_RING_CHUNKS  8
+#define WINED3D_STREAM_CHUNK_SIZE   (WINED3D_STREAM_RING_SIZE / WINED3D_STREAM_RING_CHUNKS)
+
+struct wined3d_stream_chunk
+{
+    struct wined3d_event_query *query;
+    unsigned int pending;   /* Regions not yet copied to their buffer. */
+    BOOL closed;            /* No new regions are allocated from this chunk. */
+    BOOL fenced;            /* The query has to complete before the chunk is reused. */
+};
+
+struct wined3d_stream_ring
+{
+    GLuint buffer_object;
+    BYTE *ptr;              /* NULL if the ring is not available. */
+    unsigned int head;
+    unsigned int current;   /* The chunk regions are allocated from, or ~0u. */
+    struct wined3d_stream_chunk chunks[WINED3D_STREAM_RING_CHUNKS];
+};
+
+void wined3d_stream_ring_destroy(struct wined3d_device *device,
+        const struct wined3d_gl_info *gl_info) DECLSPEC_HIDDEN;
+
 struct wined3d_buffer
 {
     struct wined3d_resource resource;
@@ -3132,6 +3212,7 @@ struct wined3d_buffer
     struct wined3d_map_range *maps;
     ULONG maps_size, modified_areas;
     struct wined3d_event_query *query;
+    unsigned int stream_offset;
 
     /* conversion stuff */
     UINT decl_change_count, full_conversion_count;
@@ -1393,6 +1393,102 @@ struct open_semaphore_reply
 
 
 
+typedef volatile struct
+{
+    unsigned int   state;
+    unsigned int   count;
+    int            __pad[2];
+} shared_sync_t;
+
+
+
+#define SHARED_SYNC_SERVER_WAIT 0x80000000
+
+
+#define SHARED_SYNC_MUTEX_ABANDONED 1
+
+enum shared_sync_type
+{
+    SHARED_SYNC_NONE,
+    SHARED_SYNC_AUTO_EVENT,
+    SHARED_SYNC_MANUAL_EVENT,
+    SHARED_SYNC_SEMAPHORE,
+    SHARED_SYNC_MUTEX
+};
+
+
+struct get_shared_sync_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    int          need_fd;
+    char __pad_20[4];
+};
+struct get_shared_sync_reply
+{
+    struct reply_header __header;
+    int          enabled;
+    int          type;
+    unsigned int index;
+    unsigned int access;
+};
+
+
+
+
+
+
+
+
+
+#define SHARED_REQUEST_SLOTS 256
+
+
+
+
+
+#define SHARED_REQUEST_ENTRY(pos,slot) (((pos) << 8) | (slot))
+
+enum shared_request_state
+{
+    SHARED_REQUEST_IDLE,
+    SHARED_REQUEST_PENDING,
+    SHARED_REQUEST_DONE,
+    SHARED_REQUEST_ABORTED
+};
+
+typedef volatile struct
+{
+    int                      state;
+    int                      waiting;
+    int                      __pad[14];
+    struct request_max_size  data;
+} shared_request_t;
+
+typedef volatile struct
+{
+    int              server_idle;
+    unsigned int     tail;
+    int              __pad[14];
+    unsigned int     ring[SHARED_REQUEST_SLOTS];
+    shared_request_t requests[SHARED_REQUEST_SLOTS];
+} shared_requests_t;
+
+
+struct get_shared_requests_request
+{
+    struct request_header __header;
+    int          need_fd;
+};
+struct get_shared_requests_reply
+{
+    struct reply_header __header;
+    int          enabled;
+    unsigned int slot;
+};
+
+
+
 struct create_file_request
 {
     struct request_header __header;
@@ -5179,6 +5275,55 @@ struct query_completion_reply
 
 
 
+struct create_wait_completion_request
+{
+    struct request_header __header;
+    unsigned int  access;
+    unsigned int  attributes;
+    char __pad_20[4];
+};
+struct create_wait_completion_reply
+{
+    struct reply_header __header;
+    obj_handle_t  handle;
+    char __pad_12[4];
+};
+
+
+
+struct associate_wait_completion_request
+{
+    struct request_header __header;
+    obj_handle_t  handle;
+    obj_handle_t  port;
+    obj_handle_t  object;
+    apc_param_t   ckey;
+    apc_param_t   cvalue;
+};
+struct associate_wait_completion_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct cancel_wait_completion_request
+{
+    struct request_header __header;
+    obj_handle_t  handle;
+};
+struct cancel_wait_completion_reply
+{
+    struct reply_header __header;
+    int           state;
+    char __pad_12[4];
+};
+#define WAIT_COMPLETION_CANCELED   0
+#define WAIT_COMPLETION_REMOVED    1
+#define WAIT_COMPLETION_DELIVERED  2
+
+
+
 struct set_completion_info_request
 {
     struct request_header __header;
@@ -5471,6 +5616,46 @@ struct terminate_job_reply
 };
 
 
+struct request_stats
+{
+    char             name[32];
+    unsigned int     count;
+    unsigned int     fd_count;
+    unsigned __int64 reply_bytes;
+    timeout_t        total_time;
+    timeout_t        max_time;
+};
+
+
+struct get_request_stats_request
+{
+    struct request_header __header;
+    int          reset;
+};
+struct get_request_stats_reply
+{
+    struct reply_header __header;
+    int          total;
+    /* VARARG(stats,request_stats); */
+    char __pad_12[4];
+};
+
+
+
+struct get_process_request_stats_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_process_request_stats_reply
+{
+    struct reply_header __header;
+    unsigned int count;
+    unsigned int fd_count;
+    timeout_t    total_time;
+};
+
+
 enum request
 {
     REQ_new_process,
@@ -5513,6 +5698,8 @@ enum request
     REQ_release_semaphore,
     REQ_query_semaphore,
     REQ_open_semaphore,
+    REQ_get_shared_sync,
+    REQ_get_shared_requests,
     REQ_create_file,
     REQ_open_file_object,
     REQ_alloc_file_handle,
@@ -5731,6 +5918,9 @@ enum request
     REQ_add_completion,
     REQ_remove_completion,
     REQ_query_completion,
+    REQ_create_wait_completion,
+    REQ_associate_wait_completion,
+    REQ_cancel_wait_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
     REQ_set_fd_disp_info,
@@ -5750,6 +5940,8 @@ enum request
     REQ_set_job_limits,
     REQ_set_job_completion_port,
     REQ_terminate_job,
+    REQ_get_request_stats,
+    REQ_get_process_request_stats,
     REQ_NB_REQUESTS
 };
 
@@ -5797,6 +5989,8 @@ union generic_request
     struct release_semaphore_request release_semaphore_request;
     struct query_semaphore_request query_semaphore_request;
     struct open_semaphore_request open_semaphore_request;
+    struct get_shared_sync_request get_shared_sync_request;
+    struct get_shared_requests_request get_shared_requests_request;
     struct create_file_request create_file_request;
     struct open_file_object_request open_file_object_request;
     struct alloc_file_handle_request alloc_file_handle_request;
@@ -6015,6 +6209,9 @@ union generic_request
     struct add_completion_request add_completion_request;
     struct remove_completion_request remove_completion_request;
     struct query_completion_request query_completion_request;
+    struct create_wait_completion_request create_wait_completion_request;
+    struct associate_wait_completion_request associate_wait_completion_request;
+    struct cancel_wait_completion_request cancel_wait_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
     struct set_fd_disp_info_request set_fd_disp_info_request;
@@ -6034,6 +6231,8 @@ union generic_request
     struct set_job_limits_request set_job_limits_request;
     struct set_job_completion_port_request set_job_completion_port_request;
     struct terminate_job_request terminate_job_request;
+    struct get_request_stats_request get_request_stats_request;
+    struct get_process_request_stats_request get_process_request_stats_request;
 };
 union generic_reply
 {
@@ -6079,6 +6278,8 @@ union generic_reply
     struct release_semaphore_reply release_semaphore_reply;
     struct query_semaphore_reply query_semaphore_reply;
     struct open_semaphore_reply open_semaphore_reply;
+    struct get_shared_sync_reply get_shared_sync_reply;
+    struct get_shared_requests_reply get_shared_requests_reply;
     struct create_file_reply create_file_reply;
     struct open_file_object_reply open_file_object_reply;
     struct alloc_file_handle_reply alloc_file_handle_reply;
@@ -6297,6 +6498,9 @@ union generic_reply
     struct add_completion_reply add_completion_reply;
     struct remove_completion_reply remove_completion_reply;
     struct query_completion_reply query_completion_reply;
+    struct create_wait_completion_reply create_wait_completion_reply;
+    struct associate_wait_completion_reply associate_wait_completion_reply;
+    struct cancel_wait_completion_reply cancel_wait_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
     struct set_fd_disp_info_reply set_fd_disp_info_reply;
@@ -6316,8 +6520,10 @@ union generic_reply
     struct set_job_limits_reply set_job_limits_reply;
     struct set_job_completion_port_reply set_job_completion_port_reply;
     struct terminate_job_reply terminate_job_reply;
+    struct get_request_stats_reply get_request_stats_reply;
+    struct get_process_request_stats_reply get_process_request_stats_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 513
+#define SERVER_PROTOCOL_VERSION 521
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
@@ -0,0 +1,274 @@
+/*
+ * wineserverstat - display the wineserver request statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winbase.h"
+#include "winternl.h"
+#include "tlhelp32.h"
+#include "wine/server.h"
+
+struct process_stats
+{
+    DWORD        pid;
+    char         name[MAX_PATH];
+    unsigned int count;
+    unsigned int fd_count;
+    timeout_t    total_time;
+};
+
+static unsigned int max_rows = 20;
+
+static void usage(void)
+{
+    printf( "Usage: wineserverstat [options]\n\n"
+            "Display the time spent by the wineserver in each request type.\n\n"
+            "Options:\n"
+            "  -d <seconds>  refresh the display at this interval, showing the changes\n"
+            "  -n <rows>     number of rows to display (default %u)\n"
+            "  -p            display the totals per process instead\n"
+            "  -r            reset the request counters\n", max_rows );
+    exit( 1 );
+}
+
+/* retrieve the statistics of all the request types */
+static struct request_stats *get_request_stats( unsigned int *count, BOOL reset )
+{
+    struct request_stats *stats = NULL;
+    unsigned int size = 512, total;
+    NTSTATUS status;
+
+    for (;;)
+    {
+        if (!(stats = realloc( stats, size * sizeof(*stats) ))) return NULL;
+        SERVER_START_REQ( get_request_stats )
+        {
+            req->reset = reset;
+            wine_server_set_reply( req, stats, size * sizeof(*stats) );
+            status = wine_server_call( req );
+            total  = reply->total;
+            *count = wine_server_reply_size( reply ) / sizeof(*stats);
+        }
+        SERVER_END_REQ;
+        if (status)
+        {
+            free( stats );
+            return NULL;
+        }
+        if (*count >= total) return stats;
+        size = total;
+    }
+}
+
+/* retrieve the request totals of all the processes */
+static struct process_stats *get_process_stats( unsigned int *count )
+{
+    struct process_stats *stats = NULL, *new_stats;
+    unsigned int size = 0;
+    PROCESSENTRY32 entry;
+    HANDLE snapshot, process;
+    NTSTATUS status;
+
+    *count = 0;
+    if ((snapshot = CreateToolhelp32Snapshot( TH32CS_SNAPPROCESS, 0 )) == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    entry.dwSize = sizeof(entry);
+    if (Process32First( snapshot, &entry )) do
+    {
+        if (!(process = OpenProcess( PROCESS_QUERY_LIMITED_INFORMATION, FALSE, entry.th32ProcessID )))
+            continue;
+        if (*count == size)
+        {
+            size = size ? size * 2 : 64;
+            if (!(new_stats = realloc( stats, size * sizeof(*stats) )))
+            {
+                CloseHandle( process );
+                break;
+            }
+            stats = new_stats;
+        }
+        SERVER_START_REQ( get_process_request_stats )
+        {
+            req->handle = wine_server_obj_handle( process );
+            if (!(status = wine_server_call( req )))
+            {
+                stats[*count].count      = reply->count;
+                stats[*count].fd_count   = reply->fd_count;
+                stats[*count].total_time = reply->total_time;
+            }
+        }
+        SERVER_END_REQ;
+        CloseHandle( process );
+        if (status) continue;
+        stats[*count].pid = entry.th32ProcessID;
+        lstrcpynA( stats[*count].name, entry.szExeFile, sizeof(stats[*count].name) );
+        (*count)++;
+    } while (Process32Next( snapshot, &entry ));
+
+    CloseHandle( snapshot );
+    return stats;
+}
+
+static int compare_request_stats( const void *p1, const void *p2 )
+{
+    const struct request_stats *s1 = p1, *s2 = p2;
+
+    if (s1->total_time != s2->total_time) return s1->total_time > s2->total_time ? -1 : 1;
+    if (s1->count != s2->count) return s1->count > s2->count ? -1 : 1;
+    return strcmp( s1->name, s2->name );
+}
+
+static int compare_process_stats( const void *p1, const void *p2 )
+{
+    const struct process_stats *s1 = p1, *s2 = p2;
+
+    if (s1->total_time != s2->total_time) return s1->total_time > s2->total_time ? -1 : 1;
+    if (s1->count != s2->count) return s1->count > s2->count ? -1 : 1;
+    return s1->pid < s2->pid ? -1 : s1->pid > s2->pid;
+}
+
+static void display_requests( struct request_stats *stats, const struct request_stats *prev,
+                              unsigned int count )
+{
+    unsigned int i, total_count = 0;
+    timeout_t total_time = 0;
+
+    if (prev)
+    {
+        for (i = 0; i < count; i++)
+        {
+            stats[i].count       -= prev[i].count;
+            stats[i].fd_count    -= prev[i].fd_count;
+            stats[i].reply_bytes -= prev[i].reply_bytes;
+            stats[i].total_time  -= prev[i].total_time;
+        }
+    }
+    for (i = 0; i < count; i++)
+    {
+        total_count += stats[i].count;
+        total_time  += stats[i].total_time;
+    }
+    qsort( stats, count, sizeof(*stats), compare_request_stats );
+
+    printf( "%u requests, %u.%03u ms in handlers\n\n", total_count,
+            (unsigned int)(total_time / 10000), (unsigned int)(total_time % 10000) / 10 );
+    printf( "%-32s %10s %10s %8s %10s %10s %8s\n",
+            "request", "count", "time(ms)", "avg(us)", "max(us)", "reply KB", "fds" );
+    for (i = 0; i < count && i < max_rows; i++)
+    {
+        if (!stats[i].count) break;
+        printf( "%-32.32s %10u %10u %8u %10u %10u %8u\n", stats[i].name, stats[i].count,
+                (unsigned int)(stats[i].total_time / 10000),
+                (unsigned int)(stats[i].total_time / stats[i].count / 10),
+                (unsigned int)(stats[i].max_time / 10),
+                (unsigned int)(stats[i].reply_bytes / 1024), stats[i].fd_count );
+    }
+}
+
+static void display_processes( struct process_stats *stats, unsigned int count,
+                               const struct process_stats *prev, unsigned int prev_count )
+{
+    unsigned int i, j;
+
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < prev_count; j++)
+        {
+            if (prev[j].pid != stats[i].pid) continue;
+            stats[i].count      -= prev[j].count;
+            stats[i].fd_count   -= prev[j].fd_count;
+            stats[i].total_time -= prev[j].total_time;
+            break;
+        }
+    }
+    qsort( stats, count, sizeof(*stats), compare_process_stats );
+
+    printf( "%-8s %-32s %10s %10s %8s\n", "pid", "process", "count", "time(ms)", "fds" );
+    for (i = 0; i < count && i < max_rows; i++)
+        printf( "%08x %-32.32s %10u %10u %8u\n", stats[i].pid, stats[i].name, stats[i].count,
+                (unsigned int)(stats[i].total_time / 10000), stats[i].fd_count );
+}
+
+int main( int argc, char *argv[] )
+{
+    struct request_stats *stats, *prev = NULL;
+    struct process_stats *procs, *prev_procs = NULL;
+    unsigned int count, prev_count = 0, delay = 0;
+    BOOL per_process = FALSE, reset = FALSE;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp( argv[i], "-d" ) && i + 1 < argc) delay = atoi( argv[++i] );
+        else if (!strcmp( argv[i], "-n" ) && i + 1 < argc) max_rows = atoi( argv[++i] );
+        else if (!strcmp( argv[i], "-p" )) per_process = TRUE;
+        else if (!strcmp( argv[i], "-r" )) reset = TRUE;
+        else usage();
+    }
+
+    if (reset)
+    {
+        if (!(stats = get_request_stats( &count, TRUE ))) return 1;
+        free( stats );
+    }
+
+    for (;;)
+    {
+        if (per_process)
+        {
+            struct process_stats *copy = NULL;
+
+            procs = get_process_stats( &count );
+            if (count)
+            {
+                if (!(copy = malloc( count * sizeof(*copy) ))) return 1;
+                memcpy( copy, procs, count * sizeof(*copy) );
+            }
+            display_processes( procs, count, prev_procs, prev_count );
+            free( procs );
+            free( prev_procs );
+            prev_procs = copy;
+            prev_count = count;
+        }
+        else
+        {
+            struct request_stats *copy;
+
+            if (!(stats = get_request_stats( &count, FALSE ))) return 1;
+            if (!(copy = malloc( count * sizeof(*copy) ))) return 1;
+            memcpy( copy, stats, count * sizeof(*copy) );
+            display_requests( stats, prev, count );
+            free( stats );
+            free( prev );
+            prev = copy;
+        }
+        if (!delay) break;
+        Sleep( delay * 1000 );
+        printf( "\n" );
+    }
+    free( prev );
+    free( prev_procs );
+    return 0;
+}
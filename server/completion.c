@@ -88,6 +88,45 @@ struct comp_msg
     unsigned int  status;
 };
 
+/* a wait completion queues a completion to a port when an object is signaled, */
+/* allowing a single thread to wait for an unlimited number of objects */
+struct wait_completion
+{
+    struct object            obj;
+    struct wait_queue_entry  wait;        /* entry in the wait queue of the object, without a thread */
+    struct completion       *completion;  /* port receiving the completion */
+    apc_param_t              ckey;        /* completion key */
+    apc_param_t              cvalue;      /* completion value */
+    int                      waiting;     /* waiting for the object */
+    int                      queued;      /* completion was queued since the last association */
+};
+
+static void wait_completion_dump( struct object *obj, int verbose );
+static struct object_type *wait_completion_get_type( struct object *obj );
+static void wait_completion_destroy( struct object *obj );
+
+static const struct object_ops wait_completion_ops =
+{
+    sizeof(struct wait_completion), /* size */
+    wait_completion_dump,      /* dump */
+    wait_completion_get_type,  /* get_type */
+    no_add_queue,              /* add_queue */
+    NULL,                      /* remove_queue */
+    NULL,                      /* signaled */
+    NULL,                      /* satisfied */
+    no_signal,                 /* signal */
+    no_get_fd,                 /* get_fd */
+    no_map_access,             /* map_access */
+    default_get_sd,            /* get_sd */
+    default_set_sd,            /* set_sd */
+    no_lookup_name,            /* lookup_name */
+    no_link_name,              /* link_name */
+    NULL,                      /* unlink_name */
+    no_open_file,              /* open_file */
+    no_close_handle,           /* close_handle */
+    wait_completion_destroy    /* destroy */
+};
+
 static void completion_destroy( struct object *obj)
 {
     struct completion *completion = (struct completion *) obj;
@@ -171,6 +210,81 @@ void add_completion( struct completion *completion, apc_param_t ckey, apc_param_
     wake_up( &completion->obj, 1 );
 }
 
+static void wait_completion_dump( struct object *obj, int verbose )
+{
+    struct wait_completion *wait = (struct wait_completion *)obj;
+
+    assert( obj->ops == &wait_completion_ops );
+    fprintf( stderr, "WaitCompletion obj=%p port=%p\n", wait->waiting ? wait->wait.obj : NULL, wait->completion );
+}
+
+static struct object_type *wait_completion_get_type( struct object *obj )
+{
+    static const WCHAR name[] = {'W','a','i','t','C','o','m','p','l','e','t','i','o','n','P','a','c','k','e','t'};
+    static const struct unicode_str str = { name, sizeof(name) };
+    return get_object_type( &str );
+}
+
+static void cancel_wait_completion( struct wait_completion *wait )
+{
+    if (!wait->waiting) return;
+    wait->wait.obj->ops->remove_queue( wait->wait.obj, &wait->wait );
+    wait->waiting = 0;
+}
+
+static void wait_completion_destroy( struct object *obj )
+{
+    struct wait_completion *wait = (struct wait_completion *)obj;
+
+    assert( obj->ops == &wait_completion_ops );
+    cancel_wait_completion( wait );
+    if (wait->completion) release_object( wait->completion );
+}
+
+/* called from wake_up() for wait queue entries that don't belong to a thread */
+int wake_wait_completion( struct wait_queue_entry *entry )
+{
+    struct wait_completion *wait = LIST_ENTRY( entry, struct wait_completion, wait );
+    struct object *obj = entry->obj;
+
+    assert( wait->waiting );
+    if (!obj->ops->signaled( obj, entry )) return 0;
+    obj->ops->satisfied( obj, entry );
+    cancel_wait_completion( wait );
+    wait->queued = 1;
+    add_completion( wait->completion, wait->ckey, wait->cvalue, STATUS_WAIT_0, 0 );
+    return 1;
+}
+
+/* check if the wait conditions of an object can be handled without a waiting thread */
+static int is_wait_completion_supported( struct object *obj )
+{
+    static const WCHAR mutantW[] = {'M','u','t','a','n','t'};
+    static const WCHAR keyed_eventW[] = {'K','e','y','e','d','E','v','e','n','t'};
+    static const struct unicode_str mutant_str = { mutantW, sizeof(mutantW) };
+    static const struct unicode_str keyed_event_str = { keyed_eventW, sizeof(keyed_eventW) };
+    struct object_type *type = obj->ops->get_type( obj );
+
+    /* mutexes and keyed events depend on the waiting thread, objects without a type are internal */
+    return type && type != get_object_type( &mutant_str ) && type != get_object_type( &keyed_event_str );
+}
+
+/* remove the completion queued by a wait completion from the port queue, if still there */
+static int remove_wait_completion_msg( struct wait_completion *wait )
+{
+    struct comp_msg *msg;
+
+    LIST_FOR_EACH_ENTRY( msg, &wait->completion->queue, struct comp_msg, queue_entry )
+    {
+        if (msg->ckey != wait->ckey || msg->cvalue != wait->cvalue) continue;
+        list_remove( &msg->queue_entry );
+        wait->completion->depth--;
+        free( msg );
+        return 1;
+    }
+    return 0;
+}
+
 /* create a completion */
 DECL_HANDLER(create_completion)
 {
@@ -251,3 +365,87 @@ DECL_HANDLER(query_completion)
 
     release_object( completion );
 }
+
+/* create a wait completion */
+DECL_HANDLER(create_wait_completion)
+{
+    struct wait_completion *wait;
+
+    if (!(wait = alloc_object( &wait_completion_ops ))) return;
+    wait->wait.wait   = NULL;
+    wait->completion  = NULL;
+    wait->ckey        = 0;
+    wait->cvalue      = 0;
+    wait->waiting     = 0;
+    wait->queued      = 0;
+    reply->handle = alloc_handle( current->process, wait, req->access, req->attributes );
+    release_object( wait );
+}
+
+/* start waiting for an object to queue a completion */
+DECL_HANDLER(associate_wait_completion)
+{
+    struct wait_completion *wait;
+    struct completion *completion;
+    struct object *obj;
+
+    if (!(wait = (struct wait_completion *)get_handle_obj( current->process, req->handle, 0,
+                                                          &wait_completion_ops )))
+        return;
+
+    if (wait->waiting)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        release_object( wait );
+        return;
+    }
+    if (!(completion = get_completion_obj( current->process, req->port, IO_COMPLETION_MODIFY_STATE )))
+    {
+        release_object( wait );
+        return;
+    }
+    if (!(obj = get_handle_obj( current->process, req->object, SYNCHRONIZE, NULL )))
+    {
+        release_object( completion );
+        release_object( wait );
+        return;
+    }
+
+    if (!is_wait_completion_supported( obj )) set_error( STATUS_OBJECT_TYPE_MISMATCH );
+    else if (obj->ops->add_queue( obj, &wait->wait ))
+    {
+        if (wait->completion) release_object( wait->completion );
+        wait->completion = (struct completion *)grab_object( completion );
+        wait->ckey       = req->ckey;
+        wait->cvalue     = req->cvalue;
+        wait->waiting    = 1;
+        wait->queued     = 0;
+        wake_wait_completion( &wait->wait );
+    }
+
+    release_object( obj );
+    release_object( completion );
+    release_object( wait );
+}
+
+/* cancel the wait of a wait completion */
+DECL_HANDLER(cancel_wait_completion)
+{
+    struct wait_completion *wait;
+
+    if (!(wait = (struct wait_completion *)get_handle_obj( current->process, req->handle, 0,
+                                                          &wait_completion_ops )))
+        return;
+
+    if (wait->waiting)
+    {
+        cancel_wait_completion( wait );
+        reply->state = WAIT_COMPLETION_CANCELED;
+    }
+    else if (!wait->queued) reply->state = WAIT_COMPLETION_CANCELED;
+    else if (remove_wait_completion_msg( wait )) reply->state = WAIT_COMPLETION_REMOVED;
+    else reply->state = WAIT_COMPLETION_DELIVERED;
+    wait->queued = 0;
+
+    release_object( wait );
+}
@@ -339,7 +339,7 @@ static struct object *create_console_input( struct thread* renderer, int fd )
     console_input->input_cp      = 0;
     console_input->output_cp     = 0;
     console_input->win           = 0;
-    console_input->event         = create_event( NULL, NULL, 0, 1, 0, NULL );
+    console_input->event         = create_event( NULL, NULL, 0, 1, 0, NULL, NULL );
     console_input->fd            = NULL;
 
     if (!console_input->history || (renderer && !console_input->evt) || !console_input->event)
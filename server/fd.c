@@ -358,13 +358,19 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct list           entry;      /* entry in expired list while the callback is pending */
+    int                   index;      /* index in the timeout heap, -1 if expired */
+    unsigned int          seq;        /* insertion sequence, to order timeouts with the same expiry */
     timeout_t             when;       /* timeout expiry (absolute time) */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list timeout_list = LIST_INIT(timeout_list);   /* sorted timeouts list */
+/* pending timeouts are kept in a binary min-heap ordered by expiry time */
+static struct timeout_user **timeout_heap;
+static unsigned int timeout_count;
+static unsigned int timeout_size;
+static unsigned int timeout_seq;
 timeout_t current_time;
 
 static inline void set_current_time(void)
@@ -375,32 +381,101 @@ static inline void set_current_time(void)
     current_time = (timeout_t)now.tv_sec * TICKS_PER_SEC + now.tv_usec * 10 + ticks_1601_to_1970;
 }
 
+/* check whether timeout a expires before timeout b */
+/* timeouts with the same expiry time are ordered most recent first */
+static inline int timeout_before( const struct timeout_user *a, const struct timeout_user *b )
+{
+    if (a->when != b->when) return a->when < b->when;
+    return (int)(a->seq - b->seq) > 0;
+}
+
+static inline void timeout_heap_set( unsigned int index, struct timeout_user *user )
+{
+    timeout_heap[index] = user;
+    user->index = index;
+}
+
+/* move a heap entry up towards the root until the heap order is restored */
+static void timeout_heap_up( unsigned int index )
+{
+    struct timeout_user *user = timeout_heap[index];
+
+    while (index)
+    {
+        unsigned int parent = (index - 1) / 2;
+        if (!timeout_before( user, timeout_heap[parent] )) break;
+        timeout_heap_set( index, timeout_heap[parent] );
+        index = parent;
+    }
+    timeout_heap_set( index, user );
+}
+
+/* move a heap entry down towards the leaves until the heap order is restored */
+static void timeout_heap_down( unsigned int index )
+{
+    struct timeout_user *user = timeout_heap[index];
+
+    for (;;)
+    {
+        unsigned int child = 2 * index + 1;
+        if (child >= timeout_count) break;
+        if (child + 1 < timeout_count && timeout_before( timeout_heap[child + 1], timeout_heap[child] ))
+            child++;
+        if (!timeout_before( timeout_heap[child], user )) break;
+        timeout_heap_set( index, timeout_heap[child] );
+        index = child;
+    }
+    timeout_heap_set( index, user );
+}
+
+/* remove an entry from the timeout heap */
+static void timeout_heap_remove( struct timeout_user *user )
+{
+    unsigned int index = user->index;
+    struct timeout_user *last = timeout_heap[--timeout_count];
+
+    user->index = -1;
+    if (last == user) return;
+    timeout_heap_set( index, last );
+    if (index && timeout_before( last, timeout_heap[(index - 1) / 2] )) timeout_heap_up( index );
+    else timeout_heap_down( index );
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
+
+    if (timeout_count == timeout_size)
+    {
+        unsigned int new_size = max( timeout_size * 2, 64 );
+        struct timeout_user **new_heap = realloc( timeout_heap, new_size * sizeof(*new_heap) );
+
+        if (!new_heap)
+        {
+            set_error( STATUS_NO_MEMORY );
+            return NULL;
+        }
+        timeout_heap = new_heap;
+        timeout_size = new_size;
+    }
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = (when > 0) ? when : current_time - when;
+    user->seq      = timeout_seq++;
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &timeout_list )
-    {
-        struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-        if (timeout->when >= user->when) break;
-    }
-    list_add_before( ptr, &user->entry );
+    timeout_heap_set( timeout_count++, user );
+    timeout_heap_up( user->index );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index == -1) list_remove( &user->entry );
+    else timeout_heap_remove( user );
     free( user );
 }
 
@@ -537,6 +612,7 @@ static inline void main_loop_epoll(void)
 
         ret = epoll_wait( epoll_fd, events, sizeof(events)/sizeof(events[0]), timeout );
         set_current_time();
+        shared_requests_wakeup();
 
         /* put the events into the pollfd array first, like poll does */
         for (i = 0; i < ret; i++)
@@ -651,6 +727,7 @@ static inline void main_loop_epoll(void)
         else ret = kevent( kqueue_fd, NULL, 0, events, sizeof(events)/sizeof(events[0]), NULL );
 
         set_current_time();
+        shared_requests_wakeup();
 
         /* put the events into the pollfd array first, like poll does */
         for (i = 0; i < ret; i++)
@@ -757,6 +834,7 @@ static inline void main_loop_epoll(void)
 	if (ret == -1) break;  /* an error occurred with event completion */
 
         set_current_time();
+        shared_requests_wakeup();
 
         /* put the events into the pollfd array first, like poll does */
         for (i = 0; i < nget; i++)
@@ -846,23 +924,20 @@ static void remove_poll_user( struct fd *fd, int user )
 /* process pending timeouts and return the time until the next timeout, in milliseconds */
 static int get_next_timeout(void)
 {
-    if (!list_empty( &timeout_list ))
+    int ret = -1;  /* no pending timeouts */
+
+    if (timeout_count)
     {
         struct list expired_list, *ptr;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heap */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &timeout_list )) != NULL)
+        while (timeout_count && timeout_heap[0]->when <= current_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            struct timeout_user *timeout = timeout_heap[0];
+            timeout_heap_remove( timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
 
         /* now call the callback for all the removed timers */
@@ -875,15 +950,16 @@ static int get_next_timeout(void)
             free( timeout );
         }
 
-        if ((ptr = list_head( &timeout_list )) != NULL)
+        if (timeout_count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            int diff = (timeout->when - current_time + 9999) / 10000;
-            if (diff < 0) diff = 0;
-            return diff;
+            ret = (timeout_heap[0]->when - current_time + 9999) / 10000;
+            if (ret < 0) ret = 0;
         }
     }
-    return -1;  /* no pending timeouts */
+
+    /* don't sleep if requests got queued in the shared memory ring */
+    if (!shared_requests_idle( ret )) ret = 0;
+    return ret;
 }
 
 /* server main poll() loop */
@@ -905,6 +981,7 @@ void main_loop(void)
 
         ret = poll( pollfd, nb_users, timeout );
         set_current_time();
+        shared_requests_wakeup();
 
         if (ret > 0)
         {
@@ -42,17 +42,22 @@
 struct handle_entry
 {
     struct object *ptr;       /* object */
-    unsigned int   access;    /* access rights */
+    unsigned int   access;    /* access rights, or index of the next free entry if ptr is NULL */
 };
 
+/* the entries are allocated in chunks, so that they never move when the table grows */
 struct handle_table
 {
-    struct object        obj;         /* object header */
-    struct process      *process;     /* process owning this table */
-    int                  count;       /* number of allocated entries */
-    int                  last;        /* last used entry */
-    int                  free;        /* first entry that may be free */
-    struct handle_entry *entries;     /* handle entries */
+    struct object         obj;          /* object header */
+    struct process       *process;      /* process owning this table */
+    int                   count;        /* number of allocated entries */
+    int                   last;         /* last entry that has been used */
+    int                   free;         /* first entry of the free list, or -1 */
+    int                   used;         /* number of entries in use */
+    int                   shrink_limit; /* shrink the table when fewer entries are in use */
+    int                   nb_chunks;    /* number of allocated chunks */
+    int                   max_chunks;   /* size of the chunks array */
+    struct handle_entry **chunks;       /* chunks of handle entries */
 };
 
 static struct handle_table *global_table;
@@ -63,9 +68,16 @@ static struct handle_table *global_table;
 #define RESERVED_CLOSE_PROTECT (HANDLE_FLAG_PROTECT_FROM_CLOSE << RESERVED_SHIFT)
 #define RESERVED_ALL           (RESERVED_INHERIT | RESERVED_CLOSE_PROTECT)
 
-#define MIN_HANDLE_ENTRIES  32
+#define HANDLE_CHUNK_SHIFT  8
+#define HANDLE_CHUNK_SIZE   (1 << HANDLE_CHUNK_SHIFT)  /* entries per chunk */
 #define MAX_HANDLE_ENTRIES  0x00ffffff
 
+/* return the entry at a given index; the index must be below the table count */
+static inline struct handle_entry *get_entry( const struct handle_table *table, int index )
+{
+    return table->chunks[index >> HANDLE_CHUNK_SHIFT] + (index & (HANDLE_CHUNK_SIZE - 1));
+}
+
 
 /* handle to table index conversion */
 
@@ -146,12 +158,12 @@ static void handle_table_dump( struct object *obj, int verbose )
 
     assert( obj->ops == &handle_table_ops );
 
-    fprintf( stderr, "Handle table last=%d count=%d process=%p\n",
-             table->last, table->count, table->process );
+    fprintf( stderr, "Handle table last=%d count=%d used=%d process=%p\n",
+             table->last, table->count, table->used, table->process );
     if (!verbose) return;
-    entry = table->entries;
-    for (i = 0; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         fprintf( stderr, "    %04x: %p %08x ",
                  index_to_handle(i), entry->ptr, entry->access );
@@ -172,20 +184,24 @@ static void handle_table_destroy( struct object *obj )
     /* first notify all objects that handles are being closed */
     if (table->process)
     {
-        for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+        for (i = 0; i <= table->last; i++)
         {
-            struct object *obj = entry->ptr;
+            struct object *obj = get_entry( table, i )->ptr;
             if (obj) obj->ops->close_handle( obj, table->process, index_to_handle(i) );
         }
     }
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
-        struct object *obj = entry->ptr;
+        struct object *obj;
+
+        entry = get_entry( table, i );
+        obj = entry->ptr;
         entry->ptr = NULL;
         if (obj) release_object_from_handle( obj );
     }
-    free( table->entries );
+    for (i = 0; i < table->nb_chunks; i++) free( table->chunks[i] );
+    free( table->chunks );
 }
 
 /* close all the process handles and free the handle table */
@@ -197,57 +213,90 @@ void close_process_handles( struct process *process )
     if (table) release_object( table );
 }
 
+/* add a chunk of entries to a handle table */
+static int add_handle_chunk( struct handle_table *table )
+{
+    struct handle_entry *chunk;
+
+    if (table->count + HANDLE_CHUNK_SIZE > MAX_HANDLE_ENTRIES) return 0;
+    if (table->nb_chunks == table->max_chunks)
+    {
+        int new_max = max( table->max_chunks * 2, 4 );
+        struct handle_entry **new_chunks = realloc( table->chunks, new_max * sizeof(*new_chunks) );
+
+        if (!new_chunks) return 0;
+        table->chunks = new_chunks;
+        table->max_chunks = new_max;
+    }
+    if (!(chunk = malloc( HANDLE_CHUNK_SIZE * sizeof(*chunk) ))) return 0;
+    table->chunks[table->nb_chunks++] = chunk;
+    table->count += HANDLE_CHUNK_SIZE;
+    return 1;
+}
+
 /* allocate a new handle table */
 struct handle_table *alloc_handle_table( struct process *process, int count )
 {
     struct handle_table *table;
 
-    if (count < MIN_HANDLE_ENTRIES) count = MIN_HANDLE_ENTRIES;
     if (!(table = alloc_object( &handle_table_ops )))
         return NULL;
-    table->process = process;
-    table->count   = count;
-    table->last    = -1;
-    table->free    = 0;
-    if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
-    release_object( table );
-    return NULL;
+    table->process      = process;
+    table->count        = 0;
+    table->last         = -1;
+    table->free         = -1;
+    table->used         = 0;
+    table->shrink_limit = 0;
+    table->nb_chunks    = 0;
+    table->max_chunks   = 0;
+    table->chunks       = NULL;
+    do
+    {
+        if (!add_handle_chunk( table ))
+        {
+            set_error( STATUS_NO_MEMORY );
+            release_object( table );
+            return NULL;
+        }
+    } while (table->count < count);
+    return table;
 }
 
 /* grow a handle table */
 static int grow_handle_table( struct handle_table *table )
 {
-    struct handle_entry *new_entries;
-    int count = min( table->count * 2, MAX_HANDLE_ENTRIES );
-
-    if (count == table->count ||
-        !(new_entries = realloc( table->entries, count * sizeof(struct handle_entry) )))
+    if (!add_handle_chunk( table ))
     {
         set_error( STATUS_INSUFFICIENT_RESOURCES );
         return 0;
     }
-    table->entries = new_entries;
-    table->count   = count;
+    table->shrink_limit = table->count / 4;
     return 1;
 }
 
-/* allocate the first free entry in the handle table */
+/* allocate a free entry in the handle table */
 static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned int access )
 {
-    struct handle_entry *entry = table->entries + table->free;
+    struct handle_entry *entry;
     int i;
 
-    for (i = table->free; i <= table->last; i++, entry++) if (!entry->ptr) goto found;
-    if (i >= table->count)
+    if ((i = table->free) != -1)
+    {
+        /* reuse the most recently freed entry */
+        entry = get_entry( table, i );
+        table->free = entry->access;
+    }
+    else
     {
-        if (!grow_handle_table( table )) return 0;
-        entry = table->entries + i;  /* the entries may have moved */
+        i = table->last + 1;
+        if (i >= table->count && !grow_handle_table( table )) return 0;
+        table->last = i;
+        entry = get_entry( table, i );
     }
-    table->last = i;
- found:
-    table->free = i + 1;
+    table->used++;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
+    unshare_sync_object( table->process, obj );
     return index_to_handle(i);
 }
 
@@ -325,30 +374,35 @@ static struct handle_entry *get_handle( struct process *process, obj_handle_t ha
     index = handle_to_index( handle );
     if (index < 0) return NULL;
     if (index > table->last) return NULL;
-    entry = table->entries + index;
+    entry = get_entry( table, index );
     if (!entry->ptr) return NULL;
     return entry;
 }
 
-/* attempt to shrink a table */
+/* free the unused chunks at the end of a table, and rebuild its free list */
 static void shrink_handle_table( struct handle_table *table )
 {
-    struct handle_entry *entry = table->entries + table->last;
-    struct handle_entry *new_entries;
-    int count = table->count;
+    struct handle_entry *entry;
+    int i;
+
+    while (table->last >= 0 && !get_entry( table, table->last )->ptr) table->last--;
+    while (table->nb_chunks > 1 && table->count - HANDLE_CHUNK_SIZE > table->last)
+    {
+        free( table->chunks[--table->nb_chunks] );
+        table->count -= HANDLE_CHUNK_SIZE;
+    }
 
-    while (table->last >= 0)
+    /* put the lowest entries first */
+    table->free = -1;
+    for (i = table->last; i >= 0; i--)
     {
-        if (entry->ptr) break;
-        table->last--;
-        entry--;
+        entry = get_entry( table, i );
+        if (entry->ptr) continue;
+        entry->access = table->free;
+        table->free = i;
     }
-    if (table->last >= count / 4) return;  /* no need to shrink */
-    if (count < MIN_HANDLE_ENTRIES * 2) return;  /* too small to shrink */
-    count /= 2;
-    if (!(new_entries = realloc( table->entries, count * sizeof(*new_entries) ))) return;
-    table->count   = count;
-    table->entries = new_entries;
+    /* don't try again until half of the remaining entries are closed */
+    table->shrink_limit = table->used / 2;
 }
 
 /* copy the handle table of the parent process */
@@ -357,25 +411,29 @@ struct handle_table *copy_handle_table( struct process *process, struct process
 {
     struct handle_table *parent_table = parent->handles;
     struct handle_table *table;
+    struct handle_entry *ptr;
     int i;
 
     assert( parent_table );
     assert( parent_table->obj.ops == &handle_table_ops );
 
-    if (!(table = alloc_handle_table( process, parent_table->count )))
+    if (!(table = alloc_handle_table( process, parent_table->last + 1 )))
         return NULL;
 
-    if ((table->last = parent_table->last) >= 0)
+    for (i = 0; i <= parent_table->last; i++)
     {
-        struct handle_entry *ptr = table->entries;
-        memcpy( ptr, parent_table->entries, (table->last + 1) * sizeof(struct handle_entry) );
-        for (i = 0; i <= table->last; i++, ptr++)
+        ptr = get_entry( table, i );
+        *ptr = *get_entry( parent_table, i );
+        if (!ptr->ptr) continue;
+        if (ptr->access & RESERVED_INHERIT)
         {
-            if (!ptr->ptr) continue;
-            if (ptr->access & RESERVED_INHERIT) grab_object_for_handle( ptr->ptr );
-            else ptr->ptr = NULL; /* don't inherit this entry */
+            grab_object_for_handle( ptr->ptr );
+            unshare_sync_object( process, ptr->ptr );
+            table->used++;
         }
+        else ptr->ptr = NULL; /* don't inherit this entry */
     }
+    table->last = parent_table->last;
     /* attempt to shrink the table */
     shrink_handle_table( table );
     return table;
@@ -384,18 +442,24 @@ struct handle_table *copy_handle_table( struct process *process, struct process
 /* close a handle and decrement the refcount of the associated object */
 unsigned int close_handle( struct process *process, obj_handle_t handle )
 {
-    struct handle_table *table;
+    struct handle_table *table = process->handles;
     struct handle_entry *entry;
     struct object *obj;
+    obj_handle_t local = handle;
 
     if (!(entry = get_handle( process, handle ))) return STATUS_INVALID_HANDLE;
     if (entry->access & RESERVED_CLOSE_PROTECT) return STATUS_HANDLE_NOT_CLOSABLE;
     obj = entry->ptr;
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
-    entry->ptr = NULL;
-    table = handle_is_global(handle) ? global_table : process->handles;
-    if (entry < table->entries + table->free) table->free = entry - table->entries;
-    if (entry == table->entries + table->last) shrink_handle_table( table );
+    if (handle_is_global(handle))
+    {
+        table = global_table;
+        local = handle_global_to_local(handle);
+    }
+    entry->ptr    = NULL;
+    entry->access = table->free;
+    table->free   = handle_to_index( local );
+    if (--table->used < table->shrink_limit) shrink_handle_table( table );
     release_object_from_handle( obj );
     return STATUS_SUCCESS;
 }
@@ -475,8 +539,9 @@ obj_handle_t find_inherited_handle( struct process *process, const struct object
 
     if (!table) return 0;
 
-    for (i = 0, ptr = table->entries; i <= table->last; i++, ptr++)
+    for (i = 0; i <= table->last; i++)
     {
+        ptr = get_entry( table, i );
         if (!ptr->ptr) continue;
         if (ptr->ptr->ops != ops) continue;
         if (ptr->access & RESERVED_INHERIT) return index_to_handle(i);
@@ -495,8 +560,9 @@ obj_handle_t enumerate_handles( struct process *process, const struct object_ops
 
     if (!table) return 0;
 
-    for (i = *index, entry = &table->entries[i]; i <= table->last; i++, entry++)
+    for (i = *index; (int)i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         if (entry->ptr->ops != ops) continue;
         *index = i + 1;
@@ -614,7 +680,7 @@ obj_handle_t open_object( struct process *process, obj_handle_t parent, unsigned
 unsigned int get_handle_table_count( struct process *process )
 {
     if (!process->handles) return 0;
-    return process->handles->count;
+    return process->handles->used;
 }
 
 /* close a handle */
@@ -785,8 +851,9 @@ static int enum_handles( struct process *process, void *user )
     if (!table)
         return 0;
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; (int)i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         if (!info->handle)
         {
@@ -55,7 +55,7 @@ static mach_port_t server_mach_port;
 
 void sigchld_callback(void)
 {
-    assert(0);  /* should never be called on MacOS */
+    /* the only children are the registry savers, which are reaped when they are created */
 }
 
 static void mach_set_error(kern_return_t mach_error)
@@ -32,21 +32,22 @@
 #include "winternl.h"
 
 #include "handle.h"
+#include "process.h"
 #include "thread.h"
 #include "request.h"
 #include "security.h"
 
 struct mutex
 {
-    struct object  obj;             /* object header */
-    struct thread *owner;           /* mutex owner */
-    unsigned int   count;           /* recursion count */
-    int            abandoned;       /* has it been abandoned? */
-    struct list    entry;           /* entry in owner thread mutex list */
+    struct object     obj;         /* object header */
+    struct sync_state sync;        /* mutex state: owner thread id and recursion count */
+    struct list       entry;       /* entry in the local mutexes of the sync area, or in owner thread mutex list */
 };
 
 static void mutex_dump( struct object *obj, int verbose );
 static struct object_type *mutex_get_type( struct object *obj );
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int mutex_map_access( struct object *obj, unsigned int access );
@@ -58,8 +59,8 @@ static const struct object_ops mutex_ops =
     sizeof(struct mutex),      /* size */
     mutex_dump,                /* dump */
     mutex_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    mutex_add_queue,           /* add_queue */
+    mutex_remove_queue,        /* remove_queue */
     mutex_signaled,            /* signaled */
     mutex_satisfied,           /* satisfied */
     mutex_signal,              /* signal */
@@ -76,29 +77,55 @@ static const struct object_ops mutex_ops =
 };
 
 
-/* grab a mutex for a given thread */
-static void do_grab( struct mutex *mutex, struct thread *thread )
+static inline thread_id_t get_mutex_owner( struct mutex *mutex )
 {
-    assert( !mutex->count || (mutex->owner == thread) );
+    thread_id_t owner = mutex->sync.shm->state & ~SHARED_SYNC_SERVER_WAIT;
+    return owner == SHARED_SYNC_MUTEX_ABANDONED ? 0 : owner;
+}
+
+static inline int is_mutex_abandoned( struct mutex *mutex )
+{
+    return (mutex->sync.shm->state & ~SHARED_SYNC_SERVER_WAIT) == SHARED_SYNC_MUTEX_ABANDONED;
+}
+
+/* grab a mutex for a given thread, return 1 if it had been abandoned */
+static int do_grab( struct mutex *mutex, struct thread *thread )
+{
+    thread_id_t owner = get_mutex_owner( mutex );
+    unsigned int prev;
 
-    if (!mutex->count++)  /* FIXME: avoid wrap-around */
+    assert( !owner || owner == thread->id );
+
+    if (owner)
     {
-        assert( !mutex->owner );
-        mutex->owner = thread;
-        list_add_head( &thread->mutex_list, &mutex->entry );
+        mutex->sync.shm->count++;  /* FIXME: avoid wrap-around */
+        return 0;
     }
+    /* clients can't grab the mutex while it's being created or waited upon */
+    prev = update_shared_sync( mutex->sync.shm, ~SHARED_SYNC_SERVER_WAIT, thread->id );
+    mutex->sync.shm->count = 1;
+    /* local mutexes stay in the sync area list, the client can grab them without telling us */
+    if (!is_sync_state_local( &mutex->sync )) list_add_head( &thread->mutex_list, &mutex->entry );
+    return (prev & ~SHARED_SYNC_SERVER_WAIT) == SHARED_SYNC_MUTEX_ABANDONED;
 }
 
-/* release a mutex once the recursion count is 0 */
-static void do_release( struct mutex *mutex )
+/* release a mutex once the recursion count is 0, state is 0 or SHARED_SYNC_MUTEX_ABANDONED */
+static void do_release( struct mutex *mutex, unsigned int state )
 {
-    assert( !mutex->count );
+    assert( !mutex->sync.shm->count );
     /* remove the mutex from the thread list of owned mutexes */
-    list_remove( &mutex->entry );
-    mutex->owner = NULL;
+    if (!is_sync_state_local( &mutex->sync )) list_remove( &mutex->entry );
+    update_shared_sync( mutex->sync.shm, ~SHARED_SYNC_SERVER_WAIT, state );
     wake_up( &mutex->obj, 0 );
 }
 
+/* abandon a mutex owned by a terminated thread */
+static void do_abandon( struct mutex *mutex )
+{
+    mutex->sync.shm->count = 0;
+    do_release( mutex, SHARED_SYNC_MUTEX_ABANDONED );
+}
+
 static struct mutex *create_mutex( struct object *root, const struct unicode_str *name,
                                    unsigned int attr, int owned, const struct security_descriptor *sd )
 {
@@ -109,9 +136,13 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            mutex->count = 0;
-            mutex->owner = NULL;
-            mutex->abandoned = 0;
+            if (!alloc_sync_state( &mutex->sync, current->process ))
+            {
+                release_object( mutex );
+                return NULL;
+            }
+            if (is_sync_state_local( &mutex->sync ))
+                list_add_tail( get_sync_area_mutexes( mutex->sync.area ), &mutex->entry );
             if (owned) do_grab( mutex, current );
         }
     }
@@ -120,15 +151,78 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
 
 void abandon_mutexes( struct thread *thread )
 {
-    struct list *ptr;
+    struct mutex *mutex, **owned;
+    struct list *ptr, *local;
+    unsigned int i, count = 0;
 
     while ((ptr = list_head( &thread->mutex_list )) != NULL)
     {
-        struct mutex *mutex = LIST_ENTRY( ptr, struct mutex, entry );
-        assert( mutex->owner == thread );
-        mutex->count = 0;
-        mutex->abandoned = 1;
-        do_release( mutex );
+        mutex = LIST_ENTRY( ptr, struct mutex, entry );
+        assert( get_mutex_owner( mutex ) == thread->id );
+        do_abandon( mutex );
+    }
+
+    /* the client may also have grabbed some of the mutexes local to its process */
+    if (!thread->process->sync_area) return;
+    local = get_sync_area_mutexes( thread->process->sync_area );
+
+    /* waking up waiters may release other mutexes, so grab them first */
+    LIST_FOR_EACH_ENTRY( mutex, local, struct mutex, entry )
+        if (get_mutex_owner( mutex ) == thread->id) count++;
+    if (!count || !(owned = mem_alloc( count * sizeof(*owned) ))) return;
+
+    count = 0;
+    LIST_FOR_EACH_ENTRY( mutex, local, struct mutex, entry )
+        if (get_mutex_owner( mutex ) == thread->id) owned[count++] = (struct mutex *)grab_object( mutex );
+
+    for (i = 0; i < count; i++)
+    {
+        if (get_mutex_owner( owned[i] ) == thread->id) do_abandon( owned[i] );
+        release_object( owned[i] );
+    }
+    free( owned );
+}
+
+/* return the state of a mutex and its type, or NULL if not a mutex */
+struct sync_state *get_mutex_sync_state( struct object *obj, int *type )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+
+    if (obj->ops != &mutex_ops) return NULL;
+    *type = SHARED_SYNC_MUTEX;
+    return &mutex->sync;
+}
+
+/* move the state of a local mutex to server memory, once it's used by other processes */
+void unshare_mutex( struct object *obj )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    struct sync_area *area = mutex->sync.area;
+    unsigned int error = get_error();
+    struct thread *thread;
+    thread_id_t owner;
+
+    assert( obj->ops == &mutex_ops );
+
+    unshare_sync_state( &mutex->sync );
+    if (is_sync_state_local( &mutex->sync )) return;  /* out of memory, keep it local */
+    list_remove( &mutex->entry );
+    list_init( &mutex->entry );
+    if (!(owner = get_mutex_owner( mutex ))) return;
+
+    /* the owner was set by the client, make sure it's one of its threads */
+    if ((thread = get_thread_from_id( owner )))
+    {
+        if (thread->state != TERMINATED && thread->process->sync_area == area)
+            list_add_head( &thread->mutex_list, &mutex->entry );
+        else
+            do_abandon( mutex );
+        release_object( thread );
+    }
+    else
+    {
+        do_abandon( mutex );
+        set_error( error );
     }
 }
 
@@ -136,7 +230,7 @@ static void mutex_dump( struct object *obj, int verbose )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
+    fprintf( stderr, "Mutex count=%u owner=%04x\n", mutex->sync.shm->count, get_mutex_owner( mutex ));
 }
 
 static struct object_type *mutex_get_type( struct object *obj )
@@ -146,11 +240,28 @@ static struct object_type *mutex_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    return shared_sync_add_queue( obj, entry, &mutex->sync );
+}
+
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    shared_sync_remove_queue( obj, entry, &mutex->sync );
+}
+
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct mutex *mutex = (struct mutex *)obj;
+    thread_id_t owner;
+
     assert( obj->ops == &mutex_ops );
-    return (!mutex->count || (mutex->owner == get_wait_queue_thread( entry )));
+    owner = get_mutex_owner( mutex );
+    return (!owner || (owner == get_wait_queue_thread( entry )->id));
 }
 
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry )
@@ -158,9 +269,7 @@ static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
-    do_grab( mutex, get_wait_queue_thread( entry ));
-    if (mutex->abandoned) make_wait_abandoned( entry );
-    mutex->abandoned = 0;
+    if (do_grab( mutex, get_wait_queue_thread( entry ))) make_wait_abandoned( entry );
 }
 
 static unsigned int mutex_map_access( struct object *obj, unsigned int access )
@@ -182,12 +291,12 @@ static int mutex_signal( struct object *obj, unsigned int access )
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
-    if (!mutex->count || (mutex->owner != current))
+    if (get_mutex_owner( mutex ) != current->id)
     {
         set_error( STATUS_MUTANT_NOT_OWNED );
         return 0;
     }
-    if (!--mutex->count) do_release( mutex );
+    if (!--mutex->sync.shm->count) do_release( mutex, 0 );
     return 1;
 }
 
@@ -196,9 +305,9 @@ static void mutex_destroy( struct object *obj )
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
-    if (!mutex->count) return;
-    mutex->count = 0;
-    do_release( mutex );
+    if (!mutex->sync.shm) return;
+    if (is_sync_state_local( &mutex->sync ) || get_mutex_owner( mutex )) list_remove( &mutex->entry );
+    free_sync_state( &mutex->sync );
 }
 
 /* create a mutex */
@@ -242,11 +351,11 @@ DECL_HANDLER(release_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  0, &mutex_ops )))
     {
-        if (!mutex->count || (mutex->owner != current)) set_error( STATUS_MUTANT_NOT_OWNED );
+        if (get_mutex_owner( mutex ) != current->id) set_error( STATUS_MUTANT_NOT_OWNED );
         else
         {
-            reply->prev_count = mutex->count;
-            if (!--mutex->count) do_release( mutex );
+            reply->prev_count = mutex->sync.shm->count;
+            if (!--mutex->sync.shm->count) do_release( mutex, 0 );
         }
         release_object( mutex );
     }
@@ -260,9 +369,9 @@ DECL_HANDLER(query_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  MUTANT_QUERY_STATE, &mutex_ops )))
     {
-        reply->count = mutex->count;
-        reply->owned = (mutex->owner == current);
-        reply->abandoned = mutex->abandoned;
+        reply->count = mutex->sync.shm->count;
+        reply->owned = (get_mutex_owner( mutex ) == current->id);
+        reply->abandoned = is_mutex_abandoned( mutex );
 
         release_object( mutex );
     }
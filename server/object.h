@@ -113,6 +113,8 @@ struct object_name
     struct list         entry;           /* entry in the hash list */
     struct object      *obj;             /* object owning this name */
     struct object      *parent;          /* parent object */
+    struct namespace   *namespace;       /* namespace containing the name */
+    unsigned int        hash;            /* case-insensitive hash of the name */
     data_size_t         len;             /* name length in bytes */
     WCHAR               name[1];
 };
@@ -141,6 +143,7 @@ extern void *open_named_object( struct object *parent, const struct object_ops *
 extern void unlink_named_object( struct object *obj );
 extern void make_object_static( struct object *obj );
 extern struct namespace *create_namespace( unsigned int hash_size );
+extern void free_namespace( struct namespace *namespace );
 /* grab/release_object can take any pointer, but you better make sure */
 /* that the thing pointed to starts with a struct object... */
 extern struct object *grab_object( void *obj );
@@ -177,7 +180,7 @@ struct keyed_event;
 
 extern struct event *create_event( struct object *root, const struct unicode_str *name,
                                    unsigned int attr, int manual_reset, int initial_state,
-                                   const struct security_descriptor *sd );
+                                   const struct security_descriptor *sd, struct process *process );
 extern struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                                unsigned int attr, const struct security_descriptor *sd );
 extern struct event *get_event_obj( struct process *process, obj_handle_t handle, unsigned int access );
@@ -190,6 +193,33 @@ extern void reset_event( struct event *event );
 
 extern void abandon_mutexes( struct thread *thread );
 
+/* shared synchronization state functions */
+
+struct sync_area;
+
+/* state of an event, semaphore or mutex */
+struct sync_state
+{
+    shared_sync_t    *shm;      /* current state, in the sync area or in server memory */
+    struct sync_area *area;     /* sync area of the process the object was created by, if any */
+    unsigned int      index;    /* index of the object slot in the sync area */
+};
+
+extern int alloc_sync_state( struct sync_state *sync, struct process *process );
+extern void free_sync_state( struct sync_state *sync );
+extern int is_sync_state_local( const struct sync_state *sync );
+extern void unshare_sync_state( struct sync_state *sync );
+extern unsigned int update_shared_sync( shared_sync_t *shm, unsigned int mask, unsigned int value );
+extern int shared_sync_add_queue( struct object *obj, struct wait_queue_entry *entry, struct sync_state *sync );
+extern void shared_sync_remove_queue( struct object *obj, struct wait_queue_entry *entry, struct sync_state *sync );
+extern void unshare_sync_object( struct process *process, struct object *obj );
+extern struct list *get_sync_area_mutexes( struct sync_area *area );
+extern void release_sync_area( struct process *process );
+extern struct sync_state *get_event_sync_state( struct object *obj, int *type );
+extern struct sync_state *get_semaphore_sync_state( struct object *obj, int *type );
+extern struct sync_state *get_mutex_sync_state( struct object *obj, int *type );
+extern void unshare_mutex( struct object *obj );
+
 /* serial functions */
 
 int get_serial_async_timeout(struct object *obj, int type, int count);
@@ -527,12 +527,17 @@ struct thread *create_process( int fd, struct thread *parent_thread, int inherit
     process->peb             = 0;
     process->ldt_copy        = 0;
     process->dir_cache       = NULL;
+    process->request_ring    = NULL;
+    process->sync_area       = NULL;
     process->winstation      = 0;
     process->desktop         = 0;
     process->token           = NULL;
     process->trace_data      = 0;
     process->rawinput_mouse  = NULL;
     process->rawinput_kbd    = NULL;
+    process->request_count   = 0;
+    process->request_fds     = 0;
+    process->request_time    = 0;
     list_init( &process->thread_list );
     list_init( &process->locks );
     list_init( &process->classes );
@@ -618,6 +623,7 @@ static void process_destroy( struct object *obj )
     assert( !process->sigkill_timeout );  /* timeout should hold a reference to the process */
 
     close_process_handles( process );
+    release_sync_area( process );
     set_process_startup_state( process, STARTUP_ABORTED );
 
     if (process->job)
@@ -866,6 +872,7 @@ static void process_killed( struct process *process )
     remove_process_locks( process );
     set_process_startup_state( process, STARTUP_ABORTED );
     finish_process_tracing( process );
+    free_request_ring( process );
     release_job_process( process );
     start_sigkill_timer( process );
     wake_up( &process->obj, 0 );
@@ -1313,7 +1320,7 @@ DECL_HANDLER(init_process_done)
     generate_startup_debug_events( process, req->entry );
     set_process_startup_state( process, STARTUP_DONE );
 
-    if (req->gui) process->idle_event = create_event( NULL, NULL, 0, 1, 0, NULL );
+    if (req->gui) process->idle_event = create_event( NULL, NULL, 0, 1, 0, NULL, NULL );
     stop_thread_if_suspended( current );
     if (process->debugger) set_process_debug_flag( process, 1 );
 }
@@ -1369,6 +1376,20 @@ DECL_HANDLER(get_process_info)
     }
 }
 
+/* retrieve the request totals of a process */
+DECL_HANDLER(get_process_request_stats)
+{
+    struct process *process;
+
+    if ((process = get_process_from_handle( req->handle, PROCESS_QUERY_LIMITED_INFORMATION )))
+    {
+        reply->count      = process->request_count;
+        reply->fd_count   = process->request_fds;
+        reply->total_time = process->request_time;
+        release_object( process );
+    }
+}
+
 static void set_process_affinity( struct process *process, affinity_t affinity )
 {
     struct thread *thread;
@@ -1522,7 +1543,7 @@ DECL_HANDLER(make_process_system)
 
     if (!shutdown_event)
     {
-        if (!(shutdown_event = create_event( NULL, NULL, 0, 1, 0, NULL ))) return;
+        if (!(shutdown_event = create_event( NULL, NULL, 0, 1, 0, NULL, NULL ))) return;
         make_object_static( (struct object *)shutdown_event );
     }
 
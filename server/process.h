@@ -91,10 +91,15 @@ struct process
     client_ptr_t         peb;             /* PEB address in client address space */
     client_ptr_t         ldt_copy;        /* pointer to LDT copy in client addr space */
     struct dir_cache    *dir_cache;       /* map of client-side directory cache */
+    struct request_ring *request_ring;    /* shared memory request ring */
+    struct sync_area    *sync_area;       /* shared memory state of the process synchronization objects */
     unsigned int         trace_data;      /* opaque data used by the process tracing mechanism */
     struct list          rawinput_devices;/* list of registered rawinput devices */
     const struct rawinput_device *rawinput_mouse; /* rawinput mouse device, if any */
     const struct rawinput_device *rawinput_kbd;   /* rawinput keyboard device, if any */
+    unsigned int         request_count;   /* number of requests handled for this process */
+    unsigned int         request_fds;     /* number of fds passed to this process */
+    timeout_t            request_time;    /* total time spent handling its requests */
 };
 
 struct process_snapshot
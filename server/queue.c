@@ -88,7 +88,10 @@ struct message
 
 struct timer
 {
-    struct list     entry;     /* entry in timer list */
+    struct list     entry;     /* entry in expired timer list */
+    struct list     hash_entry; /* entry in timer hash table */
+    unsigned int    heap_pos;  /* position in pending timer heap, or -1 if expired */
+    unsigned int    seq;       /* link order, for timers expiring at the same time */
     timeout_t       when;      /* next expiration */
     unsigned int    rate;      /* timer rate in ms */
     user_handle_t   win;       /* window handle */
@@ -133,7 +136,13 @@ struct msg_queue
     struct list            send_result;     /* stack of sent messages waiting for result */
     struct list            callback_result; /* list of callback messages waiting for result */
     struct message_result *recv_result;     /* stack of received messages waiting for result */
-    struct list            pending_timers;  /* list of pending timers */
+    struct timer         **pending_timers;  /* heap of pending timers, next to expire first */
+    unsigned int           nb_pending;      /* number of pending timers */
+    unsigned int           nb_timers;       /* total number of timers */
+    unsigned int           heap_size;       /* allocated size of the pending timer heap */
+    unsigned int           timer_seq;       /* sequence number of the last linked timer */
+    struct list           *timer_hash;      /* hash table of timers by window, msg and id */
+    unsigned int           timer_hash_size; /* number of buckets in the timer hash table */
     struct list            expired_timers;  /* list of expired timers */
     lparam_t               next_timer_id;   /* id for the next timer with a 0 window */
     struct timeout_user   *timeout;         /* timeout for next timer to expire */
@@ -300,7 +309,13 @@ static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_
         queue->last_get_msg    = current_time;
         list_init( &queue->send_result );
         list_init( &queue->callback_result );
-        list_init( &queue->pending_timers );
+        queue->pending_timers  = NULL;
+        queue->nb_pending      = 0;
+        queue->nb_timers       = 0;
+        queue->heap_size       = 0;
+        queue->timer_seq       = 0;
+        queue->timer_hash      = NULL;
+        queue->timer_hash_size = 0;
         list_init( &queue->expired_timers );
         for (i = 0; i < NB_MSG_KINDS; i++) list_init( &queue->msg_list[i] );
 
@@ -978,18 +993,15 @@ static void msg_queue_destroy( struct object *obj )
         }
     }
 
-    while ((ptr = list_head( &queue->pending_timers )))
-    {
-        struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
-        list_remove( &timer->entry );
-        free( timer );
-    }
+    for (i = 0; i < queue->nb_pending; i++) free( queue->pending_timers[i] );
     while ((ptr = list_head( &queue->expired_timers )))
     {
         struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
         list_remove( &timer->entry );
         free( timer );
     }
+    free( queue->pending_timers );
+    free( queue->timer_hash );
     if (queue->timeout) remove_timeout_user( queue->timeout );
     queue->input->cursor_count -= queue->cursor_count;
     release_object( queue->input );
@@ -1131,18 +1143,14 @@ void detach_thread_input( struct thread *thread_from )
 /* set the next timer to expire */
 static void set_next_timer( struct msg_queue *queue )
 {
-    struct list *ptr;
-
     if (queue->timeout)
     {
         remove_timeout_user( queue->timeout );
         queue->timeout = NULL;
     }
-    if ((ptr = list_head( &queue->pending_timers )))
-    {
-        struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
-        queue->timeout = add_timeout_user( timer->when, timer_callback, queue );
-    }
+    if (queue->nb_pending)
+        queue->timeout = add_timeout_user( queue->pending_timers[0]->when, timer_callback, queue );
+
     /* set/clear QS_TIMER bit */
     if (list_empty( &queue->expired_timers ))
         clear_queue_bits( queue, QS_TIMER );
@@ -1150,22 +1158,110 @@ static void set_next_timer( struct msg_queue *queue )
         set_queue_bits( queue, QS_TIMER );
 }
 
+/* check if a timer must expire before another one */
+static inline int timer_before( const struct timer *t1, const struct timer *t2 )
+{
+    if (t1->when != t2->when) return t1->when < t2->when;
+    return (int)(t1->seq - t2->seq) > 0;  /* the most recently linked timer goes first */
+}
+
+/* store a timer at a given position of the pending timer heap */
+static inline void set_heap_timer( struct msg_queue *queue, unsigned int pos, struct timer *timer )
+{
+    queue->pending_timers[pos] = timer;
+    timer->heap_pos = pos;
+}
+
+/* move a timer up or down the heap until it's at its rightful place */
+static void sift_timer( struct msg_queue *queue, unsigned int pos )
+{
+    struct timer *timer = queue->pending_timers[pos];
+    unsigned int child;
+
+    while (pos && timer_before( timer, queue->pending_timers[(pos - 1) / 2] ))
+    {
+        set_heap_timer( queue, pos, queue->pending_timers[(pos - 1) / 2] );
+        pos = (pos - 1) / 2;
+    }
+    while ((child = 2 * pos + 1) < queue->nb_pending)
+    {
+        if (child + 1 < queue->nb_pending &&
+            timer_before( queue->pending_timers[child + 1], queue->pending_timers[child] ))
+            child++;
+        if (!timer_before( queue->pending_timers[child], timer )) break;
+        set_heap_timer( queue, pos, queue->pending_timers[child] );
+        pos = child;
+    }
+    set_heap_timer( queue, pos, timer );
+}
+
+/* remove a timer from the pending timer heap */
+static void unlink_timer( struct msg_queue *queue, struct timer *timer )
+{
+    unsigned int pos = timer->heap_pos;
+
+    timer->heap_pos = ~0u;
+    if (pos != --queue->nb_pending)
+    {
+        set_heap_timer( queue, pos, queue->pending_timers[queue->nb_pending] );
+        sift_timer( queue, pos );
+    }
+}
+
+/* link a timer at its rightful place in the pending timer heap */
+/* the heap is always large enough to hold all the queue timers */
+static void link_timer( struct msg_queue *queue, struct timer *timer )
+{
+    timer->seq = ++queue->timer_seq;
+    set_heap_timer( queue, queue->nb_pending++, timer );
+    sift_timer( queue, timer->heap_pos );
+}
+
+static inline unsigned int timer_hash( const struct msg_queue *queue, user_handle_t win,
+                                       unsigned int msg, lparam_t id )
+{
+    unsigned int hash = win;
+
+    hash = hash * 31 + msg;
+    hash = hash * 31 + (unsigned int)id;
+    hash = hash * 31 + (unsigned int)(id >> 32);
+    return (hash ^ (hash >> 16)) & (queue->timer_hash_size - 1);
+}
+
+/* grow the timer hash table to keep the buckets short */
+static void grow_timer_hash( struct msg_queue *queue )
+{
+    unsigned int i, old_size = queue->timer_hash_size;
+    struct list *old_hash = queue->timer_hash;
+    struct timer *timer, *next;
+
+    if (!(queue->timer_hash = malloc( max( 2 * old_size, 16 ) * sizeof(*queue->timer_hash) )))
+    {
+        queue->timer_hash = old_hash;
+        return;
+    }
+    queue->timer_hash_size = max( 2 * old_size, 16 );
+    for (i = 0; i < queue->timer_hash_size; i++) list_init( &queue->timer_hash[i] );
+    for (i = 0; i < old_size; i++)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( timer, next, &old_hash[i], struct timer, hash_entry )
+            list_add_tail( &queue->timer_hash[timer_hash( queue, timer->win, timer->msg, timer->id )],
+                           &timer->hash_entry );
+    }
+    free( old_hash );
+}
+
 /* find a timer from its window and id */
 static struct timer *find_timer( struct msg_queue *queue, user_handle_t win,
                                  unsigned int msg, lparam_t id )
 {
-    struct list *ptr;
+    struct timer *timer;
 
-    /* we need to search both lists */
+    if (!queue->nb_timers) return NULL;
 
-    LIST_FOR_EACH( ptr, &queue->pending_timers )
+    LIST_FOR_EACH_ENTRY( timer, &queue->timer_hash[timer_hash( queue, win, msg, id )],
+                         struct timer, hash_entry )
     {
-        struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
-        if (timer->win == win && timer->msg == msg && timer->id == id) return timer;
-    }
-    LIST_FOR_EACH( ptr, &queue->expired_timers )
-    {
-        struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
         if (timer->win == win && timer->msg == msg && timer->id == id) return timer;
     }
     return NULL;
@@ -1175,33 +1271,22 @@ static struct timer *find_timer( struct msg_queue *queue, user_handle_t win,
 static void timer_callback( void *private )
 {
     struct msg_queue *queue = private;
-    struct list *ptr;
+    struct timer *timer = queue->pending_timers[0];
 
     queue->timeout = NULL;
     /* move on to the next timer */
-    ptr = list_head( &queue->pending_timers );
-    list_remove( ptr );
-    list_add_tail( &queue->expired_timers, ptr );
+    unlink_timer( queue, timer );
+    list_add_tail( &queue->expired_timers, &timer->entry );
     set_next_timer( queue );
 }
 
-/* link a timer at its rightful place in the queue list */
-static void link_timer( struct msg_queue *queue, struct timer *timer )
-{
-    struct list *ptr;
-
-    for (ptr = queue->pending_timers.next; ptr != &queue->pending_timers; ptr = ptr->next)
-    {
-        struct timer *t = LIST_ENTRY( ptr, struct timer, entry );
-        if (t->when >= timer->when) break;
-    }
-    list_add_before( ptr, &timer->entry );
-}
-
 /* remove a timer from the queue timer list and free it */
 static void free_timer( struct msg_queue *queue, struct timer *timer )
 {
-    list_remove( &timer->entry );
+    if (timer->heap_pos != ~0u) unlink_timer( queue, timer );
+    else list_remove( &timer->entry );
+    list_remove( &timer->hash_entry );
+    queue->nb_timers--;
     free( timer );
     set_next_timer( queue );
 }
@@ -1236,17 +1321,43 @@ static struct timer *find_expired_timer( struct msg_queue *queue, user_handle_t
 }
 
 /* add a timer */
-static struct timer *set_timer( struct msg_queue *queue, unsigned int rate )
+static struct timer *set_timer( struct msg_queue *queue, unsigned int rate, user_handle_t win,
+                                unsigned int msg, lparam_t id, lparam_t lparam )
 {
-    struct timer *timer = mem_alloc( sizeof(*timer) );
-    if (timer)
+    struct timer *timer;
+
+    if (queue->nb_timers == queue->heap_size)
     {
-        timer->rate = max( rate, 1 );
-        timer->when = current_time + (timeout_t)timer->rate * 10000;
-        link_timer( queue, timer );
-        /* check if we replaced the next timer */
-        if (list_head( &queue->pending_timers ) == &timer->entry) set_next_timer( queue );
+        unsigned int new_size = max( queue->heap_size * 2, 16 );
+        struct timer **new_heap = realloc( queue->pending_timers, new_size * sizeof(*new_heap) );
+
+        if (!new_heap)
+        {
+            set_error( STATUS_NO_MEMORY );
+            return NULL;
+        }
+        queue->pending_timers = new_heap;
+        queue->heap_size = new_size;
     }
+    if (queue->nb_timers >= 2 * queue->timer_hash_size) grow_timer_hash( queue );
+    if (!queue->timer_hash_size)
+    {
+        set_error( STATUS_NO_MEMORY );
+        return NULL;
+    }
+
+    if (!(timer = mem_alloc( sizeof(*timer) ))) return NULL;
+    timer->rate   = max( rate, 1 );
+    timer->when   = current_time + (timeout_t)timer->rate * 10000;
+    timer->win    = win;
+    timer->msg    = msg;
+    timer->id     = id;
+    timer->lparam = lparam;
+    list_add_head( &queue->timer_hash[timer_hash( queue, win, msg, id )], &timer->hash_entry );
+    queue->nb_timers++;
+    link_timer( queue, timer );
+    /* check if we replaced the next timer */
+    if (queue->pending_timers[0] == timer) set_next_timer( queue );
     return timer;
 }
 
@@ -2033,28 +2144,18 @@ void inc_queue_paint_count( struct thread *thread, int incr )
 void queue_cleanup_window( struct thread *thread, user_handle_t win )
 {
     struct msg_queue *queue = thread->queue;
-    struct list *ptr;
-    int i;
+    unsigned int i;
 
     if (!queue) return;
 
     /* remove timers */
 
-    ptr = list_head( &queue->pending_timers );
-    while (ptr)
+    for (i = 0; queue->nb_timers && i < queue->timer_hash_size; i++)
     {
-        struct list *next = list_next( &queue->pending_timers, ptr );
-        struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
-        if (timer->win == win) free_timer( queue, timer );
-        ptr = next;
-    }
-    ptr = list_head( &queue->expired_timers );
-    while (ptr)
-    {
-        struct list *next = list_next( &queue->expired_timers, ptr );
-        struct timer *timer = LIST_ENTRY( ptr, struct timer, entry );
-        if (timer->win == win) free_timer( queue, timer );
-        ptr = next;
+        struct timer *timer, *next;
+
+        LIST_FOR_EACH_ENTRY_SAFE( timer, next, &queue->timer_hash[i], struct timer, hash_entry )
+            if (timer->win == win) free_timer( queue, timer );
     }
 
     /* remove messages */
@@ -2603,14 +2704,7 @@ DECL_HANDLER(set_win_timer)
         }
     }
 
-    if ((timer = set_timer( queue, req->rate )))
-    {
-        timer->win    = win;
-        timer->msg    = req->msg;
-        timer->id     = id;
-        timer->lparam = req->lparam;
-        reply->id     = id;
-    }
+    if ((timer = set_timer( queue, req->rate, win, req->msg, id, req->lparam ))) reply->id = id;
     if (thread) release_object( thread );
 }
 
@@ -27,6 +27,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -35,6 +36,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -119,12 +127,38 @@ static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_va
 
 static void set_periodic_save_timer(void);
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void add_journal_record( const struct key *key, unsigned int op, const WCHAR *name,
+                                data_size_t namelen, unsigned int type, const void *data, data_size_t len );
+static void invalidate_registry_journal( const struct key *key );
+
+/* a registry branch being saved by a child process */
+struct branch_saver
+{
+    struct object             obj;     /* object header */
+    struct fd                *fd;      /* pipe receiving the result from the child */
+    struct save_branch_info  *info;    /* branch being saved */
+};
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
-    struct key  *key;
-    const char  *path;
+    struct key           *key;
+    const char           *path;
+    struct branch_saver  *saver;              /* background save in progress */
+    char                 *journal;            /* journal records not written yet */
+    size_t                journal_len;        /* size of the pending records */
+    size_t                journal_size;       /* allocated size of the journal buffer */
+    size_t                journal_file_size;  /* size of the journal file, 0 if none */
+    int                   journal_invalid;    /* the journal is missing changes, rewrite the file */
+};
+
+/* journal operations */
+enum journal_op
+{
+    JOURNAL_CREATE_KEY,    /* name is the class, type is the key flags */
+    JOURNAL_DELETE_KEY,
+    JOURNAL_SET_VALUE,
+    JOURNAL_DELETE_VALUE
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
@@ -829,6 +863,8 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
         if (!(key->class = memdup( class->str, key->classlen ))) key->classlen = 0;
     }
     touch_key( key->parent, REG_NOTIFY_CHANGE_NAME );
+    add_journal_record( key, JOURNAL_CREATE_KEY, key->class, key->classlen,
+                        key->flags & KEY_SYMLINK, NULL, 0 );
     grab_object( key );
     return key;
 }
@@ -1012,6 +1048,7 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    add_journal_record( key, JOURNAL_DELETE_KEY, NULL, 0, 0, NULL, 0 );
     free_subkey( parent, index );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 0;
@@ -1139,6 +1176,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    add_journal_record( key, JOURNAL_SET_VALUE, value->name, value->namelen, type, ptr, len );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1225,6 +1263,7 @@ static void delete_value( struct key *key, const struct unicode_str *name )
         return;
     }
     if (debug_level > 1) dump_operation( key, value, "Delete" );
+    add_journal_record( key, JOURNAL_DELETE_VALUE, value->name, value->namelen, 0, NULL, 0 );
     free( value->name );
     free( value->data );
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
@@ -1714,12 +1753,741 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/*
+ * Binary registry cache
+ *
+ * When the WINEREGISTRYCACHE environment variable is set, a binary copy of
+ * each initial registry file is written next to it with a ".cache" suffix.
+ * It stores the keys depth-first in a form that can be loaded without any
+ * text parsing. The cache is only used if the size, modification time and
+ * inode of the text file still match the ones recorded in its header, so
+ * editing the text file by hand invalidates it.
+ *
+ * The format uses the native byte order and is not meant to be portable.
+ */
+
+#define REG_CACHE_MAGIC   "WINEREGC"
+#define REG_CACHE_VERSION 1
+
+struct reg_cache_header
+{
+    char              magic[8];     /* REG_CACHE_MAGIC */
+    unsigned int      version;      /* REG_CACHE_VERSION */
+    unsigned int      prefix_type;  /* prefix type of the registry */
+    unsigned __int64  file_size;    /* size of the text file */
+    unsigned __int64  file_mtime;   /* modification time of the text file */
+    unsigned __int64  file_ino;     /* inode of the text file */
+    unsigned int      data_size;    /* size of the data following the header */
+    unsigned int      checksum;     /* checksum of the data */
+};
+
+/* followed by the name and class, padded to 8 bytes, then the values and subkeys */
+struct reg_cache_key
+{
+    timeout_t         modif;        /* last modification time */
+    unsigned int      flags;        /* KEY_SYMLINK */
+    unsigned int      namelen;      /* length of the key name in bytes */
+    unsigned int      classlen;     /* length of the class name in bytes */
+    unsigned int      nb_values;    /* number of values */
+    unsigned int      nb_subkeys;   /* number of (non-volatile) subkeys */
+    unsigned int      __pad;
+};
+
+/* followed by the name and data, padded to 8 bytes */
+struct reg_cache_value
+{
+    unsigned int      namelen;      /* length of the value name in bytes */
+    unsigned int      type;         /* value type */
+    unsigned int      len;          /* length of the data in bytes */
+    unsigned int      __pad;
+};
+
+#define REG_CACHE_ALIGN(len) (((len) + 7) & ~7)
+
+static int use_registry_cache(void)
+{
+    static int enabled = -1;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINEREGISTRYCACHE" );
+        enabled = env && atoi( env );
+    }
+    return enabled;
+}
+
+static char *get_registry_cache_name( const char *path )
+{
+    char *name;
+
+    if ((name = malloc( strlen(path) + sizeof(".cache") ))) sprintf( name, "%s.cache", path );
+    return name;
+}
+
+/* update the checksum with data whose size is a multiple of 4 bytes */
+static unsigned int update_registry_cache_checksum( unsigned int sum, const void *data, unsigned int size )
+{
+    const unsigned int *ptr = data;
+
+    for (size /= sizeof(*ptr); size; size--) sum = ((sum << 5) | (sum >> 27)) ^ *ptr++;
+    return sum;
+}
+
+/* write data to the cache file, padded to 8 bytes */
+static int write_registry_cache_data( FILE *f, const void *data, unsigned int len, unsigned int *checksum )
+{
+    unsigned int size = REG_CACHE_ALIGN( len );
+    char buffer[256];
+
+    while (size)
+    {
+        /* the checksum needs whole words, so go through an aligned buffer */
+        unsigned int chunk = min( size, sizeof(buffer) );
+        unsigned int copy = min( chunk, len );
+
+        if (copy) memcpy( buffer, data, copy );
+        memset( buffer + copy, 0, chunk - copy );
+        *checksum = update_registry_cache_checksum( *checksum, buffer, chunk );
+        if (fwrite( buffer, chunk, 1, f ) != 1) return 0;
+        data = (const char *)data + copy;
+        len -= copy;
+        size -= chunk;
+    }
+    return 1;
+}
+
+/* write a key and its subkeys to the cache file */
+static int save_registry_cache_key( FILE *f, const struct key *key, unsigned int *checksum )
+{
+    struct reg_cache_key rec;
+    struct reg_cache_value val;
+    int i;
+
+    memset( &rec, 0, sizeof(rec) );
+    rec.modif     = key->modif;
+    rec.flags     = key->flags & KEY_SYMLINK;
+    rec.namelen   = key->namelen;
+    rec.classlen  = key->classlen;
+    rec.nb_values = key->last_value + 1;
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) rec.nb_subkeys++;
+
+    if (!write_registry_cache_data( f, &rec, sizeof(rec), checksum )) return 0;
+    if (!write_registry_cache_data( f, key->name, key->namelen, checksum )) return 0;
+    if (!write_registry_cache_data( f, key->class, key->classlen, checksum )) return 0;
+
+    for (i = 0; i <= key->last_value; i++)
+    {
+        const struct key_value *value = &key->values[i];
+
+        memset( &val, 0, sizeof(val) );
+        val.namelen = value->namelen;
+        val.type    = value->type;
+        val.len     = value->len;
+        if (!write_registry_cache_data( f, &val, sizeof(val), checksum )) return 0;
+        if (!write_registry_cache_data( f, value->name, value->namelen, checksum )) return 0;
+        if (!write_registry_cache_data( f, value->data, value->len, checksum )) return 0;
+    }
+
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        if (!save_registry_cache_key( f, key->subkeys[i], checksum )) return 0;
+    }
+    return 1;
+}
+
+/* write the binary cache for the registry file at path */
+static void save_registry_cache( struct key *key, const char *path )
+{
+    struct reg_cache_header header;
+    struct stat st;
+    char *name, *tmp;
+    long size;
+    FILE *f;
+    int ret = 0;
+
+    if (!use_registry_cache()) return;
+    if (stat( path, &st ) == -1) return;
+    if (!(name = get_registry_cache_name( path ))) return;
+    if (!(tmp = malloc( strlen(name) + sizeof(".tmp") )))
+    {
+        free( name );
+        return;
+    }
+    sprintf( tmp, "%s.tmp", name );
+
+    if ((f = fopen( tmp, "wb" )))
+    {
+        memset( &header, 0, sizeof(header) );
+        memcpy( header.magic, REG_CACHE_MAGIC, sizeof(header.magic) );
+        header.version     = REG_CACHE_VERSION;
+        header.prefix_type = prefix_type;
+        header.file_size   = st.st_size;
+        header.file_mtime  = st.st_mtime;
+        header.file_ino    = st.st_ino;
+
+        /* the header is rewritten once the size and checksum are known */
+        if (fwrite( &header, sizeof(header), 1, f ) == 1 &&
+            save_registry_cache_key( f, key, &header.checksum ) &&
+            (size = ftell( f )) != -1 && size - sizeof(header) <= UINT_MAX)
+        {
+            header.data_size = size - sizeof(header);
+            ret = !fseek( f, 0, SEEK_SET ) && fwrite( &header, sizeof(header), 1, f ) == 1;
+        }
+        if (fclose( f )) ret = 0;
+        if (ret) ret = !rename( tmp, name );
+        if (!ret) unlink( tmp );
+    }
+    free( tmp );
+    free( name );
+}
+
+/* state of the cache file being loaded */
+struct reg_cache_load
+{
+    const char  *ptr;   /* current position */
+    const char  *end;   /* end of the data */
+};
+
+/* get a pointer to the next len bytes of the cache, skipping the padding */
+static const void *get_registry_cache_data( struct reg_cache_load *load, unsigned int len )
+{
+    const void *ret = load->ptr;
+
+    if (REG_CACHE_ALIGN( len ) < len || REG_CACHE_ALIGN( len ) > load->end - load->ptr) return NULL;
+    load->ptr += REG_CACHE_ALIGN( len );
+    return ret;
+}
+
+/* load a key and its subkeys from the cache */
+static int load_registry_cache_key( struct key *key, struct reg_cache_load *load, int depth )
+{
+    struct reg_cache_key rec;
+    struct reg_cache_value val;
+    struct unicode_str name;
+    struct key_value *value;
+    struct key *subkey;
+    const void *ptr, *class, *data;
+    unsigned int i;
+    int index;
+
+    if (!(ptr = get_registry_cache_data( load, sizeof(rec) ))) return 0;
+    memcpy( &rec, ptr, sizeof(rec) );
+    if (!get_registry_cache_data( load, rec.namelen )) return 0;
+    if (!(class = get_registry_cache_data( load, rec.classlen ))) return 0;
+
+    key->modif = rec.modif;
+    key->flags |= rec.flags & KEY_SYMLINK;
+    if (rec.classlen)
+    {
+        free( key->class );
+        key->classlen = 0;
+        if (!(key->class = memdup( class, rec.classlen ))) return 0;
+        key->classlen = rec.classlen;
+    }
+
+    for (i = 0; i < rec.nb_values; i++)
+    {
+        if (!(ptr = get_registry_cache_data( load, sizeof(val) ))) return 0;
+        memcpy( &val, ptr, sizeof(val) );
+        if (val.namelen % sizeof(WCHAR)) return 0;
+        if (!(name.str = get_registry_cache_data( load, val.namelen ))) return 0;
+        if (!(data = get_registry_cache_data( load, val.len ))) return 0;
+        name.len = val.namelen;
+
+        if (!(value = find_value( key, &name, &index )) &&
+            !(value = insert_value( key, &name, index ))) return 0;
+        free( value->data );
+        value->data = NULL;
+        value->len  = 0;
+        value->type = val.type;
+        if (val.len && !(value->data = memdup( data, val.len ))) return 0;
+        value->len  = val.len;
+    }
+
+    if (depth > 512) return 0;  /* the keys are nested too deep, the cache must be corrupted */
+    for (i = 0; i < rec.nb_subkeys; i++)
+    {
+        struct reg_cache_load sub = *load;
+        struct reg_cache_key subrec;
+
+        /* peek at the name of the subkey to find or create it */
+        if (!(ptr = get_registry_cache_data( &sub, sizeof(subrec) ))) return 0;
+        memcpy( &subrec, ptr, sizeof(subrec) );
+        if (subrec.namelen % sizeof(WCHAR)) return 0;
+        if (!(name.str = get_registry_cache_data( &sub, subrec.namelen ))) return 0;
+        name.len = subrec.namelen;
+
+        if (!(subkey = find_subkey( key, &name, &index )) &&
+            !(subkey = alloc_subkey( key, &name, index, subrec.modif ))) return 0;
+        if (!load_registry_cache_key( subkey, load, depth + 1 )) return 0;
+    }
+    return 1;
+}
+
+/* load a registry branch from its binary cache; return 0 if the cache can't be used */
+static int load_registry_cache( struct key *key, const char *path )
+{
+    const struct reg_cache_header *header;
+    struct reg_cache_load load;
+    struct stat st, cache_st;
+    char *name;
+    void *base;
+    int fd, ret = 0;
+
+    if (!use_registry_cache()) return 0;
+    if (stat( path, &st ) == -1) return 0;
+    if (!(name = get_registry_cache_name( path ))) return 0;
+    fd = open( name, O_RDONLY );
+    free( name );
+    if (fd == -1) return 0;
+
+    if (fstat( fd, &cache_st ) == -1 || cache_st.st_size < (off_t)sizeof(*header) ||
+        (base = mmap( NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+
+    header = base;
+    if (memcmp( header->magic, REG_CACHE_MAGIC, sizeof(header->magic) ) ||
+        header->version != REG_CACHE_VERSION ||
+        header->file_size != st.st_size ||
+        header->file_mtime != st.st_mtime ||
+        header->file_ino != st.st_ino ||
+        header->data_size != cache_st.st_size - sizeof(*header) ||
+        (prefix_type != PREFIX_UNKNOWN && header->prefix_type != prefix_type) ||
+        update_registry_cache_checksum( 0, header + 1, header->data_size ) != header->checksum)
+        goto done;
+
+    if (header->prefix_type != PREFIX_UNKNOWN) prefix_type = header->prefix_type;
+    load.ptr = (const char *)(header + 1);
+    load.end = load.ptr + header->data_size;
+    if (!(ret = load_registry_cache_key( key, &load, 0 ) && load.ptr == load.end))
+        fprintf( stderr, "wineserver: corrupted registry cache for %s\n", path );
+    else if (debug_level > 1)
+        fprintf( stderr, "%s: loaded from the registry cache\n", path );
+
+done:
+    munmap( base, cache_st.st_size );
+    return ret;
+}
+
+/*
+ * Registry journal
+ *
+ * When the WINEREGISTRYJOURNAL environment variable is set, the changes made
+ * to an initial registry branch are appended to a journal file next to it
+ * with a ".journal" suffix, instead of rewriting the whole text file every
+ * time the branch is saved. The journal is replayed on top of the text file
+ * when the registry is loaded; it is only used if the size, modification time
+ * and inode of the text file match the ones recorded in its header.
+ *
+ * Each record is checksummed, so a record torn by a crash in the middle of an
+ * append ends the replay. The text file is rewritten, and the journal removed,
+ * once the journal grows larger than half of the text file.
+ */
+
+#define REG_JOURNAL_MAGIC    "WINEREGJ"
+#define REG_JOURNAL_VERSION  1
+#define REG_JOURNAL_MIN_SIZE (64 * 1024)    /* journal size always allowed before a rewrite */
+#define REG_JOURNAL_MAX_PENDING (1024 * 1024)  /* max size of the records not written yet */
+
+struct reg_journal_header
+{
+    char              magic[8];     /* REG_JOURNAL_MAGIC */
+    unsigned int      version;      /* REG_JOURNAL_VERSION */
+    unsigned int      __pad;
+    unsigned __int64  file_size;    /* size of the text file */
+    unsigned __int64  file_mtime;   /* modification time of the text file */
+    unsigned __int64  file_ino;     /* inode of the text file */
+};
+
+/* followed by the key path relative to the branch, the name and the data, padded to 8 bytes */
+struct reg_journal_record
+{
+    unsigned int      size;         /* total size of the record */
+    unsigned int      op;           /* enum journal_op */
+    timeout_t         modif;        /* modification time */
+    unsigned int      pathlen;      /* length of the key path in bytes */
+    unsigned int      namelen;      /* length of the value name or key class in bytes */
+    unsigned int      type;         /* value type, or key flags */
+    unsigned int      len;          /* length of the value data in bytes */
+    unsigned int      checksum;     /* checksum of the record, computed with this field set to 0 */
+    unsigned int      __pad;
+};
+
+static int journal_replaying;  /* don't record the changes made by the journal replay */
+
+static int use_registry_journal(void)
+{
+    static int enabled = -1;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINEREGISTRYJOURNAL" );
+        enabled = env && atoi( env );
+    }
+    return enabled;
+}
+
+static char *get_registry_journal_name( const char *path )
+{
+    char *name;
+
+    if ((name = malloc( strlen(path) + sizeof(".journal") ))) sprintf( name, "%s.journal", path );
+    return name;
+}
+
+/* find the initial registry branch containing a key */
+static struct save_branch_info *get_key_branch( const struct key *key )
+{
+    int i;
+
+    for ( ; key; key = key->parent)
+        for (i = 0; i < save_branch_count; i++)
+            if (save_branch_info[i].key == key) return &save_branch_info[i];
+    return NULL;
+}
+
+/* forget the journal state once the text file has been rewritten */
+static void reset_registry_journal( struct save_branch_info *info )
+{
+    info->journal_len       = 0;
+    info->journal_file_size = 0;
+    info->journal_invalid   = 0;
+}
+
+/* force the next save of the branch containing the key to rewrite the text file */
+static void invalidate_registry_journal( const struct key *key )
+{
+    struct save_branch_info *info = get_key_branch( key );
+
+    if (!info) return;
+    info->journal_invalid = 1;
+    info->journal_len = 0;
+}
+
+/* copy data to the journal buffer, padded to 8 bytes */
+static char *put_journal_data( char *ptr, const void *data, unsigned int len )
+{
+    if (len) memcpy( ptr, data, len );
+    memset( ptr + len, 0, REG_CACHE_ALIGN( len ) - len );
+    return ptr + REG_CACHE_ALIGN( len );
+}
+
+/* record a change to a key in the journal of its branch */
+static void add_journal_record( const struct key *key, unsigned int op, const WCHAR *name,
+                                data_size_t namelen, unsigned int type, const void *data, data_size_t len )
+{
+    struct save_branch_info *info;
+    struct reg_journal_record *rec;
+    const struct key *k;
+    unsigned int pathlen = 0;
+    size_t size;
+    char *ptr;
+
+    if (!use_registry_journal() || journal_replaying) return;
+    if (key->flags & KEY_VOLATILE) return;
+    if (!(info = get_key_branch( key )) || info->journal_invalid) return;
+    if (key == info->key && op == JOURNAL_DELETE_KEY)
+    {
+        invalidate_registry_journal( key );
+        return;
+    }
+
+    for (k = key; k != info->key; k = k->parent)
+        pathlen += k->namelen + (k->parent != info->key ? sizeof(WCHAR) : 0);
+
+    size = sizeof(*rec) + REG_CACHE_ALIGN( pathlen ) + REG_CACHE_ALIGN( namelen ) + REG_CACHE_ALIGN( len );
+    if (info->journal_len + size > REG_JOURNAL_MAX_PENDING)
+    {
+        invalidate_registry_journal( key );
+        return;
+    }
+    if (info->journal_len + size > info->journal_size)
+    {
+        size_t new_size = max( info->journal_size * 2, max( info->journal_len + size, 4096 ) );
+        char *new_journal = realloc( info->journal, new_size );
+
+        if (!new_journal)
+        {
+            invalidate_registry_journal( key );
+            return;
+        }
+        info->journal = new_journal;
+        info->journal_size = new_size;
+    }
+
+    rec = (struct reg_journal_record *)(info->journal + info->journal_len);
+    memset( rec, 0, sizeof(*rec) );
+    rec->size    = size;
+    rec->op      = op;
+    rec->modif   = current_time;
+    rec->pathlen = pathlen;
+    rec->namelen = namelen;
+    rec->type    = type;
+    rec->len     = len;
+
+    /* the path is built backwards, starting from the key itself */
+    ptr = (char *)(rec + 1);
+    memset( ptr + pathlen, 0, REG_CACHE_ALIGN( pathlen ) - pathlen );
+    for (k = key; k != info->key; k = k->parent)
+    {
+        pathlen -= k->namelen;
+        memcpy( ptr + pathlen, k->name, k->namelen );
+        if (k->parent == info->key) break;
+        pathlen -= sizeof(WCHAR);
+        *(WCHAR *)(ptr + pathlen) = '\\';
+    }
+    ptr += REG_CACHE_ALIGN( rec->pathlen );
+    ptr = put_journal_data( ptr, name, namelen );
+    put_journal_data( ptr, data, len );
+
+    rec->checksum = update_registry_cache_checksum( 0, rec, size );
+    info->journal_len += size;
+}
+
+/* write data to a file, retrying partial writes */
+static int write_registry_journal_data( int fd, const void *data, size_t size )
+{
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = write( fd, data, size )) == -1)
+        {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data = (const char *)data + ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+/* append the pending changes of a branch to its journal; return 0 if the text file must be rewritten */
+static int append_registry_journal( struct save_branch_info *info )
+{
+    struct reg_journal_header header;
+    struct stat st;
+    char *name;
+    int fd, ret;
+
+    if (!(info->key->flags & KEY_DIRTY)) return 1;
+    if (!use_registry_journal() || info->journal_invalid || !info->journal_len) return 0;
+    if (info->saver) return 0;  /* the journal would apply to the file being written */
+    if (stat( info->path, &st ) == -1) return 0;
+    if (info->journal_file_size + info->journal_len > max( st.st_size / 2, REG_JOURNAL_MIN_SIZE ))
+        return 0;  /* time to compact the journal into the text file */
+
+    if (!(name = get_registry_journal_name( info->path ))) return 0;
+    if (info->journal_file_size) fd = open( name, O_WRONLY | O_APPEND );
+    else fd = open( name, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    free( name );
+    if (fd == -1) return 0;
+
+    ret = 1;
+    if (!info->journal_file_size)
+    {
+        memset( &header, 0, sizeof(header) );
+        memcpy( header.magic, REG_JOURNAL_MAGIC, sizeof(header.magic) );
+        header.version    = REG_JOURNAL_VERSION;
+        header.file_size  = st.st_size;
+        header.file_mtime = st.st_mtime;
+        header.file_ino   = st.st_ino;
+        ret = write_registry_journal_data( fd, &header, sizeof(header) );
+        if (ret) info->journal_file_size = sizeof(header);
+    }
+    if (ret) ret = write_registry_journal_data( fd, info->journal, info->journal_len );
+    if (close( fd )) ret = 0;
+
+    if (!ret)
+    {
+        /* the end of the journal may be corrupted now, don't append to it anymore */
+        info->journal_invalid = 1;
+        return 0;
+    }
+    if (debug_level > 1)
+        fprintf( stderr, "%s: appended %u bytes to the journal\n", info->path, (unsigned int)info->journal_len );
+    info->journal_file_size += info->journal_len;
+    info->journal_len = 0;
+    make_clean( info->key );
+    return 1;
+}
+
+/* find a key by its path relative to a branch, without following symlinks */
+static struct key *find_journal_key( struct key *key, const struct unicode_str *path, int create, timeout_t modif )
+{
+    struct unicode_str token;
+    struct key *subkey;
+    int index;
+
+    token.str = NULL;
+    if (!get_path_token( path, &token )) return NULL;
+    while (token.len)
+    {
+        if (!(subkey = find_subkey( key, &token, &index )))
+        {
+            if (!create || !(subkey = alloc_subkey( key, &token, index, modif ))) return NULL;
+            key->modif = modif;
+        }
+        key = subkey;
+        get_path_token( path, &token );
+    }
+    return key;
+}
+
+/* apply a journal record to a branch; return 0 if the record is not valid */
+static int apply_journal_record( struct key *branch, const struct reg_journal_record *rec )
+{
+    struct unicode_str path, name;
+    struct key *key, *parent;
+    const char *ptr = (const char *)(rec + 1);
+    int index;
+
+    path.str = (const WCHAR *)ptr;
+    path.len = rec->pathlen;
+    ptr += REG_CACHE_ALIGN( rec->pathlen );
+    name.str = (const WCHAR *)ptr;
+    name.len = rec->namelen;
+    ptr += REG_CACHE_ALIGN( rec->namelen );
+
+    switch (rec->op)
+    {
+    case JOURNAL_CREATE_KEY:
+        if (!(key = find_journal_key( branch, &path, 1, rec->modif ))) return 0;
+        key->flags |= rec->type & KEY_SYMLINK;
+        if (name.len)
+        {
+            free( key->class );
+            key->classlen = 0;
+            if ((key->class = memdup( name.str, name.len ))) key->classlen = name.len;
+        }
+        key->modif = rec->modif;
+        if (key->parent) key->parent->modif = rec->modif;
+        break;
+    case JOURNAL_DELETE_KEY:
+        if (!path.len) return 0;
+        if (!(key = find_journal_key( branch, &path, 0, rec->modif ))) break;
+        parent = key->parent;
+        if (delete_key( key, 1 ) == -1) return 0;
+        parent->modif = rec->modif;
+        break;
+    case JOURNAL_SET_VALUE:
+        if (!(key = find_journal_key( branch, &path, 1, rec->modif ))) return 0;
+        set_value( key, &name, rec->type, ptr, rec->len );
+        key->modif = rec->modif;
+        break;
+    case JOURNAL_DELETE_VALUE:
+        if (!(key = find_journal_key( branch, &path, 0, rec->modif ))) break;
+        if (find_value( key, &name, &index )) delete_value( key, &name );
+        key->modif = rec->modif;
+        break;
+    default:
+        return 0;
+    }
+    clear_error();
+    return 1;
+}
+
+/* replay the journal of a registry branch after loading its text file */
+static void load_registry_journal( struct save_branch_info *info )
+{
+    const struct reg_journal_header *header;
+    const struct reg_journal_record *rec;
+    struct stat st, journal_st;
+    const char *ptr, *end;
+    char *name;
+    void *base;
+    size_t size;
+    int fd, count = 0;
+
+    if (!use_registry_journal()) return;
+    if (!(name = get_registry_journal_name( info->path ))) return;
+    if ((fd = open( name, O_RDONLY )) == -1) goto done;
+
+    if (stat( info->path, &st ) == -1 || fstat( fd, &journal_st ) == -1 ||
+        journal_st.st_size < (off_t)sizeof(*header) ||
+        (base = mmap( NULL, journal_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        unlink( name );
+        goto done;
+    }
+    close( fd );
+
+    header = base;
+    if (memcmp( header->magic, REG_JOURNAL_MAGIC, sizeof(header->magic) ) ||
+        header->version != REG_JOURNAL_VERSION ||
+        header->file_size != st.st_size ||
+        header->file_mtime != st.st_mtime ||
+        header->file_ino != st.st_ino)
+    {
+        /* the text file was written without the journal, which is now obsolete */
+        munmap( base, journal_st.st_size );
+        unlink( name );
+        goto done;
+    }
+
+    journal_replaying = 1;
+    ptr = (const char *)(header + 1);
+    end = (const char *)base + journal_st.st_size;
+    while ((size_t)(end - ptr) >= sizeof(*rec))
+    {
+        struct reg_journal_record tmp;
+
+        rec = (const struct reg_journal_record *)ptr;
+        if (rec->size > (size_t)(end - ptr) || rec->size % 8 ||
+            rec->size != sizeof(*rec) + (size_t)REG_CACHE_ALIGN( rec->pathlen ) +
+                         REG_CACHE_ALIGN( rec->namelen ) + REG_CACHE_ALIGN( rec->len ) ||
+            rec->pathlen % sizeof(WCHAR) || rec->namelen % sizeof(WCHAR))
+            break;
+        tmp = *rec;
+        tmp.checksum = 0;
+        if (update_registry_cache_checksum( update_registry_cache_checksum( 0, &tmp, sizeof(tmp) ),
+                                            rec + 1, rec->size - sizeof(*rec) ) != rec->checksum)
+            break;
+        if (!apply_journal_record( info->key, rec )) break;
+        ptr += rec->size;
+        count++;
+    }
+    journal_replaying = 0;
+
+    size = ptr - (const char *)base;
+    if (ptr != end)
+    {
+        fprintf( stderr, "wineserver: ignoring the end of the corrupted registry journal for %s\n",
+                 info->path );
+        info->journal_invalid = 1;
+    }
+    else if (size > max( st.st_size / 2, REG_JOURNAL_MIN_SIZE )) info->journal_invalid = 1;
+    else info->journal_file_size = size;
+
+    /* the branch is clean if the text file and the journal match the keys */
+    if (info->journal_invalid) make_dirty( info->key );
+    else make_clean( info->key );
+
+    if (debug_level > 1)
+        fprintf( stderr, "%s: replayed %u journal records\n", info->path, count );
+    munmap( base, journal_st.st_size );
+done:
+    free( name );
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *info;
     FILE *f;
+    int found = 1;
 
-    if ((f = fopen( filename, "r" )))
+    if (load_registry_cache( key, filename )) goto done;
+
+    if (!(f = fopen( filename, "r" ))) found = 0;
+    else
     {
         load_keys( key, filename, f, 0 );
         fclose( f );
@@ -1728,14 +2496,20 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
             fprintf( stderr, "%s is not a valid registry file\n", filename );
             return 1;
         }
+        save_registry_cache( key, filename );
     }
 
+done:
+
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    memset( info, 0, sizeof(*info) );
+    info->path = filename;
+    info->key = (struct key *)grab_object( key );
     make_object_static( &key->obj );
-    return (f != NULL);
+    if (found) load_registry_journal( info );
+    return found;
 }
 
 static WCHAR *format_user_registry_path( const SID *sid, struct unicode_str *path )
@@ -1910,20 +2684,14 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
-/* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+/* write a registry branch to its file, replacing it atomically if possible */
+static int save_branch_file( struct key *key, const char *path )
 {
     struct stat st;
     char *p, *tmp = NULL;
     int fd, count = 0, ret = 0;
     FILE *f;
 
-    if (!(key->flags & KEY_DIRTY))
-    {
-        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
-        return 1;
-    }
-
     /* test the file type */
 
     if ((fd = open( path, O_WRONLY )) != -1)
@@ -1977,13 +2745,202 @@ static int save_branch( struct key *key, const char *path )
         if (ret) ret = !rename( tmp, path );
         if (!ret) unlink( tmp );
     }
+    if (ret)
+    {
+        if (use_registry_journal() && (tmp = get_registry_journal_name( path )) != NULL)
+        {
+            /* the changes in the journal are now part of the text file */
+            unlink( tmp );
+            free( tmp );
+            tmp = NULL;
+        }
+        save_registry_cache( key, path );
+    }
 
 done:
     free( tmp );
-    if (ret) make_clean( key );
     return ret;
 }
 
+/* save a registry branch to a file */
+static int save_branch( struct save_branch_info *info )
+{
+    if (!(info->key->flags & KEY_DIRTY))
+    {
+        if (debug_level > 1) dump_operation( info->key, NULL, "Not saving clean" );
+        return 1;
+    }
+    if (!save_branch_file( info->key, info->path )) return 0;
+    make_clean( info->key );
+    reset_registry_journal( info );
+    return 1;
+}
+
+static void branch_saver_dump( struct object *obj, int verbose );
+static void branch_saver_destroy( struct object *obj );
+static void branch_saver_poll_event( struct fd *fd, int event );
+
+static const struct object_ops branch_saver_ops =
+{
+    sizeof(struct branch_saver),   /* size */
+    branch_saver_dump,             /* dump */
+    no_get_type,                   /* get_type */
+    no_add_queue,                  /* add_queue */
+    NULL,                          /* remove_queue */
+    NULL,                          /* signaled */
+    NULL,                          /* satisfied */
+    no_signal,                     /* signal */
+    no_get_fd,                     /* get_fd */
+    no_map_access,                 /* map_access */
+    default_get_sd,                /* get_sd */
+    default_set_sd,                /* set_sd */
+    no_lookup_name,                /* lookup_name */
+    no_link_name,                  /* link_name */
+    NULL,                          /* unlink_name */
+    no_open_file,                  /* open_file */
+    no_close_handle,               /* close_handle */
+    branch_saver_destroy           /* destroy */
+};
+
+static const struct fd_ops branch_saver_fd_ops =
+{
+    NULL,                          /* get_poll_events */
+    branch_saver_poll_event,       /* poll_event */
+    NULL,                          /* flush */
+    NULL,                          /* get_fd_type */
+    NULL,                          /* ioctl */
+    NULL,                          /* queue_async */
+    NULL,                          /* reselect_async */
+    NULL                           /* cancel_async */
+};
+
+static void branch_saver_dump( struct object *obj, int verbose )
+{
+    struct branch_saver *saver = (struct branch_saver *)obj;
+    assert( obj->ops == &branch_saver_ops );
+    fprintf( stderr, "Registry branch saver path=%s\n", saver->info->path );
+}
+
+static void branch_saver_destroy( struct object *obj )
+{
+    struct branch_saver *saver = (struct branch_saver *)obj;
+    assert( obj->ops == &branch_saver_ops );
+    if (saver->fd) release_object( saver->fd );
+}
+
+/* wait for the result of a background save */
+static int finish_branch_saver( struct branch_saver *saver )
+{
+    struct save_branch_info *info = saver->info;
+    char result = 0;
+    int ret;
+
+    while ((ret = read( get_unix_fd( saver->fd ), &result, 1 )) == -1 && errno == EINTR);
+
+    /* the keys were marked clean when the save started, make sure they get saved again */
+    if (ret != 1 || !result)
+    {
+        make_dirty( info->key );
+        info->journal_invalid = 1;
+    }
+
+    info->saver = NULL;
+    release_object( saver );
+    return ret == 1 && result;
+}
+
+static void branch_saver_poll_event( struct fd *fd, int event )
+{
+    struct branch_saver *saver = get_fd_user( fd );
+    struct save_branch_info *info = saver->info;
+
+    if (!finish_branch_saver( saver ))
+        fprintf( stderr, "wineserver: could not save registry branch to %s\n", info->path );
+}
+
+/* close the server file descriptors inherited by the saver child, except the result pipe */
+static void close_inherited_fds( int keep_fd )
+{
+    int fd, max_fd;
+#ifdef linux
+    DIR *dir;
+    struct dirent *de;
+
+    if ((dir = opendir( "/proc/self/fd" )))
+    {
+        while ((de = readdir( dir )))
+        {
+            if (de->d_name[0] < '0' || de->d_name[0] > '9') continue;
+            fd = atoi( de->d_name );
+            if (fd > 2 && fd != keep_fd && fd != dirfd( dir )) close( fd );
+        }
+        closedir( dir );
+        return;
+    }
+#endif
+    if ((max_fd = sysconf( _SC_OPEN_MAX )) == -1) max_fd = 1024;
+    for (fd = 3; fd < max_fd; fd++) if (fd != keep_fd) close( fd );
+}
+
+/* save a registry branch from a child process, so that the server doesn't block */
+/* the child works on a copy-on-write snapshot of the keys at the time of the fork */
+static void save_branch_background( struct save_branch_info *info )
+{
+    struct branch_saver *saver;
+    int pipe_fds[2], status;
+    pid_t pid;
+
+    if (!(info->key->flags & KEY_DIRTY)) return;
+    if (info->saver) return;  /* don't let an older snapshot overwrite a newer one */
+
+    if (pipe( pipe_fds ) == -1) goto failed;
+    if (!(saver = alloc_object( &branch_saver_ops )))
+    {
+        close( pipe_fds[0] );
+        close( pipe_fds[1] );
+        goto failed;
+    }
+    saver->fd = NULL;
+    saver->info = info;
+
+    switch ((pid = fork()))
+    {
+    case -1:
+        close( pipe_fds[0] );
+        close( pipe_fds[1] );
+        release_object( saver );
+        goto failed;
+    case 0:
+        /* fork again so that the server doesn't have to reap the writer */
+        close_inherited_fds( pipe_fds[1] );
+        if (!fork())
+        {
+            char result = save_branch_file( info->key, info->path );
+            write( pipe_fds[1], &result, 1 );
+        }
+        _exit( 0 );
+    default:
+        close( pipe_fds[1] );
+        while (waitpid( pid, &status, 0 ) == -1 && errno == EINTR);
+        break;
+    }
+
+    if (!(saver->fd = create_anonymous_fd( &branch_saver_fd_ops, pipe_fds[0], &saver->obj, 0 )))
+    {
+        /* the child is still running, but we can't know if it succeeds */
+        release_object( saver );
+        return;
+    }
+    set_fd_events( saver->fd, POLLIN );
+    info->saver = saver;
+    make_clean( info->key );
+    reset_registry_journal( info );
+    return;
+
+failed:
+    save_branch( info );
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
@@ -1992,7 +2949,8 @@ static void periodic_save( void *arg )
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
     for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+        if (!append_registry_journal( &save_branch_info[i] ))
+            save_branch_background( &save_branch_info[i] );
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2012,7 +2970,9 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        /* wait for the background save first, it would overwrite the file otherwise */
+        if (save_branch_info[i].saver) finish_branch_saver( save_branch_info[i].saver );
+        if (!append_registry_journal( &save_branch_info[i] ) && !save_branch( &save_branch_info[i] ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].path );
@@ -2215,6 +3175,8 @@ DECL_HANDLER(load_registry)
         int dummy;
         if ((key = create_key( parent, &name, NULL, 0, KEY_WOW64_64KEY, 0, sd, &dummy )))
         {
+            /* the loaded keys are not recorded in the journal */
+            invalidate_registry_journal( key );
             load_registry( key, req->file );
             release_object( key );
         }
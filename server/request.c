@@ -133,6 +133,9 @@ int config_dir_fd = -1;    /* file descriptor for the config dir */
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
 
+static struct request_stats req_stats[REQ_NB_REQUESTS];  /* per-request-type statistics */
+static enum request stats_req = REQ_NB_REQUESTS;         /* request being handled, for fd accounting */
+
 /* complain about a protocol error and terminate the client connection */
 void fatal_protocol_error( struct thread *thread, const char *err, ... )
 {
@@ -287,23 +290,63 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
-/* call a request handler */
-static void call_req_handler( struct thread *thread )
+/* get a monotonic time stamp for the request statistics */
+static inline timeout_t get_stats_time(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
+        return (timeout_t)ts.tv_sec * TICKS_PER_SEC + ts.tv_nsec / 100;
+#endif
+    return 0;
+}
+
+/* run the handler for the current request of a thread */
+static void run_req_handler( struct thread *thread, union generic_reply *reply )
 {
-    union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    struct process *process;
+    timeout_t start, time;
 
     current = thread;
     current->reply_size = 0;
     clear_error();
-    memset( &reply, 0, sizeof(reply) );
+    memset( reply, 0, sizeof(*reply) );
 
     if (debug_level) trace_request();
 
-    if (req < REQ_NB_REQUESTS)
-        req_handlers[req]( &current->req, &reply );
-    else
+    if (req >= REQ_NB_REQUESTS)
+    {
         set_error( STATUS_NOT_IMPLEMENTED );
+        return;
+    }
+
+    /* the thread may get killed by the handler */
+    process = (struct process *)grab_object( thread->process );
+    stats_req = req;
+    start = get_stats_time();
+
+    req_handlers[req]( &current->req, reply );
+
+    time = get_stats_time() - start;
+    stats_req = REQ_NB_REQUESTS;
+    req_stats[req].count++;
+    req_stats[req].total_time += time;
+    if (time > req_stats[req].max_time) req_stats[req].max_time = time;
+    req_stats[req].reply_bytes += sizeof(*reply) + (current ? current->reply_size : 0);
+    process->request_count++;
+    process->request_time += time;
+    release_object( process );
+}
+
+/* call a request handler */
+static void call_req_handler( struct thread *thread )
+{
+    union generic_reply reply;
+    enum request req = thread->req.request_header.req;
+
+    run_req_handler( thread, &reply );
 
     if (current)
     {
@@ -323,6 +366,45 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* call a request handler for a request queued in the shared memory ring */
+/* the reply overwrites the request; returns 0 if the thread got killed */
+int call_shared_req_handler( struct thread *thread, struct request_max_size *data )
+{
+    union generic_reply reply;
+    enum request req;
+
+    memcpy( &thread->req, data, sizeof(thread->req) );
+    req = thread->req.request_header.req;
+
+    if (thread->req.request_header.request_size || thread->req.request_header.reply_size)
+    {
+        fatal_protocol_error( thread, "variable size data in shared request %d\n", req );
+        return 0;
+    }
+
+    switch (req)
+    {
+    case REQ_get_handle_fd:
+    case REQ_get_shared_sync:
+    case REQ_get_shared_requests:
+        /* requests that may pass a file descriptor must go through the request pipe */
+        fatal_protocol_error( thread, "fd passing in shared request %d\n", req );
+        return 0;
+    default:
+        break;
+    }
+
+    run_req_handler( thread, &reply );
+
+    if (!current) return 0;
+    reply.reply_header.error = current->error;
+    reply.reply_header.reply_size = 0;
+    if (debug_level) trace_reply( req, &reply );
+    memcpy( data, &reply, sizeof(reply) );
+    current = NULL;
+    return 1;
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
@@ -496,7 +578,12 @@ int send_client_fd( struct process *process, int fd, obj_handle_t handle )
 
     ret = sendmsg( get_unix_fd( process->msg_fd ), &msghdr, 0 );
 
-    if (ret == sizeof(handle)) return 0;
+    if (ret == sizeof(handle))
+    {
+        if (stats_req < REQ_NB_REQUESTS) req_stats[stats_req].fd_count++;
+        process->request_fds++;
+        return 0;
+    }
 
     if (ret >= 0)
     {
@@ -898,3 +985,24 @@ void close_master_socket( timeout_t timeout )
 
     master_timeout = add_timeout_user( timeout, close_socket_timeout, NULL );
 }
+
+/* retrieve the per-request-type server statistics */
+DECL_HANDLER(get_request_stats)
+{
+    struct request_stats *stats;
+    unsigned int i, count = min( get_reply_max_size() / sizeof(*stats), REQ_NB_REQUESTS );
+
+    reply->total = REQ_NB_REQUESTS;
+    if ((stats = set_reply_data_size( count * sizeof(*stats) )))
+    {
+        for (i = 0; i < count; i++)
+        {
+            const char *name = get_req_name( i );
+
+            stats[i] = req_stats[i];
+            memset( stats[i].name, 0, sizeof(stats[i].name) );
+            memcpy( stats[i].name, name, min( strlen(name), sizeof(stats[i].name) - 1 ));
+        }
+    }
+    if (req->reset) memset( req_stats, 0, sizeof(req_stats) );
+}
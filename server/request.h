@@ -53,6 +53,11 @@ extern const void *get_req_data_after_objattr( const struct object_attributes *a
 extern int receive_fd( struct process *process );
 extern int send_client_fd( struct process *process, int fd, obj_handle_t handle );
 extern void read_request( struct thread *thread );
+extern int call_shared_req_handler( struct thread *thread, struct request_max_size *data );
+extern int shared_requests_idle( int timeout );
+extern void shared_requests_wakeup(void);
+extern void free_request_ring( struct process *process );
+extern void free_request_slot( struct thread *thread );
 extern void write_reply( struct thread *thread );
 extern unsigned int get_tick_count(void);
 extern void open_master_socket(void);
@@ -64,6 +69,7 @@ extern int server_dir_fd, config_dir_fd;
 
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern const char *get_req_name( enum request req );
 
 /* get the request vararg data */
 static inline const void *get_req_data(void)
@@ -152,6 +158,8 @@ DECL_HANDLER(create_semaphore);
 DECL_HANDLER(release_semaphore);
 DECL_HANDLER(query_semaphore);
 DECL_HANDLER(open_semaphore);
+DECL_HANDLER(get_shared_sync);
+DECL_HANDLER(get_shared_requests);
 DECL_HANDLER(create_file);
 DECL_HANDLER(open_file_object);
 DECL_HANDLER(alloc_file_handle);
@@ -370,6 +378,9 @@ DECL_HANDLER(open_completion);
 DECL_HANDLER(add_completion);
 DECL_HANDLER(remove_completion);
 DECL_HANDLER(query_completion);
+DECL_HANDLER(create_wait_completion);
+DECL_HANDLER(associate_wait_completion);
+DECL_HANDLER(cancel_wait_completion);
 DECL_HANDLER(set_completion_info);
 DECL_HANDLER(add_fd_completion);
 DECL_HANDLER(set_fd_disp_info);
@@ -389,6 +400,8 @@ DECL_HANDLER(process_in_job);
 DECL_HANDLER(set_job_limits);
 DECL_HANDLER(set_job_completion_port);
 DECL_HANDLER(terminate_job);
+DECL_HANDLER(get_request_stats);
+DECL_HANDLER(get_process_request_stats);
 
 #ifdef WANT_REQUEST_HANDLERS
 
@@ -435,6 +448,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_release_semaphore,
     (req_handler)req_query_semaphore,
     (req_handler)req_open_semaphore,
+    (req_handler)req_get_shared_sync,
+    (req_handler)req_get_shared_requests,
     (req_handler)req_create_file,
     (req_handler)req_open_file_object,
     (req_handler)req_alloc_file_handle,
@@ -653,6 +668,9 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_add_completion,
     (req_handler)req_remove_completion,
     (req_handler)req_query_completion,
+    (req_handler)req_create_wait_completion,
+    (req_handler)req_associate_wait_completion,
+    (req_handler)req_cancel_wait_completion,
     (req_handler)req_set_completion_info,
     (req_handler)req_add_fd_completion,
     (req_handler)req_set_fd_disp_info,
@@ -672,6 +690,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_set_job_limits,
     (req_handler)req_set_job_completion_port,
     (req_handler)req_terminate_job,
+    (req_handler)req_get_request_stats,
+    (req_handler)req_get_process_request_stats,
 };
 
 C_ASSERT( sizeof(affinity_t) == 8 );
@@ -960,6 +980,19 @@ C_ASSERT( FIELD_OFFSET(struct open_semaphore_request, rootdir) == 20 );
 C_ASSERT( sizeof(struct open_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_semaphore_reply, handle) == 8 );
 C_ASSERT( sizeof(struct open_semaphore_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_request, need_fd) == 16 );
+C_ASSERT( sizeof(struct get_shared_sync_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_reply, enabled) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_reply, type) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_reply, index) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_reply, access) == 20 );
+C_ASSERT( sizeof(struct get_shared_sync_reply) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_requests_request, need_fd) == 12 );
+C_ASSERT( sizeof(struct get_shared_requests_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_requests_reply, enabled) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_requests_reply, slot) == 12 );
+C_ASSERT( sizeof(struct get_shared_requests_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, sharing) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, create) == 20 );
@@ -2255,6 +2288,21 @@ C_ASSERT( FIELD_OFFSET(struct query_completion_request, handle) == 12 );
 C_ASSERT( sizeof(struct query_completion_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_completion_reply, depth) == 8 );
 C_ASSERT( sizeof(struct query_completion_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_request, access) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_request, attributes) == 16 );
+C_ASSERT( sizeof(struct create_wait_completion_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct create_wait_completion_reply, handle) == 8 );
+C_ASSERT( sizeof(struct create_wait_completion_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct associate_wait_completion_request, handle) == 12 );
+C_ASSERT( FIELD_OFFSET(struct associate_wait_completion_request, port) == 16 );
+C_ASSERT( FIELD_OFFSET(struct associate_wait_completion_request, object) == 20 );
+C_ASSERT( FIELD_OFFSET(struct associate_wait_completion_request, ckey) == 24 );
+C_ASSERT( FIELD_OFFSET(struct associate_wait_completion_request, cvalue) == 32 );
+C_ASSERT( sizeof(struct associate_wait_completion_request) == 40 );
+C_ASSERT( FIELD_OFFSET(struct cancel_wait_completion_request, handle) == 12 );
+C_ASSERT( sizeof(struct cancel_wait_completion_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct cancel_wait_completion_reply, state) == 8 );
+C_ASSERT( sizeof(struct cancel_wait_completion_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_completion_info_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_completion_info_request, ckey) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_completion_info_request, chandle) == 24 );
@@ -2334,6 +2382,16 @@ C_ASSERT( sizeof(struct set_job_completion_port_request) == 32 );
 C_ASSERT( FIELD_OFFSET(struct terminate_job_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct terminate_job_request, status) == 16 );
 C_ASSERT( sizeof(struct terminate_job_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_request_stats_request, reset) == 12 );
+C_ASSERT( sizeof(struct get_request_stats_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_request_stats_reply, total) == 8 );
+C_ASSERT( sizeof(struct get_request_stats_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_process_request_stats_request, handle) == 12 );
+C_ASSERT( sizeof(struct get_process_request_stats_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_process_request_stats_reply, count) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_process_request_stats_reply, fd_count) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_process_request_stats_reply, total_time) == 16 );
+C_ASSERT( sizeof(struct get_process_request_stats_reply) == 24 );
 
 #endif  /* WANT_REQUEST_HANDLERS */
 
@@ -38,25 +38,27 @@
 
 struct semaphore
 {
-    struct object  obj;    /* object header */
-    unsigned int   count;  /* current count */
-    unsigned int   max;    /* maximum possible count */
+    struct object     obj;      /* object header */
+    struct sync_state sync;     /* semaphore state, the current and maximum count */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static struct object_type *semaphore_get_type( struct object *obj );
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
     sizeof(struct semaphore),      /* size */
     semaphore_dump,                /* dump */
     semaphore_get_type,            /* get_type */
-    add_queue,                     /* add_queue */
-    remove_queue,                  /* remove_queue */
+    semaphore_add_queue,           /* add_queue */
+    semaphore_remove_queue,        /* remove_queue */
     semaphore_signaled,            /* signaled */
     semaphore_satisfied,           /* satisfied */
     semaphore_signal,              /* signal */
@@ -69,7 +71,7 @@ static const struct object_ops semaphore_ops =
     default_unlink_name,           /* unlink_name */
     no_open_file,                  /* open_file */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -79,7 +81,7 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
 {
     struct semaphore *sem;
 
-    if (!max || (initial > max))
+    if (!max || (initial > max) || (max & SHARED_SYNC_SERVER_WAIT))
     {
         set_error( STATUS_INVALID_PARAMETER );
         return NULL;
@@ -89,40 +91,61 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            sem->count = initial;
-            sem->max   = max;
+            if (!alloc_sync_state( &sem->sync, current->process ))
+            {
+                release_object( sem );
+                return NULL;
+            }
+            sem->sync.shm->state = initial;
+            sem->sync.shm->count = max;
         }
     }
     return sem;
 }
 
+static inline unsigned int get_semaphore_count( struct semaphore *sem )
+{
+    return sem->sync.shm->state & ~SHARED_SYNC_SERVER_WAIT;
+}
+
 static int release_semaphore( struct semaphore *sem, unsigned int count,
                               unsigned int *prev )
 {
-    if (prev) *prev = sem->count;
-    if (sem->count + count < sem->count || sem->count + count > sem->max)
-    {
-        set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
-        return 0;
-    }
-    else if (sem->count)
-    {
-        /* there cannot be any thread to wake up if the count is != 0 */
-        sem->count += count;
-    }
-    else
+    unsigned int state, old, max = sem->sync.shm->count;
+
+    /* the client may modify the count concurrently while there are no waiters */
+    for (state = sem->sync.shm->state;; state = old)
     {
-        sem->count = count;
-        wake_up( &sem->obj, count );
+        old = state & ~SHARED_SYNC_SERVER_WAIT;
+        if (prev) *prev = old;
+        if (old + count < old || old + count > max)
+        {
+            set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
+            return 0;
+        }
+        old = interlocked_cmpxchg( (int *)&sem->sync.shm->state, state + count, state );
+        if (old == state) break;
     }
+    /* there cannot be any thread to wake up if the count was != 0 */
+    if (!(state & ~SHARED_SYNC_SERVER_WAIT)) wake_up( &sem->obj, count );
     return 1;
 }
 
+/* return the state of a semaphore and its type, or NULL if not a semaphore */
+struct sync_state *get_semaphore_sync_state( struct object *obj, int *type )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+
+    if (obj->ops != &semaphore_ops) return NULL;
+    *type = SHARED_SYNC_SEMAPHORE;
+    return &sem->sync;
+}
+
 static void semaphore_dump( struct object *obj, int verbose )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    fprintf( stderr, "Semaphore count=%d max=%d\n", sem->count, sem->max );
+    fprintf( stderr, "Semaphore count=%d max=%d\n", get_semaphore_count( sem ), sem->sync.shm->count );
 }
 
 static struct object_type *semaphore_get_type( struct object *obj )
@@ -132,19 +155,34 @@ static struct object_type *semaphore_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    return shared_sync_add_queue( obj, entry, &sem->sync );
+}
+
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    shared_sync_remove_queue( obj, entry, &sem->sync );
+}
+
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    return (sem->count > 0);
+    return (get_semaphore_count( sem ) > 0);
 }
 
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    assert( sem->count );
-    sem->count--;
+    assert( get_semaphore_count( sem ));
+    /* clients can't modify the state while we have waiters */
+    interlocked_xchg_add( (int *)&sem->sync.shm->state, -1 );
 }
 
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access )
@@ -169,6 +207,13 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    if (sem->sync.shm) free_sync_state( &sem->sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -223,8 +268,8 @@ DECL_HANDLER(query_semaphore)
     if ((sem = (struct semaphore *)get_handle_obj( current->process, req->handle,
                                                    SEMAPHORE_QUERY_STATE, &semaphore_ops )))
     {
-        reply->current = sem->count;
-        reply->max = sem->max;
+        reply->current = get_semaphore_count( sem );
+        reply->max = sem->sync.shm->count;
         release_object( sem );
     }
 }
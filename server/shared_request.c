@@ -0,0 +1,374 @@
+/*
+ * Server-side shared memory request ring
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * When the WINESHAREDREQUESTS environment variable is set, client threads
+ * can queue requests that have no variable-size data in a memory area
+ * shared with the server, instead of writing them to their request pipe.
+ * Each process gets its own ring, so that it can't see or forge the
+ * requests of other processes.
+ *
+ * The server assigns a slot of the ring to each thread. The client copies
+ * the request to the slot of its thread, then appends the slot number to
+ * the ring. Right before going to sleep the server sets the server_idle
+ * flag and checks the ring one last time, and it clears the flag when it
+ * wakes up; a client that clears the flag writes a byte to the doorbell
+ * pipe of its process to wake up the server. The client is woken up
+ * through a futex on the state of its slot.
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "process.h"
+#include "thread.h"
+#include "request.h"
+
+#if defined(__linux__) && defined(__NR_futex)
+
+struct request_ring
+{
+    struct object        obj;          /* object header */
+    struct fd           *fd;           /* file descriptor of the read end of the doorbell pipe */
+    struct list          entry;        /* entry in the list of request rings */
+    struct process      *process;      /* process owning the ring */
+    shared_requests_t   *shared;       /* server mapping of the shared memory */
+    int                  shared_fd;    /* fd of the shared memory file, sent to the client */
+    int                  doorbell_fd;  /* write end of the doorbell pipe, sent to the client */
+    unsigned int         head;         /* position of the next ring entry to process */
+    struct thread       *threads[SHARED_REQUEST_SLOTS];  /* thread owning each slot */
+};
+
+static void request_ring_dump( struct object *obj, int verbose );
+static void request_ring_destroy( struct object *obj );
+static void request_ring_poll_event( struct fd *fd, int event );
+
+static const struct object_ops request_ring_ops =
+{
+    sizeof(struct request_ring),   /* size */
+    request_ring_dump,             /* dump */
+    no_get_type,                   /* get_type */
+    no_add_queue,                  /* add_queue */
+    NULL,                          /* remove_queue */
+    NULL,                          /* signaled */
+    NULL,                          /* satisfied */
+    no_signal,                     /* signal */
+    no_get_fd,                     /* get_fd */
+    no_map_access,                 /* map_access */
+    default_get_sd,                /* get_sd */
+    default_set_sd,                /* set_sd */
+    no_lookup_name,                /* lookup_name */
+    no_link_name,                  /* link_name */
+    NULL,                          /* unlink_name */
+    no_open_file,                  /* open_file */
+    no_close_handle,               /* close_handle */
+    request_ring_destroy           /* destroy */
+};
+
+static const struct fd_ops request_ring_fd_ops =
+{
+    NULL,                          /* get_poll_events */
+    request_ring_poll_event,       /* poll_event */
+    NULL,                          /* flush */
+    NULL,                          /* get_fd_type */
+    NULL,                          /* ioctl */
+    NULL,                          /* queue_async */
+    NULL,                          /* reselect_async */
+    NULL                           /* cancel_async */
+};
+
+static struct list request_rings = LIST_INIT(request_rings);
+
+static void request_ring_dump( struct object *obj, int verbose )
+{
+    struct request_ring *ring = (struct request_ring *)obj;
+    assert( obj->ops == &request_ring_ops );
+    fprintf( stderr, "Shared request ring process=%p fd=%p\n", ring->process, ring->fd );
+}
+
+static void request_ring_destroy( struct object *obj )
+{
+    struct request_ring *ring = (struct request_ring *)obj;
+    assert( obj->ops == &request_ring_ops );
+
+    list_remove( &ring->entry );
+    if (ring->fd) release_object( ring->fd );
+    if (ring->shared) munmap( (void *)ring->shared, sizeof(*ring->shared) );
+    if (ring->shared_fd != -1) close( ring->shared_fd );
+    if (ring->doorbell_fd != -1) close( ring->doorbell_fd );
+}
+
+static inline void futex_wake( volatile int *addr )
+{
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, INT_MAX, NULL, 0, 0 );
+}
+
+/* store the final state of a request slot and wake up the client */
+static void complete_shared_request( shared_request_t *request, int state )
+{
+    interlocked_xchg( (int *)&request->state, state );
+    if (request->waiting) futex_wake( &request->state );
+}
+
+/* process all the requests currently queued in a ring */
+static void process_shared_requests( struct request_ring *ring )
+{
+    struct request_max_size data;
+    struct thread *thread;
+    shared_request_t *request;
+    unsigned int pos, slot, value;
+
+    for (;;)
+    {
+        volatile unsigned int *entry = &ring->shared->ring[ring->head % SHARED_REQUEST_SLOTS];
+
+        pos = ring->head;
+        if ((value = *entry) == SHARED_REQUEST_ENTRY( pos, 0 )) break;  /* the ring is empty */
+        *entry = SHARED_REQUEST_ENTRY( pos + SHARED_REQUEST_SLOTS, 0 );
+        ring->head++;
+
+        /* entries that weren't queued for this position can only come from a broken client */
+        if ((value & ~0xff) != SHARED_REQUEST_ENTRY( pos, 0 )) continue;
+        slot = value & 0xff;
+        request = &ring->shared->requests[slot];
+        if (request->state != SHARED_REQUEST_PENDING) continue;
+
+        /* the slot owner is only known by the server, the client can't pick another thread */
+        if (!(thread = ring->threads[slot]) || thread->state == TERMINATED)
+        {
+            complete_shared_request( request, SHARED_REQUEST_ABORTED );
+            continue;
+        }
+        grab_object( thread );
+
+        memcpy( &data, (void *)&request->data, sizeof(data) );
+        if (thread->req_toread || thread->reply_towrite)
+        {
+            /* the request pipe must not be in the middle of a request */
+            fatal_protocol_error( thread, "shared request while a pipe request is in progress\n" );
+            complete_shared_request( request, SHARED_REQUEST_ABORTED );
+        }
+        else if (call_shared_req_handler( thread, &data ))
+        {
+            memcpy( (void *)&request->data, &data, sizeof(data) );
+            complete_shared_request( request, SHARED_REQUEST_DONE );
+        }
+        else complete_shared_request( request, SHARED_REQUEST_ABORTED );
+
+        release_object( thread );
+    }
+}
+
+static void request_ring_poll_event( struct fd *fd, int event )
+{
+    struct request_ring *ring = get_fd_user( fd );
+    char buffer[64];
+
+    assert( ring->obj.ops == &request_ring_ops );
+    while (read( get_unix_fd( fd ), buffer, sizeof(buffer) ) > 0) /* nothing */;
+
+    /* the process may get killed by one of the requests */
+    grab_object( ring );
+    process_shared_requests( ring );
+    release_object( ring );
+}
+
+/* check whether the shared memory request rings are enabled */
+static int shared_requests_enabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled == -1) enabled = getenv( "WINESHAREDREQUESTS" ) && atoi( getenv( "WINESHAREDREQUESTS" ));
+    return enabled;
+}
+
+/* create the shared memory file and the doorbell of a process */
+static struct request_ring *create_request_ring( struct process *process )
+{
+    struct request_ring *ring;
+    unsigned int i;
+    int pipe_fds[2];
+    void *ptr;
+
+    if (!(ring = alloc_object( &request_ring_ops ))) return NULL;
+    ring->fd          = NULL;
+    ring->process     = process;
+    ring->shared      = NULL;
+    ring->doorbell_fd = -1;
+    ring->head        = 0;
+    memset( ring->threads, 0, sizeof(ring->threads) );
+    list_add_tail( &request_rings, &ring->entry );
+
+    if ((ring->shared_fd = create_temp_file( sizeof(*ring->shared) )) == -1) goto failed;
+    ptr = mmap( NULL, sizeof(*ring->shared), PROT_READ | PROT_WRITE, MAP_SHARED, ring->shared_fd, 0 );
+    if (ptr == MAP_FAILED) goto failed;
+    ring->shared = ptr;
+    for (i = 0; i < SHARED_REQUEST_SLOTS; i++) ring->shared->ring[i] = SHARED_REQUEST_ENTRY( i, 0 );
+
+    if (pipe( pipe_fds ) == -1) goto failed;
+    fcntl( pipe_fds[0], F_SETFL, O_NONBLOCK );
+    fcntl( pipe_fds[1], F_SETFL, O_NONBLOCK );
+    ring->doorbell_fd = pipe_fds[1];
+    if (!(ring->fd = create_anonymous_fd( &request_ring_fd_ops, pipe_fds[0], &ring->obj, 0 ))) goto failed;
+    set_fd_events( ring->fd, POLLIN );
+    return ring;
+
+failed:
+    release_object( ring );
+    return NULL;
+}
+
+/* release the request ring of a process that has no threads left */
+void free_request_ring( struct process *process )
+{
+    if (!process->request_ring) return;
+    release_object( process->request_ring );
+    process->request_ring = NULL;
+}
+
+/* release the request slot of a terminated thread */
+void free_request_slot( struct thread *thread )
+{
+    struct request_ring *ring = thread->process->request_ring;
+
+    if (!thread->request_slot) return;
+    assert( ring->threads[thread->request_slot] == thread );
+    ring->threads[thread->request_slot] = NULL;
+    thread->request_slot = 0;
+}
+
+/* called before the server waits for events, with the wait timeout; */
+/* processes the queued requests and returns 0 if it must not sleep */
+int shared_requests_idle( int timeout )
+{
+    struct request_ring *ring;
+    unsigned int empty;
+
+    LIST_FOR_EACH_ENTRY( ring, &request_rings, struct request_ring, entry )
+    {
+        if (!ring->shared) continue;
+        /* only ask for the doorbell if we are really going to sleep */
+        if (timeout) ring->shared->server_idle = 1;
+        /* the flag must be set before the ring is checked */
+        empty = SHARED_REQUEST_ENTRY( ring->head, 0 );
+        if (interlocked_cmpxchg( (int *)&ring->shared->ring[ring->head % SHARED_REQUEST_SLOTS],
+                                 empty, empty ) == empty)
+            continue;
+
+        /* processing the requests may destroy other rings, so stop there, */
+        /* the remaining ones are checked the next time around */
+        ring->shared->server_idle = 0;
+        grab_object( ring );
+        process_shared_requests( ring );
+        release_object( ring );
+        return 0;
+    }
+    return 1;
+}
+
+/* called when the server wakes up, the clients don't need the doorbell while it's busy */
+void shared_requests_wakeup(void)
+{
+    struct request_ring *ring;
+
+    LIST_FOR_EACH_ENTRY( ring, &request_rings, struct request_ring, entry )
+        if (ring->shared) ring->shared->server_idle = 0;
+}
+
+/* retrieve the shared memory request ring of the process */
+DECL_HANDLER(get_shared_requests)
+{
+    struct request_ring *ring = current->process->request_ring;
+    unsigned int slot;
+
+    if (!shared_requests_enabled()) return;
+    if (!ring && !(ring = current->process->request_ring = create_request_ring( current->process )))
+    {
+        clear_error();
+        return;
+    }
+    reply->enabled = 1;
+
+    if (!current->request_slot)
+    {
+        for (slot = 1; slot < SHARED_REQUEST_SLOTS; slot++)
+        {
+            if (ring->threads[slot]) continue;
+            ring->threads[slot] = current;
+            current->request_slot = slot;
+            break;
+        }
+    }
+    reply->slot = current->request_slot;
+
+    if (req->need_fd)
+    {
+        send_client_fd( current->process, ring->shared_fd, 0 );
+        send_client_fd( current->process, ring->doorbell_fd, 1 );
+    }
+}
+
+#else  /* defined(__linux__) && defined(__NR_futex) */
+
+void free_request_ring( struct process *process )
+{
+}
+
+void free_request_slot( struct thread *thread )
+{
+}
+
+int shared_requests_idle( int timeout )
+{
+    return 1;
+}
+
+void shared_requests_wakeup(void)
+{
+}
+
+DECL_HANDLER(get_shared_requests)
+{
+    reply->enabled = 0;
+}
+
+#endif  /* defined(__linux__) && defined(__NR_futex) */
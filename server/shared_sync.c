@@ -0,0 +1,317 @@
+/*
+ * Server-side shared memory state for synchronization objects
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * When the WINESHAREDSYNC environment variable is set, the state of the
+ * events, semaphores and mutexes created by a process is stored in a sync
+ * area, a file mapped by the server and by that process only. As long as
+ * all the handles to an object are owned by the process that created it,
+ * its threads can set and reset events, release semaphores and mutexes,
+ * and acquire them without blocking with atomic operations on the shared
+ * state, without a server round-trip.
+ *
+ * The server only steps in under contention: as long as threads are
+ * waiting for an object in the server, the SHARED_SYNC_SERVER_WAIT flag is
+ * set in its state, and the clients then fall back to server requests, so
+ * that the server remains in control of which waiting thread gets woken
+ * up. When another process gets a handle to the object, its state is moved
+ * to server memory and the flag is left set in the sync area for good, so
+ * that a process can never modify objects used by other processes.
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "process.h"
+#include "thread.h"
+#include "request.h"
+
+#define SYNC_AREA_SIZE   (1024 * 1024)
+#define SYNC_AREA_SLOTS  (SYNC_AREA_SIZE / sizeof(shared_sync_t))
+
+struct sync_area
+{
+    struct object  obj;            /* object header */
+    int            fd;             /* fd of the shared memory file, sent to the client */
+    shared_sync_t *base;           /* server mapping of the shared memory */
+    unsigned int   used;           /* first never used slot, slot 0 is reserved */
+    unsigned int  *free_slots;     /* stack of freed slots */
+    unsigned int   nb_free_slots;
+    unsigned int   max_free_slots;
+    struct list    mutexes;        /* mutexes local to the process */
+};
+
+static void sync_area_dump( struct object *obj, int verbose );
+static void sync_area_destroy( struct object *obj );
+
+static const struct object_ops sync_area_ops =
+{
+    sizeof(struct sync_area),      /* size */
+    sync_area_dump,                /* dump */
+    no_get_type,                   /* get_type */
+    no_add_queue,                  /* add_queue */
+    NULL,                          /* remove_queue */
+    NULL,                          /* signaled */
+    NULL,                          /* satisfied */
+    no_signal,                     /* signal */
+    no_get_fd,                     /* get_fd */
+    no_map_access,                 /* map_access */
+    default_get_sd,                /* get_sd */
+    default_set_sd,                /* set_sd */
+    no_lookup_name,                /* lookup_name */
+    no_link_name,                  /* link_name */
+    NULL,                          /* unlink_name */
+    no_open_file,                  /* open_file */
+    no_close_handle,               /* close_handle */
+    sync_area_destroy              /* destroy */
+};
+
+static void sync_area_dump( struct object *obj, int verbose )
+{
+    struct sync_area *area = (struct sync_area *)obj;
+    assert( obj->ops == &sync_area_ops );
+    fprintf( stderr, "Sync area used=%u free=%u\n", area->used, area->nb_free_slots );
+}
+
+static void sync_area_destroy( struct object *obj )
+{
+    struct sync_area *area = (struct sync_area *)obj;
+    assert( obj->ops == &sync_area_ops );
+
+    assert( list_empty( &area->mutexes ));
+    if (area->base) munmap( (void *)area->base, SYNC_AREA_SIZE );
+    if (area->fd != -1) close( area->fd );
+    free( area->free_slots );
+}
+
+/* check whether the shared memory synchronization is enabled */
+static int shared_sync_enabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled == -1) enabled = getenv( "WINESHAREDSYNC" ) && atoi( getenv( "WINESHAREDSYNC" ));
+    return enabled;
+}
+
+/* get the sync area of a process, creating it on first use */
+static struct sync_area *get_sync_area( struct process *process )
+{
+    struct sync_area *area;
+    void *ptr;
+
+    if (process->sync_area) return process->sync_area;
+
+    if (!(area = alloc_object( &sync_area_ops ))) return NULL;
+    area->base           = NULL;
+    area->used           = 1;
+    area->free_slots     = NULL;
+    area->nb_free_slots  = 0;
+    area->max_free_slots = 0;
+    list_init( &area->mutexes );
+
+    if ((area->fd = create_temp_file( SYNC_AREA_SIZE )) == -1) goto failed;
+    ptr = mmap( NULL, SYNC_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, area->fd, 0 );
+    if (ptr == MAP_FAILED) goto failed;
+    area->base = ptr;
+    return process->sync_area = area;
+
+failed:
+    release_object( area );
+    return NULL;
+}
+
+/* release the sync area of a process; the objects still using it keep a reference */
+void release_sync_area( struct process *process )
+{
+    if (!process->sync_area) return;
+    release_object( process->sync_area );
+    process->sync_area = NULL;
+}
+
+/* retrieve the list of the mutexes local to the process of a sync area */
+struct list *get_sync_area_mutexes( struct sync_area *area )
+{
+    return &area->mutexes;
+}
+
+/* allocate the state of a synchronization object, local to the given process if any */
+int alloc_sync_state( struct sync_state *sync, struct process *process )
+{
+    struct sync_area *area = NULL;
+    unsigned int index = 0;
+
+    if (process && shared_sync_enabled() && (area = get_sync_area( process )))
+    {
+        if (area->nb_free_slots) index = area->free_slots[--area->nb_free_slots];
+        else if (area->used < SYNC_AREA_SLOTS) index = area->used++;
+    }
+    if (index)
+    {
+        sync->shm   = &area->base[index];
+        sync->area  = (struct sync_area *)grab_object( area );
+        sync->index = index;
+    }
+    else
+    {
+        sync->area  = NULL;
+        sync->index = 0;
+        if (!(sync->shm = mem_alloc( sizeof(*sync->shm) ))) return 0;
+    }
+    memset( (void *)sync->shm, 0, sizeof(*sync->shm) );
+    return 1;
+}
+
+/* free the state of a synchronization object */
+void free_sync_state( struct sync_state *sync )
+{
+    struct sync_area *area = sync->area;
+
+    if (!is_sync_state_local( sync )) free( (void *)sync->shm );
+    sync->shm = NULL;
+    if (!area) return;
+
+    if (area->nb_free_slots == area->max_free_slots)
+    {
+        unsigned int new_max = max( area->max_free_slots * 2, 256 );
+        unsigned int *new_slots = realloc( area->free_slots, new_max * sizeof(*new_slots) );
+
+        if (new_slots)
+        {
+            area->free_slots = new_slots;
+            area->max_free_slots = new_max;
+        }
+    }
+    /* leak the slot if we can't remember it */
+    if (area->nb_free_slots < area->max_free_slots) area->free_slots[area->nb_free_slots++] = sync->index;
+    sync->area = NULL;
+    release_object( area );
+}
+
+/* check whether the state of an object is still in the sync area of its process */
+int is_sync_state_local( const struct sync_state *sync )
+{
+    return sync->area && sync->shm == &sync->area->base[sync->index];
+}
+
+/* move the state of an object to server memory */
+/* the slot is kept until the object is destroyed, since the client may still have it cached */
+void unshare_sync_state( struct sync_state *sync )
+{
+    shared_sync_t *shm;
+
+    if (!is_sync_state_local( sync )) return;
+    if (!(shm = mem_alloc( sizeof(*shm) ))) return;  /* keep using the sync area */
+
+    /* once the flag is set, the client can no longer modify the state */
+    shm->state = update_shared_sync( sync->shm, SHARED_SYNC_SERVER_WAIT, SHARED_SYNC_SERVER_WAIT );
+    shm->count = sync->shm->count;
+    shm->__pad[0] = shm->__pad[1] = 0;
+    sync->shm = shm;
+}
+
+/* atomically replace the bits of the state selected by mask, and return the previous state */
+unsigned int update_shared_sync( shared_sync_t *shm, unsigned int mask, unsigned int value )
+{
+    unsigned int prev, state;
+
+    for (state = shm->state;; state = prev)
+    {
+        prev = interlocked_cmpxchg( (int *)&shm->state, (state & ~mask) | (value & mask), state );
+        if (prev == state) return prev;
+    }
+}
+
+/* add a thread to the wait queue of an object that has a shared state */
+int shared_sync_add_queue( struct object *obj, struct wait_queue_entry *entry, struct sync_state *sync )
+{
+    /* the flag must be set before the object is checked for being signaled */
+    if (list_empty( &obj->wait_queue ))
+        update_shared_sync( sync->shm, SHARED_SYNC_SERVER_WAIT, SHARED_SYNC_SERVER_WAIT );
+    return add_queue( obj, entry );
+}
+
+/* remove a thread from the wait queue of an object that has a shared state */
+void shared_sync_remove_queue( struct object *obj, struct wait_queue_entry *entry, struct sync_state *sync )
+{
+    remove_queue( obj, entry );
+    if (list_empty( &obj->wait_queue )) update_shared_sync( sync->shm, SHARED_SYNC_SERVER_WAIT, 0 );
+}
+
+/* retrieve the state of an event, semaphore or mutex */
+static struct sync_state *get_sync_state( struct object *obj, int *type )
+{
+    struct sync_state *sync;
+
+    if (!(sync = get_event_sync_state( obj, type )) &&
+        !(sync = get_semaphore_sync_state( obj, type )))
+        sync = get_mutex_sync_state( obj, type );
+    return sync;
+}
+
+/* called when a process gets a handle to an object: the state of an object */
+/* local to another process is moved to server memory */
+void unshare_sync_object( struct process *process, struct object *obj )
+{
+    struct sync_state *sync;
+    int type;
+
+    if (!(sync = get_sync_state( obj, &type )) || !is_sync_state_local( sync )) return;
+    if (process && sync->area == process->sync_area) return;
+
+    if (type == SHARED_SYNC_MUTEX) unshare_mutex( obj );
+    else unshare_sync_state( sync );
+}
+
+/* retrieve the shared memory state of a synchronization object */
+DECL_HANDLER(get_shared_sync)
+{
+    struct sync_state *sync;
+    struct object *obj;
+    int type;
+
+    if (!(reply->enabled = shared_sync_enabled())) return;
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+
+    if ((sync = get_sync_state( obj, &type )) && is_sync_state_local( sync ) &&
+        sync->area == current->process->sync_area)
+    {
+        reply->type   = type;
+        reply->index  = sync->index;
+        reply->access = get_handle_access( current->process, req->handle );
+        if (req->need_fd) send_client_fd( current->process, sync->area->fd, req->handle );
+    }
+    release_object( obj );
+}
@@ -1203,6 +1203,27 @@ static void dump_varargs_handle_infos( const char *prefix, data_size_t size )
     fputc( '}', stderr );
 }
 
+static void dump_varargs_request_stats( const char *prefix, data_size_t size )
+{
+    const struct request_stats *stats;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*stats))
+    {
+        stats = cur_data;
+        fprintf( stderr, "{name=%.*s,count=%u,fd_count=%u", (int)sizeof(stats->name),
+                 stats->name, stats->count, stats->fd_count );
+        dump_uint64( ",reply_bytes=", &stats->reply_bytes );
+        dump_uint64( ",total_time=", (const unsigned __int64 *)&stats->total_time );
+        dump_uint64( ",max_time=", (const unsigned __int64 *)&stats->max_time );
+        fputc( '}', stderr );
+        size -= sizeof(*stats);
+        remove_data( sizeof(*stats) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
 typedef void (*dump_func)( const void *req );
 
 /* Everything below this line is generated automatically by tools/make_requests */
@@ -1699,6 +1720,31 @@ static void dump_open_semaphore_reply( const struct open_semaphore_reply *req )
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_get_shared_sync_request( const struct get_shared_sync_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", need_fd=%d", req->need_fd );
+}
+
+static void dump_get_shared_sync_reply( const struct get_shared_sync_reply *req )
+{
+    fprintf( stderr, " enabled=%d", req->enabled );
+    fprintf( stderr, ", type=%d", req->type );
+    fprintf( stderr, ", index=%08x", req->index );
+    fprintf( stderr, ", access=%08x", req->access );
+}
+
+static void dump_get_shared_requests_request( const struct get_shared_requests_request *req )
+{
+    fprintf( stderr, " need_fd=%d", req->need_fd );
+}
+
+static void dump_get_shared_requests_reply( const struct get_shared_requests_reply *req )
+{
+    fprintf( stderr, " enabled=%d", req->enabled );
+    fprintf( stderr, ", slot=%08x", req->slot );
+}
+
 static void dump_create_file_request( const struct create_file_request *req )
 {
     fprintf( stderr, " access=%08x", req->access );
@@ -4246,6 +4292,36 @@ static void dump_query_completion_reply( const struct query_completion_reply *re
     fprintf( stderr, " depth=%08x", req->depth );
 }
 
+static void dump_create_wait_completion_request( const struct create_wait_completion_request *req )
+{
+    fprintf( stderr, " access=%08x", req->access );
+    fprintf( stderr, ", attributes=%08x", req->attributes );
+}
+
+static void dump_create_wait_completion_reply( const struct create_wait_completion_reply *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_associate_wait_completion_request( const struct associate_wait_completion_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", port=%04x", req->port );
+    fprintf( stderr, ", object=%04x", req->object );
+    dump_uint64( ", ckey=", &req->ckey );
+    dump_uint64( ", cvalue=", &req->cvalue );
+}
+
+static void dump_cancel_wait_completion_request( const struct cancel_wait_completion_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_cancel_wait_completion_reply( const struct cancel_wait_completion_reply *req )
+{
+    fprintf( stderr, " state=%d", req->state );
+}
+
 static void dump_set_completion_info_request( const struct set_completion_info_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4406,6 +4482,29 @@ static void dump_terminate_job_request( const struct terminate_job_request *req
     fprintf( stderr, ", status=%d", req->status );
 }
 
+static void dump_get_request_stats_request( const struct get_request_stats_request *req )
+{
+    fprintf( stderr, " reset=%d", req->reset );
+}
+
+static void dump_get_request_stats_reply( const struct get_request_stats_reply *req )
+{
+    fprintf( stderr, " total=%d", req->total );
+    dump_varargs_request_stats( ", stats=", cur_size );
+}
+
+static void dump_get_process_request_stats_request( const struct get_process_request_stats_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_get_process_request_stats_reply( const struct get_process_request_stats_reply *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    fprintf( stderr, ", fd_count=%08x", req->fd_count );
+    dump_timeout( ", total_time=", &req->total_time );
+}
+
 static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_new_process_request,
     (dump_func)dump_get_new_process_info_request,
@@ -4447,6 +4546,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_release_semaphore_request,
     (dump_func)dump_query_semaphore_request,
     (dump_func)dump_open_semaphore_request,
+    (dump_func)dump_get_shared_sync_request,
+    (dump_func)dump_get_shared_requests_request,
     (dump_func)dump_create_file_request,
     (dump_func)dump_open_file_object_request,
     (dump_func)dump_alloc_file_handle_request,
@@ -4665,6 +4766,9 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_add_completion_request,
     (dump_func)dump_remove_completion_request,
     (dump_func)dump_query_completion_request,
+    (dump_func)dump_create_wait_completion_request,
+    (dump_func)dump_associate_wait_completion_request,
+    (dump_func)dump_cancel_wait_completion_request,
     (dump_func)dump_set_completion_info_request,
     (dump_func)dump_add_fd_completion_request,
     (dump_func)dump_set_fd_disp_info_request,
@@ -4684,6 +4788,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_set_job_limits_request,
     (dump_func)dump_set_job_completion_port_request,
     (dump_func)dump_terminate_job_request,
+    (dump_func)dump_get_request_stats_request,
+    (dump_func)dump_get_process_request_stats_request,
 };
 
 static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
@@ -4727,6 +4833,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_release_semaphore_reply,
     (dump_func)dump_query_semaphore_reply,
     (dump_func)dump_open_semaphore_reply,
+    (dump_func)dump_get_shared_sync_reply,
+    (dump_func)dump_get_shared_requests_reply,
     (dump_func)dump_create_file_reply,
     (dump_func)dump_open_file_object_reply,
     (dump_func)dump_alloc_file_handle_reply,
@@ -4945,6 +5053,9 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     (dump_func)dump_remove_completion_reply,
     (dump_func)dump_query_completion_reply,
+    (dump_func)dump_create_wait_completion_reply,
+    NULL,
+    (dump_func)dump_cancel_wait_completion_reply,
     NULL,
     NULL,
     NULL,
@@ -4964,6 +5075,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     NULL,
+    (dump_func)dump_get_request_stats_reply,
+    (dump_func)dump_get_process_request_stats_reply,
 };
 
 static const char * const req_names[REQ_NB_REQUESTS] = {
@@ -5007,6 +5120,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "release_semaphore",
     "query_semaphore",
     "open_semaphore",
+    "get_shared_sync",
+    "get_shared_requests",
     "create_file",
     "open_file_object",
     "alloc_file_handle",
@@ -5225,6 +5340,9 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "add_completion",
     "remove_completion",
     "query_completion",
+    "create_wait_completion",
+    "associate_wait_completion",
+    "cancel_wait_completion",
     "set_completion_info",
     "add_fd_completion",
     "set_fd_disp_info",
@@ -5244,6 +5362,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "set_job_limits",
     "set_job_completion_port",
     "terminate_job",
+    "get_request_stats",
+    "get_process_request_stats",
 };
 
 static const struct
@@ -5360,6 +5480,7 @@ static const struct
     { "USER_APC",                    STATUS_USER_APC },
     { "USER_MAPPED_FILE",            STATUS_USER_MAPPED_FILE },
     { "VOLUME_DISMOUNTED",           STATUS_VOLUME_DISMOUNTED },
+    { "WAIT_0",                      STATUS_WAIT_0 },
     { "WAS_LOCKED",                  STATUS_WAS_LOCKED },
     { NULL, 0 }
 };
@@ -5417,3 +5538,8 @@ void trace_reply( enum request req, const union generic_reply *reply )
     else fprintf( stderr, "%04x: %d() = %s\n",
                   current->id, req, get_status_name(current->error) );
 }
+
+const char *get_req_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : NULL;
+}